@@ -0,0 +1,47 @@
+/**
+ * @file	aggregator.h
+ * @brief	Header file for aggregator.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_AGGREGATOR_H_
+#define INC_AGGREGATOR_H_
+
+#include "can.h"
+#include "node_id.h"
+
+#define AGGREGATOR_WINDOWS 2 /**> @def Sample periods collected at the same time */
+#define AGGREGATOR_MEMBER_WORDS ((NODE_ID_MAX + 32U) / 32U) /**> @def Words of the member bitmap, one bit per node */
+#define AGGREGATOR_CLAIM_TIMEOUT_MS 15000 /**> @def A member without claims for this long sends its telemetry again, three rounds of one word per sample */
+
+/**
+ * @enum Quantities fused, all in the same frame
+ */
+typedef enum aggregator_quantity {
+  AGGREGATOR_TEMP = 0,
+  AGGREGATOR_RH = 1,
+  AGGREGATOR_QUANTITIES = 2
+} aggregator_quantity;
+
+/**
+ * @struct Counters of the aggregator
+ */
+typedef struct aggregator_stats {
+  uint32_t fused; /* Lecturas de otros nodos incluidas */
+  uint32_t duplicated; /* Segunda lectura de un nodo en el mismo periodo */
+  uint32_t no_window; /* Lecturas de un periodo sin ventana libre */
+  uint32_t frames; /* Marcos agregados enviados */
+  uint32_t fed; /* Lecturas propias enviadas al agregador que reclamó al nodo */
+} aggregator_stats;
+
+void aggregator_init(can_handle* handle);
+void aggregator_add_reading(can_handle* handle, float temp, float rh, uint8_t error_flags, uint32_t sample_us);
+const aggregator_stats* aggregator_get_stats(void);
+int aggregator_is_claimed(void);
+
+void aggregator_frame(can_handle* handle, const can_rx_view* frame);
+void aggregator_claim(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_AGGREGATOR_H_ */
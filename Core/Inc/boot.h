@@ -0,0 +1,43 @@
+/**
+ * @file	boot.h
+ * @brief	Header file for boot.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_BOOT_H_
+#define INC_BOOT_H_
+
+#include "stm32f0xx_hal.h"
+
+#define BOOT_NOT_REACHED 0xFFFFFFFFU /**> @def Time of a phase that didn't end */
+#define BOOT_REPORT_UNIT_US 100U /**> @def Unit of the times in the boot report frame */
+
+/**
+ * @enum Boot phases, in the order they end
+ */
+typedef enum boot_phase {
+  BOOT_CLOCK = 0, /* HSE y PLL enganchados */
+  BOOT_CAN = 1, /* CAN arrancado y primer heartbeat en cola */
+  BOOT_SENSORS = 2, /* ADC y TIM2 configurados */
+  BOOT_LOG = 3, /* Registro en flash recorrido */
+  BOOT_FIRST_READING = 4, /* Primera lectura sin errores */
+  BOOT_PHASES = 5
+} boot_phase;
+
+/**
+ * @struct Boot timestamps and reset cause
+ */
+typedef struct boot_stats {
+  uint32_t phases[BOOT_PHASES]; /* µs desde HAL_Init(), BOOT_NOT_REACHED si no termino */
+  uint8_t reset_flags; /* Bits 24 a 31 de RCC_CSR */
+} boot_stats;
+
+void boot_init(void);
+void boot_mark(boot_phase phase);
+int boot_reached(boot_phase phase);
+const boot_stats* boot_get_stats(void);
+void boot_pack_report(uint8_t* data);
+
+#endif /* INC_BOOT_H_ */
@@ -19,6 +19,9 @@ CAN permite la transmisión de paquetes con información de 0 a 8 bytes, o sea,
   - Transmitir humedad y temperatura en un mismo paquete, como un float de 4 bytes.
   - Transmitir por separado en dos paquetes, como un double de 8 bytes.
 Aqui no es necesaria la precisión de 8 bytes, asi que se optara por un solo paquete.
+
+Para incluir el momento de la lectura, temperatura y humedad se mandan en punto fijo, ver
+can_pack_reading(), dejando tres bytes para el tiempo del bus.
 */
 
 #define CAN_MAX_BYTES 8 /**> @def Defines max amount of bytes transfered in a CAN packet */
@@ -37,8 +40,173 @@ typedef enum can_error {
 typedef CAN_TxHeaderTypeDef can_tx_packet; /**> @typedef Alias for CAN_TxHeaderTypeDef */
 typedef CAN_RxHeaderTypeDef can_rx_packet; /**> @typedef Alias for CAN_RxHeaderTypeDef */
 typedef CAN_HandleTypeDef can_handle; /**> @brief Alias for CAN_HandleTypeDef */
+typedef CAN_FIFOMailBox_TypeDef can_rx_mailbox; /**> @typedef Alias for CAN_FIFOMailBox_TypeDef */
+
+#define CAN_MAX_RX_HANDLERS 16 /**> @def Handler table size, 4 filter banks in 16-bit list mode */
+#define CAN_FILTER_SLOTS_PER_BANK 4 /**> @def 16-bit identifiers held by a filter bank in list mode */
+#define CAN_FILTER_BANKS 14 /**> @def Filter banks of bxCAN on a single CAN device, 0 to 13 */
+#define CAN_MAX_MASK_HANDLERS 4 /**> @def Identifier ranges routed to FIFO1, one filter bank each */
+#define CAN_MASK_FILTER_FIRST_BANK (CAN_FILTER_BANKS - CAN_MAX_MASK_HANDLERS) /**> @def First filter bank used by the ranges, the last banks of the device */
+#define CAN_MAX_COMMANDS 16 /**> @def Size of the control panel command table */
+#define CAN_STAMP_LOG_SIZE 32 /**> @def Hardware timestamps kept, must be a power of two */
+#define CAN_STAMP_TX 0x8000U /**> @def Flag set in can_stamp.id for transmitted frames */
+
+/**
+ * @enum Commands sent by the control panel as data frames, the code is the first byte
+ */
+typedef enum can_command {
+  CAN_CMD_SET_SLOT = 0x01,
+  CAN_CMD_SYNC = 0x02,
+  CAN_CMD_PDO_CONFIG = 0x03,
+  CAN_CMD_OD_READ = 0x04,
+  CAN_CMD_OD_WRITE = 0x05,
+  CAN_CMD_LOG_TIME = 0x06,
+  CAN_CMD_LOG_QUERY = 0x07,
+  CAN_CMD_CONFIG = 0x08,
+  CAN_CMD_TRACE = 0x09
+} can_command;
+
+/**
+ * @struct Read only view of a frame still held in a hardware FIFO output mailbox.
+ *         It is only valid while the handler it was passed to is running, the
+ *         mailbox is released as soon as the handler returns.
+ */
+typedef struct can_rx_view {
+  const volatile can_rx_mailbox* mailbox;
+  uint32_t fifo;
+} can_rx_view;
+
+/**
+ * @typedef Receive handler, called from the CAN RX interrupt
+ */
+typedef void (*can_rx_handler)(can_handle* handle, const can_rx_view* frame);
+
+/* Accesores de la vista, leen directamente los registros del mailbox */
+static inline uint32_t can_view_std_id(const can_rx_view* frame)
+{
+  return (frame->mailbox->RIR & CAN_RI0R_STID) >> CAN_RI0R_STID_Pos;
+}
+
+static inline uint32_t can_view_is_rtr(const can_rx_view* frame)
+{
+  return (frame->mailbox->RIR & CAN_RI0R_RTR) != 0;
+}
+
+static inline uint32_t can_view_dlc(const can_rx_view* frame)
+{
+  return (frame->mailbox->RDTR & CAN_RDT0R_DLC) >> CAN_RDT0R_DLC_Pos;
+}
+
+static inline uint32_t can_view_fmi(const can_rx_view* frame)
+{
+  return (frame->mailbox->RDTR & CAN_RDT0R_FMI) >> CAN_RDT0R_FMI_Pos;
+}
+
+/* Tiempo del SOF en bits del bus, capturado por hardware (requiere TTCM) */
+static inline uint16_t can_view_timestamp(const can_rx_view* frame)
+{
+  return (uint16_t)((frame->mailbox->RDTR & CAN_RDT0R_TIME) >> CAN_RDT0R_TIME_Pos);
+}
+
+static inline uint32_t can_view_low_word(const can_rx_view* frame)
+{
+  return frame->mailbox->RDLR;
+}
+
+static inline uint32_t can_view_high_word(const can_rx_view* frame)
+{
+  return frame->mailbox->RDHR;
+}
+
+static inline uint8_t can_view_byte(const can_rx_view* frame, int i)
+{
+  return (i < 4) ?
+    (uint8_t)(frame->mailbox->RDLR >> (8 * i)) :
+    (uint8_t)(frame->mailbox->RDHR >> (8 * (i - 4)));
+}
+
+/* Centesimas de una lectura para los marcos, saturadas al rango del campo. La
+ * conversión directa de un float fuera de rango o NaN es indefinida, y el -1
+ * de una lectura de %RH fallida es negativo; sus banderas de error ya lo
+ * indican, el campo queda en 0 */
+static inline int16_t can_centi_signed(float value)
+{
+  const float centi = value * 100.f;
+  if(centi != centi)
+  {
+    return 0;
+  }
+  if(centi <= -32768.f)
+  {
+    return INT16_MIN;
+  }
+  return (centi >= 32767.f) ? INT16_MAX : (int16_t)centi;
+}
+
+static inline uint16_t can_centi_unsigned(float value)
+{
+  const float centi = value * 100.f;
+  if(!(centi > 0.f))
+  {
+    return 0;
+  }
+  return (centi >= 65535.f) ? UINT16_MAX : (uint16_t)centi;
+}
+
+/**
+ * @struct Ready to send frame, kept as the image of the TX mailbox registers
+ */
+typedef struct can_tx_image {
+  uint32_t tir;
+  uint32_t tdtr;
+  uint32_t tdlr;
+  uint32_t tdhr;
+} can_tx_image;
+
+/**
+ * @struct Poll to response latency, measured from the RTR interrupt to the
+ *         completion of the transmission of the answer. The bus figures are
+ *         taken from the hardware timestamps, from the SOF of the poll to the
+ *         SOF of the answer, in bit times.
+ */
+typedef struct can_poll_latency {
+  uint32_t last_us;
+  uint32_t max_us;
+  uint32_t total_us;
+  uint32_t count;
+  uint32_t dropped;
+  uint16_t bus_last_bits;
+  uint16_t bus_max_bits;
+} can_poll_latency;
+
+/**
+ * @struct Hardware timestamp of a frame, in bit times of the 16-bit CAN timer
+ */
+typedef struct can_stamp {
+  uint16_t time;
+  uint16_t id; /* Identificador estandar, CAN_STAMP_TX si fue transmitido */
+} can_stamp;
+
+void can_pack_reading(float temp, float rh, uint8_t error_flags, uint32_t bus_us, uint8_t* data);
 
 uint32_t can_write_to_mailbox(can_handle* handle, uint8_t* data, int bytes);
-uint32_t can_get_from_fifo(can_handle* handle, uint8_t* data[]);
+uint32_t can_write_id_to_mailbox(can_handle* handle, uint32_t std_id, uint8_t* data, int bytes);
+
+void can_cache_response(const uint8_t* data, int bytes);
+void can_answer_poll(can_handle* handle, const can_rx_view* frame);
+void can_queue_cached_response(can_handle* handle, uint32_t start_us, uint16_t poll_time);
+const can_poll_latency* can_get_poll_latency(void);
+const can_stamp* can_get_stamp_log(uint32_t* head);
+
+int can_register_command(uint8_t code, can_rx_handler handler);
+void can_dispatch_command(can_handle* handle, const can_rx_view* frame);
+uint32_t can_get_panel_tick(void);
+
+int can_register_handler(can_handle* handle, uint32_t std_id, uint32_t rtr, can_rx_handler handler);
+int can_register_mask_handler(can_handle* handle, uint32_t std_id, uint32_t mask, can_rx_handler handler);
+int can_move_mask_handler(can_handle* handle, int index, uint32_t std_id, uint32_t mask);
+uint32_t can_start(can_handle* handle);
+void can_dispatch_fifo(can_handle* handle, uint32_t fifo);
+void can_irq(can_handle* handle);
 
 #endif /* INC_CAN_H_ */
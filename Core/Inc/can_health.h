@@ -0,0 +1,68 @@
+/**
+ * @file	can_health.h
+ * @brief	Header file for can_health.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_CAN_HEALTH_H_
+#define INC_CAN_HEALTH_H_
+
+#include "can.h"
+#include "node_id.h"
+
+#ifndef DIAGNOSTIC_CAN_STD_ID
+#define DIAGNOSTIC_CAN_STD_ID (0x700U | node_id_get()) /**> @def Identifier of the diagnostic frame, lowest priority */
+#endif
+
+#define CAN_HEALTH_PERIOD_MS 5000 /**> @def Period of the diagnostic frame and of the bus load window */
+#define CAN_HEALTH_BACKOFF_MIN_MS 100 /**> @def First bus-off recovery delay */
+#define CAN_HEALTH_BACKOFF_MAX_MS 10000 /**> @def Upper bound of the bus-off recovery delay */
+#define CAN_HEALTH_STABLE_MS 30000 /**> @def Time without bus-off after which the backoff is reset */
+#define CAN_HEALTH_MAILBOX_STUCK_MS 2000 /**> @def A mailbox occupied this long outside bus-off counts as hung, see watchdog.c */
+
+/**
+ * @enum Bus state flags, as reported in the diagnostic frame
+ */
+typedef enum can_bus_state {
+  CAN_BUS_ACTIVE = 0,
+  CAN_BUS_WARNING = 1,
+  CAN_BUS_PASSIVE = 2,
+  CAN_BUS_OFF = 4,
+  CAN_BUS_BOOT = 0x80 /* No es un estado, marca el reporte de arranque, ver boot.c */
+} can_bus_state;
+
+/**
+ * @struct Bus health counters, cumulative since boot unless noted
+ */
+typedef struct can_health_stats {
+  uint32_t rx_frames;
+  uint32_t tx_frames;
+  uint32_t other_frames; /* Of rx_frames, those for other nodes, only with CAN_HEALTH_SNIFF_BUS */
+  uint32_t error_warning;
+  uint32_t error_passive;
+  uint32_t bus_off;
+  uint32_t protocol_errors;
+  uint32_t arbitration_lost;
+  uint32_t tx_errors;
+  uint32_t tx_aborted;
+  uint32_t tx_dropped;
+  uint32_t rx_overruns;
+  uint8_t tec;
+  uint8_t rec;
+  uint8_t state;
+  uint8_t bus_load; /* Percent, over the last CAN_HEALTH_PERIOD_MS window */
+} can_health_stats;
+
+void can_health_init(can_handle* handle);
+void can_health_poll(can_handle* handle);
+const can_health_stats* can_health_get_stats(void);
+
+void can_health_count_rx(const can_rx_view* frame);
+void can_health_count_tx(can_handle* handle, uint32_t mailbox);
+void can_health_count_abort(void);
+void can_health_count_drop(void);
+void can_health_on_error(can_handle* handle, uint32_t error_code);
+
+#endif /* INC_CAN_HEALTH_H_ */
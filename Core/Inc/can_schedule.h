@@ -0,0 +1,26 @@
+/**
+ * @file	can_schedule.h
+ * @brief	Header file for can_schedule.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_CAN_SCHEDULE_H_
+#define INC_CAN_SCHEDULE_H_
+
+#include "can.h"
+
+#define CAN_SCHEDULE_MAX_OFFSET_US 65535 /**> @def Largest slot offset, TIM6 counts microseconds in 16 bits */
+
+void can_schedule_init(TIM_HandleTypeDef* htim);
+void can_schedule_set_slot(uint8_t index, uint16_t width_us);
+void can_schedule_set_offset(uint32_t offset_us);
+uint32_t can_schedule_offset(void);
+int can_schedule_defer(can_handle* handle, uint32_t start_us, uint16_t poll_time);
+uint32_t can_schedule_slot_latency(uint32_t entry_cycles);
+void can_schedule_irq(TIM_HandleTypeDef* htim);
+void can_schedule_command(can_handle* handle, const can_rx_view* frame);
+void can_schedule_sync(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_CAN_SCHEDULE_H_ */
@@ -0,0 +1,85 @@
+/**
+ * @file	can_tx.h
+ * @brief	Header file for can_tx.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_CAN_TX_H_
+#define INC_CAN_TX_H_
+
+#include "can.h"
+#include "node_id.h"
+
+#define CAN_NODE_ID_MASK 0x7FU /**> @def Bits of the identifier that hold the node, the rest select the class */
+#define CAN_NODE_BROADCAST 0x00U /**> @def Node number addressing every node in a command */
+
+#define CAN_TX_ALARM_BASE 0x080U /**> @def Identifier range of alarms, highest priority */
+#define CAN_TX_RESPONSE_BASE 0x100U /**> @def Identifier range of command responses */
+#define CAN_TX_TELEMETRY_BASE 0x180U /**> @def Identifier range of periodic readings */
+#define CAN_TX_AGG_BASE 0x200U /**> @def Identifier range of the fused reading of a bin */
+#define CAN_TX_AGG_CLAIM_BASE 0x280U /**> @def Identifier range of the claims of an aggregator over its members */
+#define CAN_TX_BULK_BASE 0x600U /**> @def Identifier range of bulk transfers, such as the log backfill */
+#define CAN_TX_HEARTBEAT_BASE 0x680U /**> @def Identifier range of heartbeats and node number claims */
+#define CAN_TX_TRACE_BASE 0x780U /**> @def Identifier range of trace records, sent as bulk frames */
+
+#define CAN_TX_ALARM_DEPTH 4 /**> @def Alarm queue length */
+#define CAN_TX_RESPONSE_DEPTH 4 /**> @def Response queue length */
+#define CAN_TX_TELEMETRY_DEPTH 4 /**> @def Telemetry slots, one per identifier */
+#define CAN_TX_TELEMETRY_MAILBOXES 2 /**> @def Mailboxes telemetry and bulk may hold, the rest is kept for alarms */
+
+#define CAN_TX_RESPONSE_DEADLINE_MS 100 /**> @def Responses older than this are dropped */
+#define CAN_TX_TELEMETRY_DEADLINE_MS 1000 /**> @def Telemetry older than this is dropped */
+#define CAN_TX_NO_DEADLINE 0 /**> @def Deadline value of frames that are never dropped */
+#define CAN_TX_NO_TAG 0U /**> @def Tag of frames whose sender doesn't track them */
+
+/* Identificador de una clase para este nodo, el numero se asigna en tiempo de
+ * ejecución, ver node_id.c */
+#define CAN_TX_ID(base) ((base) | (node_id_get() & CAN_NODE_ID_MASK))
+
+/**
+ * @enum Transmit classes, in decreasing priority
+ */
+typedef enum can_tx_class {
+  CAN_TX_ALARM = 0,
+  CAN_TX_RESPONSE = 1,
+  CAN_TX_TELEMETRY = 2,
+  CAN_TX_BULK = 3,
+  CAN_TX_CLASSES = 4
+} can_tx_class;
+
+/* Fuente de marcos de la clase CAN_TX_BULK. Entrega el siguiente marco y una
+ * marca para reintentarlo, devuelve 0 si no hay marcos por ahora. */
+typedef int (*can_tx_bulk_next)(can_tx_image* image, uint32_t* cookie);
+/* Se llama con la marca de un marco de la fuente que no salio */
+typedef void (*can_tx_bulk_failed)(uint32_t cookie);
+
+/**
+ * @struct Per class transmit counters
+ */
+typedef struct can_tx_stats {
+  uint32_t queued[CAN_TX_CLASSES];
+  uint32_t sent[CAN_TX_CLASSES];
+  uint32_t superseded; /* Telemetria reemplazada por una lectura mas nueva */
+  uint32_t expired[CAN_TX_CLASSES];
+  uint32_t overflow[CAN_TX_CLASSES];
+  uint32_t preempted; /* Bulk o telemetria abortado para hacer lugar a una alarma */
+  uint32_t retried[CAN_TX_CLASSES]; /* Alarmas y respuestas fallidas devueltas a su cola */
+  uint32_t alarm_max_latency_ms;
+} can_tx_stats;
+
+void can_tx_build_image(uint32_t std_id, const uint8_t* data, int bytes, can_tx_image* image);
+int can_tx_send(can_handle* handle, can_tx_class tx_class, uint32_t std_id,
+                const uint8_t* data, int bytes, uint32_t deadline_ms);
+int can_tx_send_image(can_handle* handle, can_tx_class tx_class, const can_tx_image* image,
+                      uint32_t deadline_ms, uint32_t tag);
+int can_tx_write_mailbox(can_handle* handle, const can_tx_image* image, can_tx_class tx_class);
+void can_tx_pump(can_handle* handle);
+uint32_t can_tx_mailbox_age_ms(void);
+void can_tx_mailbox_done(can_handle* handle, uint32_t mailbox, int sent);
+uint32_t can_tx_mailbox_tag(uint32_t mailbox);
+void can_tx_set_bulk_source(can_tx_bulk_next next, can_tx_bulk_failed failed);
+const can_tx_stats* can_tx_get_stats(void);
+
+#endif /* INC_CAN_TX_H_ */
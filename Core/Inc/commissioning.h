@@ -0,0 +1,58 @@
+/**
+ * @file	commissioning.h
+ * @brief	Header file for commissioning.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_COMMISSIONING_H_
+#define INC_COMMISSIONING_H_
+
+#include "stm32f0xx_hal.h"
+
+/*
+ * Solo en la compilación de puesta en marcha, con COMMISSIONING_STREAM
+ * definido en las opciones del compilador. La imagen de producción no toca el
+ * USART ni el canal de DMA.
+ */
+
+#define COMMISSIONING_BAUD 921600U /**> @def Baud rate of the stream, 8N1 */
+#define COMMISSIONING_RING_WORDS 512U /**> @def Words queued for the DMA, 2 KB */
+#define COMMISSIONING_MAX_PAYLOAD 16U /**> @def Largest payload of a frame, in words */
+#define COMMISSIONING_SYNC 0xA5U /**> @def First byte of every frame */
+#define COMMISSIONING_USART USART1 /**> @def TX on PA9, AF1 */
+#define COMMISSIONING_DMA DMA1 /**> @def Controller of the TX channel */
+#define COMMISSIONING_DMA_CHANNEL DMA1_Channel2 /**> @def USART1_TX through CSELR */
+#define COMMISSIONING_DMA_DONE DMA_ISR_TCIF2 /**> @def Transfer complete flag of the channel */
+#define COMMISSIONING_DMA_CLEAR DMA_IFCR_CGIF2 /**> @def Clears every flag of the channel */
+#define COMMISSIONING_IRQ_PRIORITY 3 /**> @def Lowest, the stream never delays CAN */
+
+/**
+ * @enum Frame types, byte 1 of the header
+ */
+typedef enum commissioning_frame {
+  COMMISSIONING_ADC = 1, /* [0] cuentas de Vref en los 16 bits bajos, del LM35 en los altos */
+  COMMISSIONING_CAPTURE = 2 /* Capturas crudas del timer de %RH, una por palabra */
+} commissioning_frame;
+
+/**
+ * @struct Stream counters
+ */
+typedef struct commissioning_stats {
+  uint32_t frames;
+  uint32_t dropped; /* Marcos que no cupieron en el anillo */
+  uint32_t words; /* Palabras entregadas al DMA */
+} commissioning_stats;
+
+#ifdef COMMISSIONING_STREAM
+
+void commissioning_init(void);
+void commissioning_send(commissioning_frame type, const uint32_t* payload, uint32_t words);
+void commissioning_adc(uint32_t v_ref_counts, uint32_t temp_counts);
+void commissioning_dma_irq(void);
+const commissioning_stats* commissioning_get_stats(void);
+
+#endif /* COMMISSIONING_STREAM */
+
+#endif /* INC_COMMISSIONING_H_ */
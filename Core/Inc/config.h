@@ -0,0 +1,87 @@
+/**
+ * @file	config.h
+ * @brief	Header file for config.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_CONFIG_H_
+#define INC_CONFIG_H_
+
+#include "can.h"
+#include "sensors.h"
+#include "flash_log.h"
+
+#define CONFIG_VERSION 1U /**> @def Layout of config_values, blocks of other versions are ignored */
+#define CONFIG_MAGIC 0x4346U /**> @def Marks a committed block, programmed last */
+#define CONFIG_FLASH_PAGES 2 /**> @def A/B copies, one page each */
+#define CONFIG_FLASH_START (FLASH_LOG_START - CONFIG_FLASH_PAGES * FLASH_PAGE_SIZE) /**> @def First copy, just below the log */
+#define CONFIG_MAX_HOOKS 4 /**> @def Modules notified when a new configuration is applied */
+#define CONFIG_WORDS (sizeof(config_values) / 4U) /**> @def Words of a block body, the unit of a transfer */
+
+/**
+ * @struct Calibration and configuration values. Every field is a 32-bit word,
+ *         the word index is the one used by CONFIG_CMD_DATA.
+ */
+typedef struct config_values {
+  float freq_lut[FREQ_LUT_SIZE]; /* Frecuencia en Hz de 0 a 100 %RH, de 5 en 5 */
+  uint32_t adc_timeout_ms;
+  uint32_t timer_samples; /* Menos de MAX_TIMER_SAMPLES, el primer flanco ocupa una */
+  float adc_v_ref; /* Referencia leida en el primer canal, en V */
+  float temp_gradient; /* Del sensor de temperatura, en V/°C */
+  uint32_t telemetry_base; /* Identificador de las lecturas, sin el numero de nodo */
+} config_values;
+
+/**
+ * @struct Block in flash. The body is programmed word by word during a
+ *         transfer and the header on commit, the magic last.
+ */
+typedef struct config_block {
+  uint16_t magic;
+  uint16_t version;
+  uint32_t sequence; /* La copia valida con la secuencia mayor es la activa */
+  uint32_t crc; /* CRC-32 de values, ver crc.c */
+  uint32_t reserved;
+  config_values values;
+} config_block;
+
+/**
+ * @enum Sub-commands of CAN_CMD_CONFIG, byte 2 of the frame
+ */
+typedef enum config_subcommand {
+  CONFIG_CMD_BEGIN = 0,
+  CONFIG_CMD_DATA = 1,
+  CONFIG_CMD_COMMIT = 2,
+  CONFIG_CMD_WRITE = 3 /* Una palabra sobre los valores en uso, se guarda y activa de una vez */
+} config_subcommand;
+
+/**
+ * @enum Result of a subcommand, sent in the answer
+ */
+typedef enum config_status {
+  CONFIG_OK = 0,
+  CONFIG_BUSY = 1,
+  CONFIG_NOT_STARTED = 2,
+  CONFIG_BAD_INDEX = 3,
+  CONFIG_BAD_CRC = 4,
+  CONFIG_BAD_VALUE = 5,
+  CONFIG_WRITE_FAIL = 6
+} config_status;
+
+/**
+ * @typedef Called from config_poll() after a commit, with the values that were
+ *          replaced. They stay readable until the next CONFIG_CMD_BEGIN.
+ */
+typedef void (*config_hook)(can_handle* handle, const config_values* previous);
+
+void config_init(void);
+int config_register_hook(config_hook hook);
+void config_poll(can_handle* handle, uint32_t idle_us);
+const config_values* config_get(void);
+uint32_t config_sequence(void);
+int config_base_reserved(uint32_t base);
+
+void config_command(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_CONFIG_H_ */
@@ -0,0 +1,51 @@
+/**
+ * @file	crc.h
+ * @brief	Header file for crc.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_CRC_H_
+#define INC_CRC_H_
+
+#include <stdint.h>
+
+#define CRC_INITIAL 0xFFFFFFFFU /**> @def Initial value, same as the CRC peripheral after reset */
+#define CRC_POLYNOMIAL 0x04C11DB7U /**> @def CRC-32 polynomial, the default of the peripheral */
+#define CRC_BENCH_WORDS 256U /**> @def Block measured by crc_init(), 1 KB so the slowest method fits in a SysTick period */
+#define CRC_DMA_MIN_WORDS 16U /**> @def Smaller blocks are fed by the CPU, the DMA setup costs more than it saves */
+
+#ifndef CRC_DMA
+#define CRC_DMA DMA2 /**> @def Controller feeding the CRC unit, DMA1 is left for the peripherals */
+#define CRC_DMA_CHANNEL DMA2_Channel1 /**> @def Channel in memory to memory mode */
+#define CRC_DMA_DONE (DMA_ISR_TCIF1 | DMA_ISR_TEIF1) /**> @def Flags of the channel that end a transfer */
+#define CRC_DMA_CLEAR DMA_IFCR_CGIF1 /**> @def Clears every flag of the channel */
+#endif
+
+/**
+ * @enum How crc_words() computes outside interrupts
+ */
+typedef enum crc_mode {
+  CRC_SOFTWARE = 0,
+  CRC_HARDWARE = 1, /* Unidad CRC alimentada por el CPU */
+  CRC_HARDWARE_DMA = 2 /* Unidad CRC alimentada por DMA */
+} crc_mode;
+
+/**
+ * @struct Method in use and cycles of each one for CRC_BENCH_WORDS words in
+ *         flash, measured with SysTick by crc_init()
+ */
+typedef struct crc_stats {
+  uint8_t mode;
+  uint32_t software_cycles;
+  uint32_t hardware_cycles;
+  uint32_t dma_cycles;
+} crc_stats;
+
+int crc_init(void);
+uint32_t crc_words(const volatile uint32_t* words, uint32_t count);
+uint32_t crc_words_software(const volatile uint32_t* words, uint32_t count);
+const crc_stats* crc_get_stats(void);
+
+#endif /* INC_CRC_H_ */
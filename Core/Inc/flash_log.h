@@ -0,0 +1,114 @@
+/**
+ * @file	flash_log.h
+ * @brief	Header file for flash_log.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_FLASH_LOG_H_
+#define INC_FLASH_LOG_H_
+
+#include "can.h"
+#include "node_id.h"
+
+#ifndef FLASH_LOG_RAW_PAGES
+#define FLASH_LOG_RAW_PAGES 40 /**> @def Pages of every reading, about 10 h at one reading per second */
+#endif
+#ifndef FLASH_LOG_MINUTE_PAGES
+#define FLASH_LOG_MINUTE_PAGES 18 /**> @def Pages of 1 minute means, about 12 days */
+#endif
+#ifndef FLASH_LOG_HOUR_PAGES
+#define FLASH_LOG_HOUR_PAGES 6 /**> @def Pages of 1 hour means, longer than a composting cycle */
+#endif
+#define FLASH_LOG_PAGES (FLASH_LOG_RAW_PAGES + FLASH_LOG_MINUTE_PAGES + FLASH_LOG_HOUR_PAGES) /**> @def Pages of all tiers, 128 KB below the node number page */
+#define FLASH_LOG_START (NODE_ID_FLASH_PAGE - FLASH_LOG_PAGES * FLASH_PAGE_SIZE) /**> @def First page of the log */
+#ifndef FLASH_IMAGE_LIMIT
+#define FLASH_IMAGE_LIMIT (FLASH_BASE + 0x1E800U) /**> @def End of the program image, 122 KB as in the FLASH region of the linker script */
+#endif
+#define FLASH_LOG_RECORD_BYTES CAN_MAX_BYTES /**> @def Readings are appended and sent in the format of can_pack_reading() */
+#define FLASH_LOG_DATA_HALFWORDS ((FLASH_PAGE_SIZE - 20U) / 2U) /**> @def Encoded readings between the header and the footer */
+#define FLASH_LOG_DATA_BITS (FLASH_LOG_DATA_HALFWORDS * 16U)
+#define FLASH_LOG_INDEX_STRIDE 4096U /**> @def A record index is sequence * stride + position in the page */
+#define FLASH_LOG_MAGIC 0x4C48U /**> @def Marks a programmed header or footer */
+#define FLASH_LOG_OUTAGE_MS 5000 /**> @def Control panel silence after which readings are backfilled */
+#define FLASH_LOG_ERASE_IDLE_US 100000U /**> @def Idle time required to erase a page, the CPU stalls for up to 40 ms */
+#define FLASH_LOG_CLOCK_STEP_S 10U /**> @def Smallest lag behind the control panel time that moves the log clock */
+#define FLASH_LOG_QUERY_LENGTH_MASK 0x3FFFU /**> @def Length bits of a query, the two upper bits select the resolution */
+#define FLASH_LOG_QUERY_BUSY 0xFFU /**> @def Tier answered to a query while another transfer is in progress */
+
+/**
+ * @enum Tiers of the log, from the finest to the coarsest. Each one is a ring
+ *       of its own pages.
+ */
+typedef enum flash_log_tier {
+  FLASH_LOG_RAW = 0,
+  FLASH_LOG_MINUTES = 1,
+  FLASH_LOG_HOURS = 2,
+  FLASH_LOG_TIERS = 3
+} flash_log_tier;
+
+/**
+ * @struct Layout of a page. The header is programmed with the first record and
+ *         the footer, with the CRC of the rest of the page and the number of
+ *         records, when it fills up. The data is a block of log_codec.c.
+ */
+typedef struct flash_log_page {
+  uint16_t magic;
+  uint8_t tier;
+  uint8_t reserved;
+  uint32_t sequence;
+  uint32_t start_seconds; /* Reloj del registro en la primera lectura */
+  uint16_t data[FLASH_LOG_DATA_HALFWORDS];
+  uint32_t crc;
+  uint16_t count;
+  uint16_t end_magic;
+} flash_log_page;
+
+/**
+ * @struct Running mean of the current period of a tier
+ */
+typedef struct flash_log_window {
+  uint32_t start; /* Reloj del registro al inicio del periodo */
+  int32_t temp_sum;
+  int32_t rh_sum;
+  uint16_t temp_count;
+  uint16_t rh_count;
+  uint8_t flags;
+  uint8_t open;
+} flash_log_window;
+
+/**
+ * @struct Log counters
+ */
+typedef struct flash_log_stats {
+  uint32_t records;
+  uint32_t aggregates;
+  uint32_t erases;
+  uint32_t forced_erases; /* Borrados sin tiempo libre, detuvieron el muestreo */
+  uint32_t write_errors;
+  uint32_t crc_errors; /* Paginas saltadas al reenviar */
+  uint32_t overwritten; /* Paginas reutilizadas antes de reenviarse */
+  uint32_t backfills;
+  uint32_t queries;
+  uint32_t queries_busy; /* Consultas rechazadas por una transferencia en curso */
+  uint32_t encoded_bits;
+  uint32_t encode_cycles_max; /* Ciclos de CPU de log_encode(), medidos con SysTick */
+  uint32_t encode_cycles_last;
+} flash_log_stats;
+
+void flash_log_init(void);
+void flash_log_append(const uint8_t* record);
+void flash_log_poll(can_handle* handle, uint32_t idle_us);
+int flash_log_stream(can_handle* handle, flash_log_tier tier, uint32_t from, uint32_t to);
+int flash_log_streaming(void);
+uint32_t flash_log_find(flash_log_tier tier, uint32_t seconds, uint32_t* found_seconds);
+void flash_log_command(can_handle* handle, const can_rx_view* frame);
+uint32_t flash_log_head(flash_log_tier tier);
+uint32_t flash_log_seconds(void);
+flash_log_tier flash_log_tier_for(uint32_t resolution_s);
+const flash_log_stats* flash_log_get_stats(void);
+void flash_log_get_windows(flash_log_window* windows);
+void flash_log_set_windows(const flash_log_window* windows);
+
+#endif /* INC_FLASH_LOG_H_ */
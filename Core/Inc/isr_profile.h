@@ -0,0 +1,47 @@
+/**
+ * @file	isr_profile.h
+ * @brief	Header file for isr_profile.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_ISR_PROFILE_H_
+#define INC_ISR_PROFILE_H_
+
+#include "stm32f0xx_hal.h"
+#include "timebase.h"
+
+#define ISR_PROFILE_BUCKETS 20 /**> @def Buckets of a histogram, the last one holds 2^18 cycles (5.4 ms) and up */
+#define ISR_PROFILE_NO_LATENCY 0xFFFFFFFFU /**> @def The handler can't tell when its event happened */
+
+/**
+ * @enum Profiled handlers
+ */
+typedef enum isr_id {
+  ISR_SYSTICK = 0,
+  ISR_TIM2 = 1, /* Capturas del sensor de %RH */
+  ISR_TIM6 = 2, /* Ranura de respuesta, ver can_schedule.c */
+  ISR_CAN = 3,
+  ISR_COUNT = 4
+} isr_id;
+
+/**
+ * @struct Log2 histograms of a handler, in CPU cycles. Bucket 0 counts zero,
+ *         bucket k counts from 2^(k-1) to 2^k - 1.
+ */
+typedef struct isr_histogram {
+  uint32_t latency[ISR_PROFILE_BUCKETS]; /* Del evento a la entrada del handler */
+  uint32_t duration[ISR_PROFILE_BUCKETS]; /* De la entrada a la salida */
+} isr_histogram;
+
+void isr_profile_init(void);
+void isr_profile_exit(isr_id id, uint32_t entry_cycles, uint32_t latency_cycles);
+void isr_profile_systick(uint32_t entry_val);
+uint32_t isr_profile_can_latency(const CAN_TypeDef* can, uint32_t now_us);
+const isr_histogram* isr_profile_get(isr_id id);
+
+/* Al entrar al handler, antes de atender al periférico */
+#define isr_profile_enter() timebase_cycles()
+
+#endif /* INC_ISR_PROFILE_H_ */
@@ -0,0 +1,72 @@
+/**
+ * @file	log_codec.h
+ * @brief	Header file for log_codec.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_LOG_CODEC_H_
+#define INC_LOG_CODEC_H_
+
+#include <stdint.h>
+
+/* Sin dependencias del HAL, las herramientas de Tools/ compilan el mismo codigo */
+
+#define LOG_CODEC_TIME_BITS 24 /**> @def Width of the sample time, in units of 256 us as in can_pack_reading() */
+#define LOG_CODEC_MAX_SAMPLE_BITS 77 /**> @def Longest encoding of one sample */
+#define LOG_CODEC_MAX_HALFWORDS 5 /**> @def Most halfwords completed by one log_encode() */
+
+/**
+ * @struct Reading as stored in the log, the fields of can_pack_reading()
+ */
+typedef struct log_sample {
+  uint32_t time; /* Bits 8 a 31 del tiempo del bus en µs */
+  int16_t temp; /* Centesimas de grado */
+  uint16_t rh; /* Centesimas de %RH */
+  uint8_t flags;
+} log_sample;
+
+/**
+ * @struct Previous sample, shared by the encoder and the decoder
+ */
+typedef struct log_codec_state {
+  uint32_t time;
+  int32_t delta;
+  int16_t temp;
+  uint16_t rh;
+  uint8_t flags;
+  uint16_t count; /* Muestras desde el reinicio del bloque */
+} log_codec_state;
+
+/**
+ * @struct Encoder, with the bits that don't complete a halfword yet
+ */
+typedef struct log_encoder {
+  log_codec_state last;
+  uint32_t pending;
+  uint8_t pending_bits;
+  uint32_t total_bits;
+} log_encoder;
+
+/**
+ * @struct Decoder of a block of halfwords
+ */
+typedef struct log_decoder {
+  log_codec_state last;
+  const uint16_t* data;
+  uint32_t position; /* Bit siguiente, desde el mas significativo de data[0] */
+  uint32_t limit; /* Bits disponibles */
+} log_decoder;
+
+void log_sample_from_record(const uint8_t* record, log_sample* sample);
+void log_sample_to_record(const log_sample* sample, uint8_t* record);
+
+void log_encoder_reset(log_encoder* encoder);
+int log_encode(log_encoder* encoder, const log_sample* sample, uint16_t* out);
+int log_encoder_flush(log_encoder* encoder, uint16_t* out);
+
+void log_decoder_reset(log_decoder* decoder, const uint16_t* data, uint32_t limit_bits);
+int log_decode(log_decoder* decoder, log_sample* sample);
+
+#endif /* INC_LOG_CODEC_H_ */
@@ -47,6 +47,14 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
+/* Funciones que corren desde la SRAM, sin los estados de espera de la flash. Se
+ * copian al arrancar, ver startup_stm32f091cctx.s y el README. RAMFUNC_DISABLE
+ * las deja en flash, para comparar los ciclos. */
+#ifndef RAMFUNC_DISABLE
+#define RAMFUNC __attribute__((section(".RamFunc"), noinline))
+#else
+#define RAMFUNC
+#endif
 
 /* USER CODE END EM */
 
@@ -58,6 +66,8 @@ void Error_Handler(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
+#define RH_OSC_Pin GPIO_PIN_5
+#define RH_OSC_GPIO_Port GPIOA
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
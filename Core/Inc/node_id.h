@@ -0,0 +1,41 @@
+/**
+ * @file	node_id.h
+ * @brief	Header file for node_id.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_NODE_ID_H_
+#define INC_NODE_ID_H_
+
+#include "can.h"
+
+#define NODE_ID_MAX 0x7FU /**> @def Highest node number, 0 is CAN_NODE_BROADCAST */
+#define NODE_ID_HEARTBEAT_MS 1000 /**> @def Heartbeat period */
+#define NODE_ID_PEER_TIMEOUT_MS (3 * NODE_ID_HEARTBEAT_MS) /**> @def A node without heartbeats for this long is gone */
+#define NODE_ID_CLAIM_MS 250 /**> @def Time a claim must go unchallenged, plus a jitter of up to 63 ms */
+
+#ifndef NODE_ID_FLASH_PAGE
+#define NODE_ID_FLASH_PAGE (FLASH_BASE + 0x3F800U) /**> @def Last 2 KB page of the STM32F091CC, excluded from the image */
+#endif
+#define NODE_ID_FLASH_MAGIC 0x4E49U /**> @def Marks a valid record in NODE_ID_FLASH_PAGE */
+
+/**
+ * @enum State of this node, first byte of the heartbeat
+ */
+typedef enum node_id_state {
+  NODE_ID_CLAIMING = 0,
+  NODE_ID_ACTIVE = 1
+} node_id_state;
+
+void node_id_init(can_handle* handle);
+void node_id_poll(can_handle* handle);
+uint8_t node_id_get(void);
+const volatile uint8_t* node_id_location(void);
+int node_id_is_claimed(void);
+int node_id_peer_alive(uint8_t node);
+
+void node_id_heartbeat(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_NODE_ID_H_ */
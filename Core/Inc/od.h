@@ -0,0 +1,128 @@
+/**
+ * @file	od.h
+ * @brief	Header file for od.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_OD_H_
+#define INC_OD_H_
+
+#include "can.h"
+
+#define OD_SIZE 128 /**> @def Number of indexes, the index is the position in the table */
+#define OD_VALUE_BYTES 4 /**> @def Largest value carried by an expedited transfer */
+
+/**
+ * @enum Indexes of the dictionary
+ */
+typedef enum od_index {
+  OD_NODE_ID = 0x00,
+  OD_WATCHDOG_MISSED = 0x08, /* Tareas vencidas en el ultimo reset del IWDG, ver watchdog.h */
+  OD_WATCHDOG_RESETS = 0x09,
+  OD_SENSOR_ADC_TIMEOUT = 0x10,
+  OD_SENSOR_TIMER_SAMPLES = 0x11,
+  OD_SENSOR_FREQ_LUT = 0x12, /* Un subindice por entrada de la LUT */
+  OD_SENSOR_ADC_V_REF = 0x13,
+  OD_SENSOR_TEMP_GRADIENT = 0x14,
+  OD_CONFIG_TELEMETRY_BASE = 0x15,
+  OD_CONFIG_SEQUENCE = 0x16,
+  OD_SENSOR_RH_CYCLES = 0x17, /* Ciclos de CPU de la ultima conversión de %RH */
+  OD_SENSOR_RH_CYCLES_MAX = 0x18,
+  OD_READING_TEMP = 0x20,
+  OD_READING_RH = 0x21,
+  OD_READING_FLAGS = 0x22,
+  OD_READING_TIME = 0x23,
+  OD_CAN_TEC = 0x30,
+  OD_CAN_REC = 0x31,
+  OD_CAN_STATE = 0x32,
+  OD_CAN_BUS_LOAD = 0x33,
+  OD_CAN_RX_FRAMES = 0x34,
+  OD_CAN_TX_FRAMES = 0x35,
+  OD_CAN_TX_DROPPED = 0x36,
+  OD_AGGREGATOR_ENABLE = 0x40,
+  OD_AGGREGATOR_MEMBERS = 0x41, /* Mapa de bits de los nodos del contenedor, un subindice por cada 32 */
+  OD_AGGREGATOR_OWNER = 0x42, /* Agregador que reclamó a este nodo, 0 sin reclamo */
+  OD_LOG_RECORDS = 0x50,
+  OD_LOG_ENCODED_BITS = 0x51, /* Bits comprimidos de todos los registros */
+  OD_LOG_ENCODE_CYCLES = 0x52, /* Ciclos de CPU de la ultima muestra comprimida */
+  OD_LOG_ENCODE_CYCLES_MAX = 0x53,
+  OD_CRC_MODE = 0x60, /* crc_mode en uso */
+  OD_CRC_SOFTWARE_CYCLES = 0x61, /* Ciclos de CRC_BENCH_WORDS palabras con cada método */
+  OD_CRC_HARDWARE_CYCLES = 0x62,
+  OD_CRC_DMA_CYCLES = 0x63,
+  OD_ISR_LATENCY = 0x70, /* Histograma log2 en ciclos, un subindice por bucket; 0x70 + 2 * isr_id */
+  OD_ISR_DURATION = 0x71, /* 0x71 + 2 * isr_id */
+  OD_MEM_STACK_PEAK = 0x78, /* Bytes, ver sysmem.c */
+  OD_MEM_STACK_RESERVED = 0x79,
+  OD_MEM_HEAP_PEAK = 0x7A,
+  OD_MEM_HEAP_FAILURES = 0x7B,
+  OD_MEM_FREE_MIN = 0x7C,
+  OD_BOOT_PHASES = 0x7D, /* µs desde HAL_Init(), un subindice por boot_phase */
+  OD_BOOT_RESET_FLAGS = 0x7E,
+  OD_WARM_RESTARTS = 0x7F /* Reinicios en caliente seguidos, 0 en un arranque en frio */
+} od_index;
+
+/**
+ * @enum Types of the entries, as stored in memory
+ */
+typedef enum od_type {
+  OD_U8 = 0,
+  OD_U16 = 1,
+  OD_U32 = 2,
+  OD_I16 = 3,
+  OD_F32 = 4
+} od_type;
+
+/**
+ * @enum Access rights of an entry
+ */
+typedef enum od_access {
+  OD_RO = 0,
+  OD_RW = 1
+} od_access;
+
+/**
+ * @enum Result of an access, sent in the answer
+ */
+typedef enum od_status {
+  OD_OK = 0,
+  OD_NO_ENTRY = 1,
+  OD_READ_ONLY = 2,
+  OD_OUT_OF_RANGE = 3,
+  OD_PENDING = 4, /**> Accepted by the write hook, applied later by the main loop */
+  OD_BUSY = 5 /**> The write hook can't take another write yet */
+} od_status;
+
+/**
+ * @typedef Replaces the store of a write to an entry that can't be written in
+ *          place, such as the configuration in flash. Called from the RX
+ *          interrupt with the address of the element and the checked value.
+ */
+typedef od_status (*od_write_hook)(volatile void* address, uint32_t value);
+
+/**
+ * @struct Entry of the dictionary. An array has one subindex per element. The
+ *         range is only checked on writes to integers when min < max.
+ */
+typedef struct od_entry {
+  volatile void* address;
+  od_write_hook hook; /* NULL, la escritura va directo a la variable */
+  int32_t min;
+  int32_t max;
+  uint8_t type;
+  uint8_t access;
+  uint8_t count;
+} od_entry;
+
+void od_init(void);
+int od_register(uint8_t index, volatile void* address, od_type type, uint8_t count,
+                od_access access, int32_t min, int32_t max);
+int od_set_write_hook(uint8_t index, od_write_hook hook);
+od_status od_read(uint8_t index, uint8_t subindex, uint32_t* value);
+od_status od_write(uint8_t index, uint8_t subindex, uint32_t value);
+
+void od_command(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_OD_H_ */
@@ -0,0 +1,94 @@
+/**
+ * @file	pdo.h
+ * @brief	Header file for pdo.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_PDO_H_
+#define INC_PDO_H_
+
+#include "can.h"
+
+#define PDO_MAX 4 /**> @def Number of process data frames */
+#define PDO_MAX_ENTRIES 4 /**> @def Variables mapped into a single frame */
+#define PDO_MIN_PERIOD_MS 10 /**> @def Shortest period_ms of a cyclic frame */
+
+/**
+ * @enum Transmission modes of a process data frame
+ */
+typedef enum pdo_mode {
+  PDO_OFF = 0,
+  PDO_CYCLIC = 1, /* Cada period_ms */
+  PDO_ON_CHANGE = 2, /* Al cambiar el contenido, separados al menos inhibit_ms */
+  PDO_ON_RTR = 3 /* Al recibir un RTR con el identificador del marco */
+} pdo_mode;
+
+/**
+ * @enum Variables that can be mapped, little endian on the bus
+ */
+typedef enum pdo_var {
+  PDO_VAR_TEMP = 0, /* int16, centi-grados */
+  PDO_VAR_RH = 1, /* uint16, centi-%RH */
+  PDO_VAR_ERROR_FLAGS = 2, /* uint8, sensor_error */
+  PDO_VAR_SAMPLE_TIME = 3, /* uint32, tiempo del bus de la lectura en us */
+  PDO_VAR_SAMPLE_TIME_256US = 4, /* uint32, el mismo en unidades de 256 us */
+  PDO_VAR_TEC = 5, /* uint8 */
+  PDO_VAR_REC = 6, /* uint8 */
+  PDO_VAR_BUS_LOAD = 7, /* uint8, porcentaje */
+  PDO_VAR_COUNT = 8
+} pdo_var;
+
+/**
+ * @enum Sub-commands of CAN_CMD_PDO_CONFIG
+ */
+typedef enum pdo_subcommand {
+  PDO_CMD_COMM = 0,
+  PDO_CMD_TIMING = 1,
+  PDO_CMD_MAP = 2
+} pdo_subcommand;
+
+/**
+ * @enum Result in the answer to CAN_CMD_PDO_CONFIG
+ */
+typedef enum pdo_reply {
+  PDO_REPLY_ACCEPTED = 0, /**> Valid, applied by the next pdo_poll() */
+  PDO_REPLY_INVALID = 1, /**> Not valid, nothing changes */
+  PDO_REPLY_NO_FILTER = 2 /**> Sent by pdo_poll(), no filter left for the remote requests, the previous configuration stays */
+} pdo_reply;
+
+/**
+ * @struct A variable placed in a frame. A size smaller than the variable keeps
+ *         its least significant bytes.
+ */
+typedef struct pdo_entry {
+  uint8_t var;
+  uint8_t offset;
+  uint8_t size;
+} pdo_entry;
+
+/**
+ * @struct Mapping and transmission parameters of a process data frame
+ */
+typedef struct pdo_config {
+  uint16_t std_id;
+  uint8_t mode;
+  uint8_t entry_count;
+  uint16_t period_ms;
+  uint16_t inhibit_ms;
+  pdo_entry entries[PDO_MAX_ENTRIES];
+} pdo_config;
+
+void pdo_init(can_handle* handle);
+void pdo_update_reading(float temp, float rh, uint8_t error_flags, uint32_t sample_us);
+void pdo_poll(can_handle* handle);
+int pdo_configure(int pdo, const pdo_config* config);
+const pdo_config* pdo_get_config(int pdo);
+int pdo_restore(can_handle* handle, int pdo, const pdo_config* config);
+const void* pdo_get_var(pdo_var var, uint8_t* size);
+
+void pdo_command(can_handle* handle, const can_rx_view* frame);
+void pdo_answer_rtr(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_PDO_H_ */
@@ -11,11 +11,13 @@
 #include "stm32f0xx_hal.h"
 #include <stdio.h>
 
-#define TIMER_CLOCK_RATE 48000000 /**> @def Timer clock rate in Hz */
+#define TIMER_CLOCK_RATE 24000000 /**> @def Count rate of TIM2 in Hz, 48 MHz divided by the prescaler of MX_TIM2_Init() */
 #define FREQ_LUT_SIZE 21 /**> @def Number of elements inside RH LUT table */
 #define FREQ_LUT_INTERVAL 5 /**> @def Interval length of RH in the LUT table */
 #define MAX_TIMER_SAMPLES 3 /**> @def Samples in order to determine frequency*/
 #define ADC_TIMEOUT 100 /**> @def ADC timeout time */
+#define RH_CAPTURE_LEAD_US 1000U /**> @def The RH capture is armed this long before each reading */
+#define RH_CAPTURE_TIMEOUT_US 2000U /**> @def Longest wait for the RH capture from its arming, about 12 periods at the bottom of the LUT (6.2 kHz) */
 
 /**
  * @enum Sensors error states
@@ -49,25 +51,22 @@ typedef enum hum_error {
 typedef ADC_HandleTypeDef adc_handle; /**> @typedef Alias for ADC_HandleTypeDef */
 typedef TIM_HandleTypeDef tim_handle; /**> @typedef Alias for TIM_HandleTypeDef */
 
+/**
+ * @struct CPU cycles of the RH conversion, from the captures to %RH
+ */
+typedef struct sensors_stats {
+  uint32_t rh_cycles_last;
+  uint32_t rh_cycles_max;
+} sensors_stats;
+
 /**
  * @struct Struct for encapsulation of handles relevant to sensor readings
  */
 typedef struct sensors_handle {
   adc_handle adc;
-  tim_handle htim2;
+  tim_handle* htim2; /* El mismo handle que usa TIM2_IRQHandler(), no una copia */
 } sensors_handle;
 
-/* Los valores negativos indican un estado de error, estos no se especifican en la hoja de datos, se asume
- * que porque no son factibles en la practica. Como se menciono en la documentación, esta LUT se da en intervalos
- * de 5 en 5 de %RH, desde el 0 al 100.
- */
-static const float freq_lut[FREQ_LUT_SIZE] = {
-    -1.0, -1.0, 7155, 7080, 7010, 6945,
-    6880, 6820, 6760, 6705, 6650, 6600,
-    6550, 6500, 6450, 6400, 6355, 6305,
-    6260, 6210, -1.0
-};
-
 static uint32_t timer_samples[MAX_TIMER_SAMPLES];
 
 sensor_error read_sensors(sensors_handle* handle, float* temp, float* rh);
@@ -77,9 +76,15 @@ temp_error read_temp_adc(adc_handle* handle, float* temp);
 temp_error read_temp_internal(float* temp);
 
 hum_error read_rh(tim_handle* handle, float* rh);
-void init_tim_callback(tim_handle* handle);
-void recursive_tim_callback(tim_handle* handle);
+void sensors_arm_rh(tim_handle* handle);
+void init_tim_callback(tim_handle* handle, uint32_t capture);
+void recursive_tim_callback(tim_handle* handle, uint32_t capture);
+void sensors_tim_capture(tim_handle* handle);
+void sensors_tim_irq(tim_handle* handle);
+uint32_t sensors_edge_latency(uint32_t entry_cycles);
 
 float lerp_rh_from_lut(float freq);
+void sensors_time_conversion(void);
+const sensors_stats* sensors_get_stats(void);
 
 #endif
@@ -53,7 +53,12 @@ void SVC_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
 void TIM2_IRQHandler(void);
+void TIM6_DAC_IRQHandler(void);
+void CEC_CAN_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+/* Los handlers de cada flanco de %RH y de CAN corren desde la SRAM */
+RAMFUNC void TIM2_IRQHandler(void);
+RAMFUNC void CEC_CAN_IRQHandler(void);
 
 /* USER CODE END EFP */
 
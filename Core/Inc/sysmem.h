@@ -0,0 +1,32 @@
+/**
+ * @file	sysmem.h
+ * @brief	Header file for the memory watermarks of sysmem.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_SYSMEM_H_
+#define INC_SYSMEM_H_
+
+#include "stm32f0xx_hal.h"
+
+#define SYSMEM_PAINT 0xC5C5C5C5U /**> @def Pattern of the unused stack */
+#define SYSMEM_PAINT_MARGIN 64U /**> @def Bytes below the stack pointer left unpainted, the frame of the painter */
+
+/**
+ * @struct Memory watermarks, in bytes
+ */
+typedef struct sysmem_stats {
+  uint32_t stack_peak; /* Mayor profundidad de la pila desde _estack */
+  uint32_t stack_reserved; /* _Min_Stack_Size del linker script */
+  uint32_t heap_peak; /* Mayor tamaño del heap desde _end */
+  uint32_t heap_failures; /* Llamadas a _sbrk() rechazadas por falta de memoria */
+  uint32_t free_min; /* Menor distancia entre el heap y la pila */
+} sysmem_stats;
+
+void sysmem_paint_stack(void);
+void sysmem_poll(void);
+const sysmem_stats* sysmem_get_stats(void);
+
+#endif /* INC_SYSMEM_H_ */
@@ -0,0 +1,30 @@
+/**
+ * @file	timebase.h
+ * @brief	Header file for timebase.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_TIMEBASE_H_
+#define INC_TIMEBASE_H_
+
+#include "stm32f0xx_hal.h"
+
+#define TIMEBASE_RATE_GAIN 8 /**> @def Inverse gain of the IIR filter of the rate estimate */
+#define TIMEBASE_SYNC_MAX_INTERVAL_US 10000000U /**> @def Longer gaps between syncs don't update the rate */
+#define TIMEBASE_RATE_LIMIT_PPB 500000 /**> @def Measured rates beyond this are considered outliers */
+#define TIMEBASE_CAN_BIT_US 1U /**> @def Microseconds per count of the CAN timestamp, a bit time at 1 Mbit/s (see MX_CAN_Init()) */
+#define TIMEBASE_SOF_AGING 16U /**> @def Frames between 1 us increments of the SOF offset, see timebase_sof_local_us() */
+
+uint32_t timebase_now_us(void);
+uint32_t timebase_cycles(void);
+uint32_t timebase_bus_us(void);
+uint32_t timebase_bus_us_at(uint32_t local_us);
+uint32_t timebase_sof_local_us(uint16_t sof_stamp, uint32_t now_us);
+void timebase_sync(uint32_t master_us, uint32_t local_us);
+int timebase_is_synced(void);
+int32_t timebase_rate_ppb(void);
+void timebase_set_rate_ppb(int32_t rate);
+
+#endif /* INC_TIMEBASE_H_ */
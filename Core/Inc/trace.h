@@ -0,0 +1,56 @@
+/**
+ * @file	trace.h
+ * @brief	Header file for trace.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include "can.h"
+
+#define TRACE_RING_SIZE 128U /**> @def Records kept in RAM, a power of two */
+#define TRACE_MAGIC 0x54524345UL /**> @def First word of trace_buffer, to find it in a RAM dump */
+#define TRACE_BUSY 0xFFU /**> @def Byte 1 of the answer to CAN_CMD_TRACE while a log transfer is in progress */
+
+/**
+ * @enum Trace events, listed with their format in trace_events.h
+ */
+typedef enum trace_event {
+#define TRACE_EVENT(id, format) id,
+#include "trace_events.h"
+#undef TRACE_EVENT
+  TRACE_EVENTS
+} trace_event;
+
+/**
+ * @struct Record of the ring, also the payload of a trace frame
+ */
+typedef struct trace_record {
+  uint32_t time_cycles; /* timebase_cycles() al escribir el registro */
+  uint16_t event;
+  uint16_t arg;
+} trace_record;
+
+/**
+ * @struct Ring of records, a global so a debugger can read it by name
+ */
+typedef struct trace_ring {
+  uint32_t magic;
+  volatile uint32_t head; /* Registros escritos desde el ultimo arranque en frio */
+  trace_record records[TRACE_RING_SIZE]; /* El registro n esta en n % TRACE_RING_SIZE */
+} trace_ring;
+
+extern trace_ring trace_buffer;
+
+/* Registra un evento, desde cualquier contexto */
+#define TRACE(event, arg) trace_write((event), (uint16_t)(arg))
+
+void trace_init(void);
+void trace_write(trace_event event, uint16_t arg);
+
+void trace_command(can_handle* handle, const can_rx_view* frame);
+
+#endif /* INC_TRACE_H_ */
@@ -0,0 +1,27 @@
+/**
+ * @file	trace_events.h
+ * @brief	Trace events and their format strings, shared by the firmware and the
+ * 		host decoder
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Sin guardas de inclusión: se incluye con TRACE_EVENT definido para generar
+ * el enum en trace.h o la tabla de formatos en Tools/trace_decode.c. El formato
+ * recibe el argumento de 16 bits del registro; los eventos se agregan al final,
+ * el numero de un evento no debe cambiar.
+ */
+
+TRACE_EVENT(TRACE_ADC_BUSY, "ADC busy, can't read")
+TRACE_EVENT(TRACE_ADC_VREF_TIMEOUT, "ADC timed out reading Vref after %u ms")
+TRACE_EVENT(TRACE_ADC_TEMP_TIMEOUT, "ADC timed out reading external temp sensor after %u ms")
+TRACE_EVENT(TRACE_TIMER_BUSY, "Timer still getting freq values, state %u")
+TRACE_EVENT(TRACE_CONFIG_COMMIT, "Configuration committed, status %u")
+TRACE_EVENT(TRACE_LOG_QUERY, "Log query answered with %u records")
+TRACE_EVENT(TRACE_WARM_RESTORE, "Warm restart %u, state restored")
+TRACE_EVENT(TRACE_WATCHDOG_LATE, "Watchdog not fed, late tasks 0x%02x")
+TRACE_EVENT(TRACE_WATCHDOG_RESET, "Watchdog reset, missed tasks 0x%02x")
+TRACE_EVENT(TRACE_FILTER_FAIL, "Filter of range 0x%03x couldn't be programmed")
+TRACE_EVENT(TRACE_RH_TIMEOUT, "RH capture timed out in state %u")
@@ -0,0 +1,52 @@
+/**
+ * @file	warm.h
+ * @brief	Header file for warm.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_WARM_H_
+#define INC_WARM_H_
+
+#include "stm32f0xx_hal.h"
+#include "aggregator.h"
+#include "flash_log.h"
+#include "pdo.h"
+
+#define WARM_NOINIT __attribute__((section(".noinit"))) /**> @def Placement of the variables kept across a reset, see the README */
+#define WARM_MAGIC 0x5741524DUL /**> @def Marks a written copy of the state */
+#define WARM_VERSION 1U /**> @def Changes with the layout of warm_state, an older copy is discarded */
+
+/**
+ * @struct State resumed after a warm restart. Two copies live in .noinit and
+ *         are written in turns, the valid one with the highest sequence wins.
+ */
+typedef struct warm_state {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t restarts; /* Reinicios en caliente seguidos desde el ultimo arranque en frio */
+  uint32_t sequence;
+  int32_t rate_ppb; /* Ver timebase.c */
+  uint32_t slot_offset_us; /* Ver can_schedule.c */
+  uint32_t aggregator_enable;
+  uint32_t aggregator_members[AGGREGATOR_MEMBER_WORDS];
+  pdo_config pdos[PDO_MAX];
+  flash_log_window log_windows[FLASH_LOG_TIERS];
+  uint32_t crc; /* CRC-32 de todo lo anterior, ver crc.c */
+} warm_state;
+
+/**
+ * @struct Warm restart counters
+ */
+typedef struct warm_stats {
+  uint32_t restarts; /* 0 si este arranque fue en frio */
+  uint32_t discarded; /* Copias con la marca pero con CRC o version invalidos */
+} warm_stats;
+
+int warm_restore(can_handle* handle);
+void warm_restore_log(void);
+void warm_save(void);
+const warm_stats* warm_get_stats(void);
+
+#endif /* INC_WARM_H_ */
@@ -0,0 +1,45 @@
+/**
+ * @file	watchdog.h
+ * @brief	Header file for watchdog.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#ifndef INC_WATCHDOG_H_
+#define INC_WATCHDOG_H_
+
+#include "stm32f0xx_hal.h"
+
+#define WATCHDOG_TIMEOUT_MS 4000U /**> @def IWDG timeout with the nominal LSI, 3.2 to 5.3 s with its 30 to 50 kHz tolerance */
+#define WATCHDOG_PRESCALER 64U /**> @def LSI divider, IWDG_PR_PR_2 */
+#define WATCHDOG_RELOAD ((WATCHDOG_TIMEOUT_MS * (LSI_VALUE / 1000U)) / WATCHDOG_PRESCALER) /**> @def Value of IWDG_RLR */
+#define WATCHDOG_MAGIC 0x5744474BUL /**> @def Marks the record of the previous run in .noinit */
+#define WATCHDOG_FAULT 0x80U /**> @def Bit of the missed mask when Error_Handler() or HardFault_Handler() was reached */
+
+/**
+ * @enum Supervised tasks, the bit of a task in the missed mask is 1 << task
+ */
+typedef enum watchdog_task {
+  WATCHDOG_LOOP = 0, /* Una vuelta del ciclo principal */
+  WATCHDOG_SENSORS = 1, /* Una lectura completa */
+  WATCHDOG_CAN_TX = 2, /* Ningun mailbox ocupado mas de CAN_HEALTH_MAILBOX_STUCK_MS */
+  WATCHDOG_TASKS = 3
+} watchdog_task;
+
+/**
+ * @struct Watchdog resets
+ */
+typedef struct watchdog_stats {
+  uint32_t resets; /* Resets del IWDG desde el ultimo arranque en frio */
+  uint8_t missed; /* Tareas vencidas en el ultimo reset del IWDG, 0 si este arranque no fue por él */
+} watchdog_stats;
+
+void watchdog_init(void);
+void watchdog_register(watchdog_task task, uint32_t deadline_ms);
+void watchdog_checkin(watchdog_task task);
+void watchdog_poll(void);
+void watchdog_fault(void);
+const watchdog_stats* watchdog_get_stats(void);
+
+#endif /* INC_WATCHDOG_H_ */
@@ -0,0 +1,426 @@
+/**
+ * @file 	aggregator.c
+ * @brief	Aggregator role: fuses the readings of the other probes of a bin into
+ * 		one frame per bin
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * El agregador reclama a sus miembros: en cada muestra manda una palabra de su
+ * mapa de miembros en CAN_TX_AGG_CLAIM_BASE, por turno. Un nodo reclamado manda
+ * su lectura en cada muestra con el formato de can_pack_reading(), sin importar
+ * la configuración de los PDO, y deja de mandar su telemetria al panel: no
+ * contesta los RTR de lecturas ni manda sus PDO. Si los reclamos dejan de
+ * llegar por AGGREGATOR_CLAIM_TIMEOUT_MS, o llega su palabra sin su bit, vuelve
+ * a la telemetria normal.
+ *
+ * El agregador recibe todo el rango de lecturas en FIFO1 y acumula en el ISR
+ * las de los nodos del mapa de miembros, sin copiar los marcos. Todos los nodos
+ * muestrean en el mismo instante del bus (ver main.c), asi que el tiempo de
+ * muestreo del marco identifica el periodo y es la llave de la ventana.
+ *
+ * Al tomar su propia lectura, el agregador cierra las ventanas de periodos
+ * anteriores y manda un solo marco por periodo con la media, la dispersión
+ * (maximo menos minimo) y el numero de lecturas de cada magnitud. El panel
+ * procesa un marco por contenedor en vez de uno por sonda.
+ *
+ * El rol y los miembros se configuran en el diccionario de objetos.
+ */
+
+#include "aggregator.h"
+#include "main.h"
+#include "sensors.h"
+#include "od.h"
+#include "can_health.h"
+#include "can_tx.h"
+#include "config.h"
+#include "trace.h"
+
+/**
+ * @struct Running sums of a quantity, in centi-units
+ */
+typedef struct accumulator {
+  int32_t sum;
+  int16_t min;
+  int16_t max;
+  uint8_t count;
+} accumulator;
+
+/**
+ * @struct Readings of one sample period
+ */
+typedef struct window {
+  uint32_t key; /* Bits 8 a 31 del tiempo de muestreo */
+  uint8_t open;
+  uint32_t seen[AGGREGATOR_MEMBER_WORDS];
+  accumulator acc[AGGREGATOR_QUANTITIES];
+} window;
+
+static volatile uint8_t enabled = 0;
+static volatile uint32_t members[AGGREGATOR_MEMBER_WORDS];
+
+static window windows[AGGREGATOR_WINDOWS];
+static aggregator_stats stats;
+
+/* Siguiente palabra del mapa de miembros a reclamar */
+static uint8_t claim_word = 0;
+
+/* Agregador que reclamó a este nodo, 0 sin reclamo, y tick del ultimo reclamo */
+static volatile uint8_t owner = 0;
+static volatile uint32_t owner_tick;
+
+/* Rango de las lecturas, sigue a telemetry_base de la configuración */
+static int telemetry_range = -1;
+
+#define RANGE_MASK (~CAN_NODE_ID_MASK & 0x7FFU)
+
+static void config_applied(can_handle* handle, const config_values* previous);
+
+/* Ventana del periodo, o una libre para él. Se llama desde el ISR o con las
+ * interrupciones deshabilitadas. */
+static window* find_window(uint32_t key)
+{
+  for(int i = 0; i < AGGREGATOR_WINDOWS; i++)
+  {
+    if(windows[i].open && windows[i].key == key)
+    {
+      return &windows[i];
+    }
+  }
+
+  for(int i = 0; i < AGGREGATOR_WINDOWS; i++)
+  {
+    window* w = &windows[i];
+    if(!w->open)
+    {
+      w->key = key;
+      w->open = 1;
+      for(uint32_t j = 0; j < AGGREGATOR_MEMBER_WORDS; j++)
+      {
+        w->seen[j] = 0;
+      }
+      for(int q = 0; q < AGGREGATOR_QUANTITIES; q++)
+      {
+        w->acc[q].sum = 0;
+        w->acc[q].count = 0;
+      }
+      return w;
+    }
+  }
+
+  return NULL;
+}
+
+static void accumulate(accumulator* acc, int16_t value)
+{
+  if(acc->count == 0 || value < acc->min) acc->min = value;
+  if(acc->count == 0 || value > acc->max) acc->max = value;
+  acc->sum += value;
+  acc->count++;
+}
+
+/* Suma una lectura, una sola vez por nodo y periodo. Las magnitudes con falla
+ * del sensor no se incluyen. */
+static int add(window* w, uint8_t number, int16_t temp, int16_t rh, uint8_t flags)
+{
+  const uint32_t bit = 1UL << (number % 32U);
+  if(w->seen[number / 32U] & bit)
+  {
+    stats.duplicated++;
+    return 0;
+  }
+  w->seen[number / 32U] |= bit;
+
+  if(!(flags & TEMP_SENSOR_FAIL))
+  {
+    accumulate(&w->acc[AGGREGATOR_TEMP], temp);
+  }
+  if(!(flags & HUM_SENSOR_FAIL))
+  {
+    accumulate(&w->acc[AGGREGATOR_RH], rh);
+  }
+  return 1;
+}
+
+/* Media redondeada y dispersión en decimas, saturada a 255 */
+static void summarize(const accumulator* acc, int16_t* mean, uint8_t* spread)
+{
+  const int32_t n = acc->count;
+  if(n == 0)
+  {
+    *mean = 0;
+    *spread = 0;
+    return;
+  }
+
+  const int32_t half = (acc->sum >= 0) ? n / 2 : -(n / 2);
+  *mean = (int16_t)((acc->sum + half) / n);
+
+  const uint32_t tenths = ((uint32_t)((int32_t)acc->max - acc->min) + 5U) / 10U;
+  *spread = (uint8_t)((tenths > 0xFFU) ? 0xFFU : tenths);
+}
+
+/**
+ * @brief	Sends the fused frame of a period:
+ * 		[0..1] temperature mean [2..3] RH mean, in the centi-units of
+ * 		can_pack_reading() [4] temperature spread [5] RH spread, maximum
+ * 		minus minimum in tenths, saturated at 255 [6] temperatures fused
+ * 		[7] RH readings fused. A quantity with no readings has a count of 0.
+ * 		All fields are little endian.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	window*: Sums of the period
+ *
+ * @retval	None
+ */
+static void send_fused(can_handle* handle, const window* w)
+{
+  int16_t temp;
+  int16_t rh;
+  uint8_t temp_spread;
+  uint8_t rh_spread;
+
+  summarize(&w->acc[AGGREGATOR_TEMP], &temp, &temp_spread);
+  summarize(&w->acc[AGGREGATOR_RH], &rh, &rh_spread);
+
+  const uint8_t data[CAN_MAX_BYTES] = {
+    (uint8_t)temp, (uint8_t)((uint16_t)temp >> 8),
+    (uint8_t)rh, (uint8_t)((uint16_t)rh >> 8),
+    temp_spread, rh_spread,
+    w->acc[AGGREGATOR_TEMP].count, w->acc[AGGREGATOR_RH].count
+  };
+
+  if(can_tx_send(handle, CAN_TX_TELEMETRY, CAN_TX_ID(CAN_TX_AGG_BASE), data, CAN_MAX_BYTES,
+                 CAN_TX_TELEMETRY_DEADLINE_MS) != 0)
+  {
+    can_health_count_drop();
+  }
+}
+
+/* Manda una palabra del mapa de miembros: [0] palabra [1..4] bits, little endian */
+static void send_claim(can_handle* handle)
+{
+  const uint32_t bits = members[claim_word];
+  const uint8_t data[5] = {
+    claim_word, (uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24)
+  };
+
+  if(can_tx_send(handle, CAN_TX_TELEMETRY, CAN_TX_ID(CAN_TX_AGG_CLAIM_BASE), data, sizeof(data),
+                 CAN_TX_TELEMETRY_DEADLINE_MS) != 0)
+  {
+    can_health_count_drop();
+  }
+  claim_word = (uint8_t)((claim_word + 1U) % AGGREGATOR_MEMBER_WORDS);
+}
+
+/**
+ * @brief	Registers the ranges of readings and claims and the entries of the
+ * 		role in the object dictionary. The role starts disabled. Must be
+ * 		called before can_health_init() and can_start().
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void aggregator_init(can_handle* handle)
+{
+  if(od_register(OD_AGGREGATOR_ENABLE, &enabled, OD_U8, 1, OD_RW, 0, 1) != 0 ||
+     od_register(OD_AGGREGATOR_MEMBERS, members, OD_U32, AGGREGATOR_MEMBER_WORDS, OD_RW, 0, 0) != 0 ||
+     od_register(OD_AGGREGATOR_OWNER, &owner, OD_U8, 1, OD_RO, 0, 0) != 0)
+  {
+    Error_Handler();
+  }
+
+  telemetry_range = can_register_mask_handler(handle, config_get()->telemetry_base, RANGE_MASK, aggregator_frame);
+  if(telemetry_range < 0 ||
+     can_register_mask_handler(handle, CAN_TX_AGG_CLAIM_BASE, RANGE_MASK, aggregator_claim) < 0 ||
+     config_register_hook(config_applied) != 0)
+  {
+    Error_Handler();
+  }
+}
+
+/* Mueve el filtro de las lecturas al rango nuevo. Si el banco no se puede
+ * programar el agregador deja de recibirlas, queda en la traza. */
+static void config_applied(can_handle* handle, const config_values* previous)
+{
+  const uint32_t base = config_get()->telemetry_base;
+  if(base != previous->telemetry_base &&
+     can_move_mask_handler(handle, telemetry_range, base, RANGE_MASK) != 0)
+  {
+    TRACE(TRACE_FILTER_FAIL, base);
+  }
+}
+
+/**
+ * @brief	On a member, sends the reading to the aggregator that claimed the node.
+ * 		On the aggregator, closes the windows of previous periods, sending
+ * 		their fused frames, adds the reading of this node and sends the next
+ * 		word of the claims. Called from the main loop after every sample.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	float: Temperature in degrees Celsius
+ * @param	float: RH in percent
+ * @param	uint8_t: Error flags of the reading
+ * @param	uint32_t: Bus time at which the sample was taken
+ *
+ * @retval	None
+ */
+void aggregator_add_reading(can_handle* handle, float temp, float rh, uint8_t error_flags, uint32_t sample_us)
+{
+  /* Un reclamo vencido se suelta aqui, el ISR solo lo renueva */
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if(owner != 0 && (HAL_GetTick() - owner_tick) >= AGGREGATOR_CLAIM_TIMEOUT_MS)
+  {
+    owner = 0;
+  }
+  __set_PRIMASK(primask);
+
+  if(owner != 0)
+  {
+    uint8_t data[CAN_MAX_BYTES];
+    can_pack_reading(temp, rh, error_flags, sample_us, data);
+    can_write_to_mailbox(handle, data, CAN_MAX_BYTES);
+    stats.fed++;
+  }
+
+  if(!enabled)
+  {
+    return;
+  }
+
+  const uint32_t key = sample_us >> 8;
+
+  for(int i = 0; i < AGGREGATOR_WINDOWS; i++)
+  {
+    window closed;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    const int done = windows[i].open && windows[i].key != key;
+    if(done)
+    {
+      closed = windows[i];
+      windows[i].open = 0;
+    }
+    __set_PRIMASK(primask);
+
+    if(!done)
+    {
+      continue;
+    }
+
+    send_fused(handle, &closed);
+    stats.frames++;
+  }
+
+  send_claim(handle);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  window* w = find_window(key);
+  if(w != NULL)
+  {
+    add(w, node_id_get(), can_centi_signed(temp), (int16_t)can_centi_unsigned(rh), error_flags);
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief	Gets the counters of the aggregator
+ * @param	None
+ *
+ * @retval	Pointer to the counters
+ */
+const aggregator_stats* aggregator_get_stats(void)
+{
+  return &stats;
+}
+
+/**
+ * @brief	Tells whether an aggregator claimed this node. A claimed node sends its
+ * 		reading only to the aggregator and no other telemetry.
+ * @param	None
+ *
+ * @retval	1 if claimed, 0 if not
+ */
+int aggregator_is_claimed(void)
+{
+  return owner != 0;
+}
+
+/**
+ * @brief	Handler of the range of readings, called from the RX interrupt. Frames
+ * 		from nodes outside the member bitmap are ignored.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the reading, in the format of can_pack_reading()
+ *
+ * @retval	None
+ */
+void aggregator_frame(can_handle* handle, const can_rx_view* frame)
+{
+  (void)handle;
+  if(!enabled || can_view_dlc(frame) < CAN_MAX_BYTES)
+  {
+    return;
+  }
+
+  const uint8_t number = (uint8_t)(can_view_std_id(frame) & CAN_NODE_ID_MASK);
+  if(!(members[number / 32U] & (1UL << (number % 32U))))
+  {
+    return;
+  }
+
+  const uint32_t low = can_view_low_word(frame);
+  const uint32_t high = can_view_high_word(frame);
+
+  window* w = find_window(high >> 8);
+  if(w == NULL)
+  {
+    stats.no_window++;
+    return;
+  }
+
+  if(add(w, number, (int16_t)(low & 0xFFFFU), (int16_t)(low >> 16), (uint8_t)high))
+  {
+    stats.fused++;
+  }
+}
+
+/**
+ * @brief	Handler of the range of claims, called from the RX interrupt. Payload:
+ * 		[0] word of the member bitmap [1..4] bits of the word, little endian.
+ * 		The word that holds this node claims it with its bit set, and
+ * 		releases it with the bit clear if it came from the same aggregator.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the claim
+ *
+ * @retval	None
+ */
+void aggregator_claim(can_handle* handle, const can_rx_view* frame)
+{
+  (void)handle;
+  if(can_view_dlc(frame) < 5 || !node_id_is_claimed())
+  {
+    return;
+  }
+
+  const uint8_t sender = (uint8_t)(can_view_std_id(frame) & CAN_NODE_ID_MASK);
+  const uint8_t number = node_id_get();
+  if(sender == number || can_view_byte(frame, 0) != number / 32U)
+  {
+    return;
+  }
+
+  const uint32_t bits = can_view_byte(frame, 1) | (can_view_byte(frame, 2) << 8) |
+                        (can_view_byte(frame, 3) << 16) | ((uint32_t)can_view_byte(frame, 4) << 24);
+  if(bits & (1UL << (number % 32U)))
+  {
+    owner = sender;
+    owner_tick = HAL_GetTick();
+  }
+  else if(owner == sender)
+  {
+    owner = 0;
+  }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file 	boot.c
+ * @brief	Timestamps of the boot phases and cause of the last reset
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Los tiempos son timebase_now_us() al terminar cada fase, contados desde
+ * HAL_Init(), que arranca SysTick; el arranque previo (copia de .data, limpieza
+ * de .bss y pintado de la pila) no se mide. Se leen del diccionario de objetos
+ * y viajan en el primer marco de diagnostico, ver can_health.c.
+ */
+
+#include "boot.h"
+#include "timebase.h"
+#include "can_health.h"
+
+static boot_stats stats;
+
+/**
+ * @brief	Keeps the reset flags and clears them for the next reset. Called
+ * 		right after HAL_Init().
+ * @param	None
+ *
+ * @retval	None
+ */
+void boot_init(void)
+{
+  for(uint8_t phase = 0; phase < BOOT_PHASES; phase++)
+  {
+    stats.phases[phase] = BOOT_NOT_REACHED;
+  }
+
+  /* OBL, pin, POR/PDR, software, IWDG, WWDG, bajo consumo y V1.8, del bit 0 al 7 */
+  stats.reset_flags = (uint8_t)(RCC->CSR >> 24);
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+}
+
+/**
+ * @brief	Notes the end of a phase, only the first time
+ * @param	boot_phase: Phase
+ *
+ * @retval	None
+ */
+void boot_mark(boot_phase phase)
+{
+  if(stats.phases[phase] == BOOT_NOT_REACHED)
+  {
+    stats.phases[phase] = timebase_now_us();
+  }
+}
+
+int boot_reached(boot_phase phase)
+{
+  return stats.phases[phase] != BOOT_NOT_REACHED;
+}
+
+/**
+ * @brief	Gets the boot timestamps and the reset flags
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const boot_stats* boot_get_stats(void)
+{
+  return &stats;
+}
+
+/* Tiempo de una fase en unidades del reporte, 0xFFFF si no termino o no cabe */
+static uint16_t report_time(boot_phase phase)
+{
+  const uint32_t units = (stats.phases[phase] == BOOT_NOT_REACHED) ? 0xFFFFU : stats.phases[phase] / BOOT_REPORT_UNIT_US;
+  return (units > 0xFFFFU) ? 0xFFFFU : (uint16_t)units;
+}
+
+/**
+ * @brief	Packs the boot report, sent as the first diagnostic frame:
+ * 		[0..1] clock ready [2] CAN_BUS_BOOT [3..4] CAN up and node announced
+ * 		[5..6] first valid reading [7] reset flags. Times in units of
+ * 		BOOT_REPORT_UNIT_US since HAL_Init(), little endian.
+ * @param	uint8_t*: Frame payload, CAN_MAX_BYTES
+ *
+ * @retval	None
+ */
+void boot_pack_report(uint8_t* data)
+{
+  const uint16_t clock = report_time(BOOT_CLOCK);
+  const uint16_t can = report_time(BOOT_CAN);
+  const uint16_t reading = report_time(BOOT_FIRST_READING);
+
+  data[0] = (uint8_t)clock;
+  data[1] = (uint8_t)(clock >> 8);
+  data[2] = CAN_BUS_BOOT;
+  data[3] = (uint8_t)can;
+  data[4] = (uint8_t)(can >> 8);
+  data[5] = (uint8_t)reading;
+  data[6] = (uint8_t)(reading >> 8);
+  data[7] = stats.reset_flags;
+}
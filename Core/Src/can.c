@@ -8,13 +8,86 @@
  */
 
 #include "can.h"
+#include "main.h"
+#include "timebase.h"
+#include "can_health.h"
+#include "can_schedule.h"
+#include "can_tx.h"
+#include "config.h"
+#include "aggregator.h"
 #include "comm_defs.h"
 
-/* Almacena mailboxes activos */
-static uint32_t tx_mailboxes = 0;
+/* Respuesta a las peticiones RTR del panel, con doble buffer. El ciclo principal
+ * escribe la copia inactiva y luego cambia el indice, el ISR solo lee la activa.
+ */
+static can_tx_image response_cache[2];
+static volatile uint8_t response_index = 0;
+static volatile uint8_t response_valid = 0;
+
+/* Inicio de las peticiones cuya respuesta sigue en can_tx, para medir la
+ * latencia. La respuesta lleva el indice + 1 como marca, ver can_tx_mailbox_tag() */
+static uint32_t poll_start_us[CAN_TX_RESPONSE_DEPTH];
+static uint16_t poll_start_bits[CAN_TX_RESPONSE_DEPTH];
+static volatile uint8_t poll_pending = 0;
+static uint8_t poll_next = 0;
+static can_poll_latency poll_latency;
+
+/* Marcas de tiempo de hardware de cada marco recibido y transmitido */
+static can_stamp stamp_log[CAN_STAMP_LOG_SIZE];
+static uint32_t stamp_head = 0;
+
+static can_rx_handler command_handlers[CAN_MAX_COMMANDS];
+
+/* Tick de la ultima petición o comando del panel, 0 si nunca hubo */
+static volatile uint32_t panel_tick = 0;
+
+static inline void mark_panel_contact(void)
+{
+  const uint32_t now = HAL_GetTick();
+  panel_tick = (now != 0U) ? now : 1U;
+}
+
+static inline void log_stamp(uint16_t time, uint16_t id)
+{
+  can_stamp* stamp = &stamp_log[stamp_head & (CAN_STAMP_LOG_SIZE - 1)];
+  stamp->time = time;
+  stamp->id = id;
+  stamp_head++;
+}
+
+/**
+ * @brief	Encodes a reading in the 8 bytes of a frame:
+ * 		[0..1] temperature in centi-degrees Celsius, signed
+ * 		[2..3] RH in centi-percent, unsigned
+ * 		[4] sensor_error flags
+ * 		[5..7] bus time of the sample, in units of 256 us (bits 8 to 31 of the
+ * 		microsecond bus time)
+ * 		All fields are little endian.
+ * @param	float: Temperature in degrees Celsius
+ * @param	float: RH in percent
+ * @param	uint8_t: Error flags of the reading
+ * @param	uint32_t: Bus time at which the sample was taken
+ * @param	uint8_t*: Pointer to a buffer of CAN_MAX_BYTES bytes
+ *
+ * @retval	None
+ */
+void can_pack_reading(float temp, float rh, uint8_t error_flags, uint32_t bus_us, uint8_t* data)
+{
+  const int16_t temp_centi = can_centi_signed(temp);
+  const uint16_t rh_centi = can_centi_unsigned(rh);
+
+  data[0] = (uint8_t)temp_centi;
+  data[1] = (uint8_t)((uint16_t)temp_centi >> 8);
+  data[2] = (uint8_t)rh_centi;
+  data[3] = (uint8_t)(rh_centi >> 8);
+  data[4] = error_flags;
+  data[5] = (uint8_t)(bus_us >> 8);
+  data[6] = (uint8_t)(bus_us >> 16);
+  data[7] = (uint8_t)(bus_us >> 24);
+}
 
 /**
- * @brief	Writes the content from a data buffer into the mailbox, to be sent in the CAN bus
+ * @brief	Queues a reading as telemetry of this node, to be sent in the CAN bus
  * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
  * @param	uint8_t*: Pointer to the data buffer
  * @param	int: Number of bytes to write, can't be larger than CAN_MAX_BYTES
@@ -23,103 +96,599 @@ static uint32_t tx_mailboxes = 0;
  */
 uint32_t can_write_to_mailbox(can_handle* handle, uint8_t* data, int bytes)
 {
-  can_tx_packet packet;
-  packet.StdId = SENSOR_OUTPUT_CAN_STD_ID; //Identificador estandar con prioridad 2
-  packet.IDE = CAN_ID_STD; //Identificador estandar
-  packet.RTR = CAN_RTR_DATA; //Tipo de paquete (Data frame / Remote frame)
-  packet.DLC = bytes; //Tamaño del paquete
+  return can_write_id_to_mailbox(handle, CAN_TX_ID(config_get()->telemetry_base), data, bytes);
+}
 
-  if(bytes > CAN_MAX_BYTES) {
-	  //printf("CAN-TX: Se intentaron enviar %d bytes, el maximo es %d.\n", bytes, CAN_MAX_BYTES);
-	  return handle->ErrorCode;
+/**
+ * @brief	Same as can_write_to_mailbox(), with an explicit standard identifier.
+ * 		Frames are sent as telemetry, see can_tx.c for other classes.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Standard identifier
+ * @param	uint8_t*: Pointer to the data buffer
+ * @param	int: Number of bytes to write, can't be larger than CAN_MAX_BYTES
+ *
+ * @retval	CAN error
+ */
+uint32_t can_write_id_to_mailbox(can_handle* handle, uint32_t std_id, uint8_t* data, int bytes)
+{
+  if(can_tx_send(handle, CAN_TX_TELEMETRY, std_id, data, bytes, CAN_TX_TELEMETRY_DEADLINE_MS) != 0)
+  {
+    can_health_count_drop();
   }
 
-  if(HAL_CAN_GetTxMailboxesFreeLevel(handle) > 0)
+  return handle->ErrorCode;
+}
+
+/**
+ * @brief	Stores the latest reading as a ready to send frame, used to answer
+ * 		RTR polls from the control panel without touching the sensors.
+ * 		Should be called every time a new measurement completes.
+ * @param	uint8_t*: Pointer to the data buffer
+ * @param	int: Number of bytes, can't be larger than CAN_MAX_BYTES
+ *
+ * @retval	None
+ */
+void can_cache_response(const uint8_t* data, int bytes)
+{
+  if(bytes > CAN_MAX_BYTES)
   {
-	  if(HAL_CAN_AddTxMessage(handle, &packet, data, &tx_mailboxes) != HAL_CAN_ERROR_NONE)
-	  {
-		  Error_Handler();
-	  }
+    return;
   }
-  else
+
+  can_tx_build_image(CAN_TX_ID(config_get()->telemetry_base), data, bytes, &response_cache[response_index ^ 1U]);
+
+  response_index ^= 1U;
+  response_valid = 1;
+}
+
+/**
+ * @brief	RX handler for control panel RTR polls. The cached frame is queued
+ * 		as a response right away, or when the node has a TDMA slot
+ * 		assigned (see can_schedule.c), once the slot begins. A node claimed
+ * 		by an aggregator doesn't answer, the panel reads the bin instead.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the received remote frame
+ *
+ * @retval	None
+ */
+void can_answer_poll(can_handle* handle, const can_rx_view* frame)
+{
+  const uint32_t start = timebase_now_us();
+  const uint16_t poll_time = can_view_timestamp(frame);
+
+  mark_panel_contact();
+
+  if(aggregator_is_claimed())
   {
-	  //MAILBOXES LLENOS
-	  printf("CAN-TX: Mailboxes llenos, no enviando los siguientes datos: 0x");
-	  for(int i = 0; i < packet.DLC; i++)
-	  {
-	     printf("%X", *(data + i) );
-	  }
-	  printf("\n");
+    return;
   }
 
-  return handle->ErrorCode;
+  if(can_schedule_defer(handle, start, poll_time))
+  {
+    return;
+  }
+
+  can_queue_cached_response(handle, start, poll_time);
 }
 
 /**
- * @brief	Reads the content from a CAN FIFO buffer into a given data buffer
+ * @brief	Queues a copy of the cached frame in the CAN_TX_RESPONSE class, from
+ * 		interrupt context. It goes out ahead of telemetry and bulk frames,
+ * 		and is retried until CAN_TX_RESPONSE_DEADLINE_MS if it fails.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: timebase_now_us() when the poll was received
+ * @param	uint16_t: Hardware timestamp of the poll
+ *
+ * @retval	None
+ */
+void can_queue_cached_response(can_handle* handle, uint32_t start_us, uint16_t poll_time)
+{
+  if(!response_valid)
+  {
+    poll_latency.dropped++;
+    return;
+  }
+
+  /* El ISR de TX no puede interrumpir a este, tiene la misma prioridad */
+  const uint8_t poll = poll_next;
+  poll_start_us[poll] = start_us;
+  poll_start_bits[poll] = poll_time;
+
+  if(can_tx_send_image(handle, CAN_TX_RESPONSE, &response_cache[response_index],
+                       CAN_TX_RESPONSE_DEADLINE_MS, poll + 1U) != 0)
+  {
+    /* Cola de respuestas llena */
+    poll_latency.dropped++;
+    return;
+  }
+
+  poll_pending |= (1U << poll);
+  poll_next = (poll + 1U) % CAN_TX_RESPONSE_DEPTH;
+}
+
+/**
+ * @brief	Returns the poll to response latency statistics
+ *
+ * @retval	can_poll_latency*: Pointer to the statistics
+ */
+const can_poll_latency* can_get_poll_latency(void)
+{
+  return &poll_latency;
+}
+
+/**
+ * @brief	Returns the ring of hardware timestamps
+ * @param	uint32_t*: Stores the number of stamps logged since boot, the newest
+ * 		is at (head - 1) % CAN_STAMP_LOG_SIZE
+ *
+ * @retval	can_stamp*: Pointer to the first element of the ring
+ */
+const can_stamp* can_get_stamp_log(uint32_t* head)
+{
+  *head = stamp_head;
+  return stamp_log;
+}
+
+/**
+ * @brief	Bookkeeping after a mailbox finished transmitting
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Mailbox number, 0 to 2
+ *
+ * @retval	None
+ */
+static RAMFUNC void can_tx_complete(can_handle* handle, uint32_t mailbox)
+{
+  const CAN_TxMailBox_TypeDef* tx = &handle->Instance->sTxMailBox[mailbox];
+  const uint16_t tx_time = (uint16_t)((tx->TDTR & CAN_TDT0R_TIME) >> CAN_TDT0R_TIME_Pos);
+
+  log_stamp(tx_time, (uint16_t)(((tx->TIR & CAN_TI0R_STID) >> CAN_TI0R_STID_Pos) | CAN_STAMP_TX));
+  can_health_count_tx(handle, mailbox);
+
+  const uint32_t tag = can_tx_mailbox_tag(mailbox);
+  const uint32_t poll = tag - 1U;
+  if(tag != CAN_TX_NO_TAG && poll < CAN_TX_RESPONSE_DEPTH && (poll_pending & (1U << poll)))
+  {
+    poll_pending &= ~(1U << poll);
+
+    /* El temporizador es de 16 bits, la resta modular es valida si la
+     * respuesta sale antes de 65536 bits */
+    const uint16_t bus_bits = (uint16_t)(tx_time - poll_start_bits[poll]);
+    poll_latency.bus_last_bits = bus_bits;
+    if(bus_bits > poll_latency.bus_max_bits)
+    {
+      poll_latency.bus_max_bits = bus_bits;
+    }
+
+    const uint32_t elapsed = timebase_now_us() - poll_start_us[poll];
+    poll_latency.last_us = elapsed;
+    poll_latency.total_us += elapsed;
+    poll_latency.count++;
+    if(elapsed > poll_latency.max_us)
+    {
+      poll_latency.max_us = elapsed;
+    }
+  }
+
+  can_tx_mailbox_done(handle, mailbox, 1);
+}
+
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef* hcan)
+{
+  can_tx_complete(hcan, 0);
+}
+
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef* hcan)
+{
+  can_tx_complete(hcan, 1);
+}
+
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef* hcan)
+{
+  can_tx_complete(hcan, 2);
+}
+
+/* Una respuesta abortada o fallida vuelve a su cola en can_tx, la petición
+ * sigue pendiente hasta que sale */
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef* hcan)
+{
+  can_health_count_abort();
+  can_tx_mailbox_done(hcan, 0, 0);
+}
+
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef* hcan)
+{
+  can_health_count_abort();
+  can_tx_mailbox_done(hcan, 1, 0);
+}
+
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef* hcan)
+{
+  can_health_count_abort();
+  can_tx_mailbox_done(hcan, 2, 0);
+}
+
+/**
+ * @brief	HAL error callback, forwards the error code to the bus health module
+ * 		and clears it so that every callback only reports new errors
+ * @param	CAN_HandleTypeDef*: Pointer to the CAN handle
+ *
+ * @retval	None
+ */
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef* hcan)
+{
+  const uint32_t error_code = hcan->ErrorCode;
+
+  const uint32_t failed[3] = {
+    HAL_CAN_ERROR_TX_ALST0 | HAL_CAN_ERROR_TX_TERR0,
+    HAL_CAN_ERROR_TX_ALST1 | HAL_CAN_ERROR_TX_TERR1,
+    HAL_CAN_ERROR_TX_ALST2 | HAL_CAN_ERROR_TX_TERR2
+  };
+
+  can_health_on_error(hcan, error_code);
+  HAL_CAN_ResetError(hcan);
+
+  for(uint32_t mailbox = 0; mailbox < 3; mailbox++)
+  {
+    if(error_code & failed[mailbox])
+    {
+      can_tx_mailbox_done(hcan, mailbox, 0);
+    }
+  }
+}
+
+/* Tabla de handlers, indexada por el FMI que reporta bxCAN. Cada identificador
+ * registrado ocupa un slot de 16 bits de un banco de filtros en modo lista, por
+ * lo que el FMI coincide con el indice del slot y el despacho es O(1).
+ */
+static can_rx_handler rx_handlers[CAN_MAX_RX_HANDLERS];
+static uint16_t rx_filter_ids[CAN_MAX_RX_HANDLERS];
+static int rx_handler_count = 0;
+
+/* Rangos de identificadores en FIFO1, que numera sus FMI aparte de FIFO0. Cada
+ * banco en modo mascara de 16 bits tiene dos filtros iguales, FMI / 2 es el
+ * indice del handler.
+ */
+static can_rx_handler mask_handlers[CAN_MAX_MASK_HANDLERS];
+static int mask_handler_count = 0;
+
+_Static_assert(CAN_MASK_FILTER_FIRST_BANK + CAN_MAX_MASK_HANDLERS <= CAN_FILTER_BANKS, "the ranges don't fit in the filter banks");
+_Static_assert(CAN_MAX_RX_HANDLERS / CAN_FILTER_SLOTS_PER_BANK <= CAN_MASK_FILTER_FIRST_BANK, "the list banks overlap the ranges");
+
+static int program_mask_bank(can_handle* handle, int index, uint32_t std_id, uint32_t mask);
+
+/**
+ * @brief	Registers a handler for a standard identifier, programming a slot of a
+ * 		list mode filter bank so that only accepted frames reach FIFO0
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Standard identifier to accept
+ * @param	uint32_t: CAN_RTR_DATA or CAN_RTR_REMOTE, the filter matches on it too
+ * @param	can_rx_handler: Function called with a view of every matching frame
+ *
+ * @retval	Filter match index assigned to the handler, -1 if the table is full or
+ * 		the bank can't be programmed
+ */
+int can_register_handler(can_handle* handle, uint32_t std_id, uint32_t rtr, can_rx_handler handler)
+{
+  if(rx_handler_count >= CAN_MAX_RX_HANDLERS)
+  {
+    return -1;
+  }
+
+  const int fmi = rx_handler_count++;
+  const int bank = fmi / CAN_FILTER_SLOTS_PER_BANK;
+  const int first = bank * CAN_FILTER_SLOTS_PER_BANK;
+
+  /* Formato de 16 bits: STID[10:0] RTR IDE EXID[17:15] */
+  rx_filter_ids[fmi] = (uint16_t)((std_id << 5) | ((rtr == CAN_RTR_REMOTE) ? 0x10U : 0x00U));
+  rx_handlers[fmi] = handler;
+
+  /* Los slots libres repiten el primer identificador del banco, en caso de
+   * coincidencias multiples gana el slot de menor numero, asi que nunca se usan */
+  uint16_t slot[CAN_FILTER_SLOTS_PER_BANK];
+  for(int i = 0; i < CAN_FILTER_SLOTS_PER_BANK; i++)
+  {
+    slot[i] = (first + i < rx_handler_count) ? rx_filter_ids[first + i] : rx_filter_ids[first];
+  }
+
+  CAN_FilterTypeDef filter;
+  filter.FilterBank = bank;
+  filter.FilterMode = CAN_FILTERMODE_IDLIST;
+  filter.FilterScale = CAN_FILTERSCALE_16BIT;
+  filter.FilterIdLow = slot[0];
+  filter.FilterMaskIdLow = slot[1];
+  filter.FilterIdHigh = slot[2];
+  filter.FilterMaskIdHigh = slot[3];
+  filter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+  filter.FilterActivation = CAN_FILTER_ENABLE;
+  filter.SlaveStartFilterBank = 0; /* Sin efecto en dispositivos de un solo CAN */
+
+  /* Se llama tambien con el periférico andando, un error se devuelve para
+   * que quien registra decida. El banco no se escribió, se libera el slot */
+  if(HAL_CAN_ConfigFilter(handle, &filter) != HAL_OK)
+  {
+    rx_handler_count--;
+    return -1;
+  }
+
+  return fmi;
+}
+
+/**
+ * @brief	Registers a handler for a range of standard data frame identifiers,
+ * 		programming a mask mode filter bank routed to FIFO1. Between ranges that
+ * 		overlap, the one registered first wins. Identifiers registered with
+ * 		can_register_handler() keep going to FIFO0, list filters have priority.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Standard identifier to compare
+ * @param	uint32_t: Bits of the identifier that must match, 0 accepts every frame
+ * @param	can_rx_handler: Function called with a view of every matching frame
+ *
+ * @retval	Index of the range, -1 if the table is full or the bank can't be
+ * 		programmed
+ */
+int can_register_mask_handler(can_handle* handle, uint32_t std_id, uint32_t mask, can_rx_handler handler)
+{
+  if(mask_handler_count >= CAN_MAX_MASK_HANDLERS)
+  {
+    return -1;
+  }
+
+  const int index = mask_handler_count;
+  if(program_mask_bank(handle, index, std_id, mask) != 0)
+  {
+    return -1;
+  }
+
+  mask_handlers[index] = handler;
+  mask_handler_count++;
+
+  return index;
+}
+
+/**
+ * @brief	Moves a range registered with can_register_mask_handler(), keeping its
+ * 		handler. The bank is reprogrammed with the peripheral running, frames of
+ * 		the range that arrive meanwhile are lost.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	int: Index of the range
+ * @param	uint32_t: Standard identifier to compare
+ * @param	uint32_t: Bits of the identifier that must match, 0 accepts every frame
+ *
+ * @retval	0 on success, -1 if the range doesn't exist or the bank can't be
+ * 		programmed
+ */
+int can_move_mask_handler(can_handle* handle, int index, uint32_t std_id, uint32_t mask)
+{
+  if(index < 0 || index >= mask_handler_count)
+  {
+    return -1;
+  }
+
+  return program_mask_bank(handle, index, std_id, mask);
+}
+
+static int program_mask_bank(can_handle* handle, int index, uint32_t std_id, uint32_t mask)
+{
+  /* Formato de 16 bits, con mascara no nula tambien se comparan RTR e IDE */
+  const uint16_t id = (uint16_t)(std_id << 5);
+  const uint16_t id_mask = (mask != 0U) ? (uint16_t)((mask << 5) | 0x18U) : 0U;
+  const int bank = CAN_MASK_FILTER_FIRST_BANK + index;
+
+  /* La HAL solo revisa el banco con USE_FULL_ASSERT */
+  if(index < 0 || bank >= CAN_FILTER_BANKS)
+  {
+    return -1;
+  }
+
+  CAN_FilterTypeDef filter;
+  filter.FilterBank = (uint32_t)bank;
+  filter.FilterMode = CAN_FILTERMODE_IDMASK;
+  filter.FilterScale = CAN_FILTERSCALE_16BIT;
+  filter.FilterIdLow = id;
+  filter.FilterMaskIdLow = id_mask;
+  filter.FilterIdHigh = id;
+  filter.FilterMaskIdHigh = id_mask;
+  filter.FilterFIFOAssignment = CAN_FILTER_FIFO1;
+  filter.FilterActivation = CAN_FILTER_ENABLE;
+  filter.SlaveStartFilterBank = 0;
+
+  return (HAL_CAN_ConfigFilter(handle, &filter) == HAL_OK) ? 0 : -1;
+}
+
+/**
+ * @brief	Enables the FIFO and TX interrupts and starts the CAN peripheral. Handlers
+ * 		should be registered beforehand.
  * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
- * @param	uint8_t*: Pointer to the data buffer
  *
  * @retval	CAN error
  */
-uint32_t can_get_from_fifo(can_handle* handle, uint8_t* data[])
+uint32_t can_start(can_handle* handle)
 {
-  can_rx_packet packet;
-  uint8_t data_input[CAN_MAX_BYTES];
+  uint32_t notifications = CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY;
+  if(mask_handler_count > 0)
+  {
+    notifications |= CAN_IT_RX_FIFO1_MSG_PENDING;
+  }
+
+  if(HAL_CAN_ActivateNotification(handle, notifications) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if(HAL_CAN_Start(handle) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  return handle->ErrorCode;
+}
+
+/**
+ * @brief	Drains a receive FIFO, passing each frame in place to the handler that
+ * 		owns its filter match index. No data is copied out of the mailbox.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: CAN_RX_FIFO0 or CAN_RX_FIFO1
+ *
+ * @retval	None
+ */
+RAMFUNC void can_dispatch_fifo(can_handle* handle, uint32_t fifo)
+{
+  CAN_TypeDef* can_ip = handle->Instance;
+  __IO uint32_t* rfr = (fifo == CAN_RX_FIFO0) ? &can_ip->RF0R : &can_ip->RF1R;
+
+  can_rx_view frame;
+  frame.mailbox = &can_ip->sFIFOMailBox[fifo];
+  frame.fifo = fifo;
 
-  // Hay que revisar como manejar multiples FIFOS
-  uint32_t rx_fill_level;
-  if( (rx_fill_level = HAL_CAN_GetRxFifoFillLevel(handle, CAN_RX_FIFO0)) > 0)
+  while((*rfr & CAN_RF0R_FMP0) != 0U)
   {
-    for(int i = 0; i < rx_fill_level; i++)
+    const uint32_t fmi = can_view_fmi(&frame);
+
+    log_stamp(can_view_timestamp(&frame), (uint16_t)can_view_std_id(&frame));
+    can_health_count_rx(&frame);
+
+    if(fifo == CAN_RX_FIFO0)
     {
-      if(HAL_CAN_GetRxMessage(handle, CAN_RX_FIFO0, &packet, data[i]) != HAL_OK)
+      if(fmi < (uint32_t)rx_handler_count)
       {
-	/* FAILED TO RECEIVE PACKET */
-	printf("CAN-RX: Failed to receive packet\n");
-	*data[i] = NO_DATA;
+        rx_handlers[fmi](handle, &frame);
       }
-      else
+    }
+    else if(fmi / 2U < (uint32_t)mask_handler_count)
+    {
+      mask_handlers[fmi / 2U](handle, &frame);
+    }
+
+    /* Libera el mailbox de salida, RFOM0 y RFOM1 ocupan el mismo bit. Se
+     * escribe directo: FULL y FOVR se borran escribiendo 1 y un SET_BIT los
+     * perderia */
+    *rfr = CAN_RF0R_RFOM0;
+  }
+}
+
+/**
+ * @brief	Registers the handler of a control panel command
+ * @param	uint8_t: Command code, first byte of the frame
+ * @param	can_rx_handler: Function called with a view of the command frame
+ *
+ * @retval	0 on success, -1 if the code is out of range
+ */
+int can_register_command(uint8_t code, can_rx_handler handler)
+{
+  if(code >= CAN_MAX_COMMANDS)
+  {
+    return -1;
+  }
+
+  command_handlers[code] = handler;
+  return 0;
+}
+
+/**
+ * @brief	RX handler for data frames from the control panel, dispatches on the
+ * 		command code in the first byte
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the received frame
+ *
+ * @retval	None
+ */
+void can_dispatch_command(can_handle* handle, const can_rx_view* frame)
+{
+  mark_panel_contact();
+
+  if(can_view_dlc(frame) == 0)
+  {
+    return;
+  }
+
+  const uint8_t code = can_view_byte(frame, 0);
+  if(code < CAN_MAX_COMMANDS && command_handlers[code] != NULL)
+  {
+    command_handlers[code](handle, frame);
+  }
+}
+
+/**
+ * @brief	Gets the tick of the last poll or command from the control panel
+ * @param	None
+ *
+ * @retval	HAL tick, 0 if the panel has not been heard yet
+ */
+uint32_t can_get_panel_tick(void)
+{
+  return panel_tick;
+}
+
+/**
+ * @brief	HAL callback for pending messages in FIFO0, overrides the weak definition
+ * @param	CAN_HandleTypeDef*: Pointer to the CAN handle
+ *
+ * @retval	None
+ */
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef* hcan)
+{
+  can_dispatch_fifo(hcan, CAN_RX_FIFO0);
+}
+
+/**
+ * @brief	HAL callback for pending messages in FIFO1, which holds the ranges of
+ * 		can_register_mask_handler()
+ * @param	CAN_HandleTypeDef*: Pointer to the CAN handle
+ *
+ * @retval	None
+ */
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef* hcan)
+{
+  can_dispatch_fifo(hcan, CAN_RX_FIFO1);
+}
+
+/**
+ * @brief	Direct CAN interrupt, replaces HAL_CAN_IRQHandler() with
+ * 		DIRECT_ISR_CAN. Handles the frequent events, a received frame and a
+ * 		mailbox sent without error, and leaves the rest (failed mailboxes,
+ * 		overruns, bus errors) to the HAL, which only sees what is left.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+RAMFUNC void can_irq(can_handle* handle)
+{
+  CAN_TypeDef* can_ip = handle->Instance;
+  const uint32_t ier = can_ip->IER;
+
+  if(ier & CAN_IER_TMEIE)
+  {
+    const uint32_t tsr = can_ip->TSR;
+    for(uint32_t mailbox = 0; mailbox < 3; mailbox++)
+    {
+      const uint32_t rqcp = CAN_TSR_RQCP0 << (8U * mailbox);
+      if((tsr & rqcp) && (tsr & (CAN_TSR_TXOK0 << (8U * mailbox))))
       {
-	/* PARSE PACKET */
-	const int identifier = packet.StdId;
-	const int id_type = packet.IDE;
-	const int packet_type =  packet.RTR;
-	const int bytes = packet.DLC;
-
-	char should_parse = 1;
-	if(id_type != CAN_ID_STD)
-	{
-	  //printf("Utilize el identificador CAN estandar, no el extendido\n");
-	  should_parse = 0;
-	}
-	if(packet_type != CAN_RTR_REMOTE)
-	{
-	  //printf("Sensor recibio datos en vez de una petición. Ignorando datos\n");
-	  should_parse = 0;
-	}
-	if(identifier != CONTROL_PANEL_CAN_STD_ID)
-	{
-	  //printf("Sensor recibio paquete de ID que no es del panel de control\n");
-	  should_parse = 0;
-	}
-
-	if(should_parse)
-	{
-	  for(int j = 0; j < bytes; j++)
-	    data[j] = data_input[j];
-	}
-	else
-	{
-	  printf("Not parsing data, deleting it\n");
-	  for(int j = 0; j < bytes; j++)
-	    data[j] = NO_DATA;    
-	}
-	
+        /* Borra tambien TXOK, ALST y TERR del mailbox */
+        can_ip->TSR = rqcp;
+        can_tx_complete(handle, mailbox);
       }
-
     }
   }
 
-  return handle->ErrorCode;
+  if((ier & CAN_IER_FMPIE0) && (can_ip->RF0R & CAN_RF0R_FMP0))
+  {
+    can_dispatch_fifo(handle, CAN_RX_FIFO0);
+  }
+  if((ier & CAN_IER_FMPIE1) && (can_ip->RF1R & CAN_RF1R_FMP1))
+  {
+    can_dispatch_fifo(handle, CAN_RX_FIFO1);
+  }
+
+  /* Lo que queda pendiente de las interrupciones habilitadas */
+  const uint32_t rf0r = can_ip->RF0R;
+  const uint32_t rf1r = can_ip->RF1R;
+  const uint32_t msr = can_ip->MSR;
+  if(((ier & CAN_IER_TMEIE) && (can_ip->TSR & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2))) ||
+     ((ier & CAN_IER_FFIE0) && (rf0r & CAN_RF0R_FULL0)) || ((ier & CAN_IER_FOVIE0) && (rf0r & CAN_RF0R_FOVR0)) ||
+     ((ier & CAN_IER_FFIE1) && (rf1r & CAN_RF1R_FULL1)) || ((ier & CAN_IER_FOVIE1) && (rf1r & CAN_RF1R_FOVR1)) ||
+     ((ier & CAN_IER_ERRIE) && (msr & CAN_MSR_ERRI)) || ((ier & CAN_IER_WKUIE) && (msr & CAN_MSR_WKUI)) ||
+     ((ier & CAN_IER_SLKIE) && (msr & CAN_MSR_SLAKI)))
+  {
+    HAL_CAN_IRQHandler(handle);
+  }
 }
@@ -0,0 +1,318 @@
+/**
+ * @file 	can_health.c
+ * @brief	Bus health telemetry, bus load estimation and bus-off recovery
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Los contadores se alimentan desde los callbacks de CAN (ver can.c), la
+ * recuperación de bus-off y el envio del marco de diagnostico se hacen desde
+ * el ciclo principal con can_health_poll(), nunca desde un interrupt.
+ *
+ * AutoBusOff se deja deshabilitado a proposito, la recuperación la controla
+ * este modulo con un retardo que se duplica con cada bus-off consecutivo.
+ */
+
+#include "can_health.h"
+#include "main.h"
+#include "boot.h"
+#include "can_tx.h"
+#include "watchdog.h"
+
+static can_health_stats stats;
+
+/* Bits transmitidos en el bus durante la ventana actual */
+static volatile uint32_t window_bits = 0;
+static uint32_t window_start = 0;
+
+static volatile uint8_t busoff_pending = 0;
+static uint32_t busoff_tick = 0;
+static uint32_t last_busoff_tick = 0;
+static uint32_t backoff_ms = CAN_HEALTH_BACKOFF_MIN_MS;
+
+/* Marcas de la ventana anterior, para reportar incrementos en el diagnostico */
+static uint32_t last_arbitration_lost = 0;
+static uint32_t last_protocol_errors = 0;
+static uint32_t last_tx_lost = 0;
+static uint8_t boot_reported = 0;
+
+/**
+ * @brief	Nominal length of a standard frame in bits, stuff bits excluded,
+ * 		interframe space included. The bus load is thus a lower bound.
+ * @param	uint32_t: Data bytes on the wire
+ *
+ * @retval	uint32_t: Bits
+ */
+static inline uint32_t frame_bits(uint32_t bytes)
+{
+  return 47U + 8U * bytes;
+}
+
+static inline uint8_t saturate_u8(uint32_t value)
+{
+  return (value > 0xFFU) ? 0xFFU : (uint8_t)value;
+}
+
+/**
+ * @brief	Computes the nominal bit rate from the bit timing register
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	uint32_t: Bits per second
+ */
+static uint32_t bit_rate(can_handle* handle)
+{
+  const uint32_t btr = handle->Instance->BTR;
+  const uint32_t brp = ((btr & CAN_BTR_BRP) >> CAN_BTR_BRP_Pos) + 1U;
+  const uint32_t ts1 = ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) + 1U;
+  const uint32_t ts2 = ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos) + 1U;
+
+  return HAL_RCC_GetPCLK1Freq() / (brp * (1U + ts1 + ts2));
+}
+
+/**
+ * @brief	Reads TEC, REC and the error state flags. The flags are levels, so
+ * 		only their transitions are counted.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+static void update_error_state(can_handle* handle)
+{
+  const uint32_t esr = handle->Instance->ESR;
+  stats.tec = (uint8_t)((esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos);
+  stats.rec = (uint8_t)((esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos);
+
+  uint8_t state = CAN_BUS_ACTIVE;
+  if(esr & CAN_ESR_EWGF) state |= CAN_BUS_WARNING;
+  if(esr & CAN_ESR_EPVF) state |= CAN_BUS_PASSIVE;
+  if(esr & CAN_ESR_BOFF) state |= CAN_BUS_OFF;
+
+  const uint8_t rising = state & ~stats.state;
+  if(rising & CAN_BUS_WARNING) stats.error_warning++;
+  if(rising & CAN_BUS_PASSIVE) stats.error_passive++;
+  if(rising & CAN_BUS_OFF)
+  {
+    stats.bus_off++;
+    busoff_pending = 1;
+    busoff_tick = HAL_GetTick();
+  }
+  stats.state = state;
+}
+
+#ifdef CAN_HEALTH_SNIFF_BUS
+/* Marcos para otros nodos, can_health_count_rx() ya los sumo a la carga */
+static void count_other(can_handle* handle, const can_rx_view* frame)
+{
+  stats.other_frames++;
+}
+#endif
+
+/**
+ * @brief	Enables the error interrupts. With CAN_HEALTH_SNIFF_BUS defined, it
+ * 		also routes every frame not accepted by the other filters to FIFO1, so
+ * 		that the bus load includes traffic between other nodes.
+ * 		Must be called before can_start(), after the other ranges are registered.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void can_health_init(can_handle* handle)
+{
+  uint32_t notifications = CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF |
+                           CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR | CAN_IT_RX_FIFO0_OVERRUN;
+
+#ifdef CAN_HEALTH_SNIFF_BUS
+  /* Mascara en cero, acepta todo. Los filtros en modo lista tienen prioridad
+   * sobre los de mascara de la misma escala, por lo que los marcos registrados
+   * siguen llegando a FIFO0, y los rangos registrados antes tienen prioridad. */
+  if(can_register_mask_handler(handle, 0, 0, count_other) < 0)
+  {
+    Error_Handler();
+  }
+#endif
+
+  if(HAL_CAN_ActivateNotification(handle, notifications) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  window_start = HAL_GetTick();
+  watchdog_register(WATCHDOG_CAN_TX, CAN_HEALTH_MAILBOX_STUCK_MS);
+}
+
+/**
+ * @brief	Accounts a frame received in either FIFO, called from the RX interrupt
+ * @param	can_rx_view*: View of the received frame
+ *
+ * @retval	None
+ */
+void can_health_count_rx(const can_rx_view* frame)
+{
+  stats.rx_frames++;
+  window_bits += frame_bits(can_view_is_rtr(frame) ? 0U : can_view_dlc(frame));
+}
+
+/**
+ * @brief	Accounts a frame successfully sent, called from the TX interrupt
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Mailbox number, 0 to 2
+ *
+ * @retval	None
+ */
+void can_health_count_tx(can_handle* handle, uint32_t mailbox)
+{
+  const CAN_TxMailBox_TypeDef* tx = &handle->Instance->sTxMailBox[mailbox];
+  const uint32_t bytes = (tx->TIR & CAN_TI0R_RTR) ? 0U : (tx->TDTR & CAN_TDT0R_DLC);
+
+  stats.tx_frames++;
+  window_bits += frame_bits(bytes);
+}
+
+void can_health_count_abort(void)
+{
+  stats.tx_aborted++;
+}
+
+void can_health_count_drop(void)
+{
+  stats.tx_dropped++;
+}
+
+/**
+ * @brief	Updates the error counters from the HAL error code, called from the
+ * 		error interrupt
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: HAL_CAN_ERROR_* flags
+ *
+ * @retval	None
+ */
+void can_health_on_error(can_handle* handle, uint32_t error_code)
+{
+  update_error_state(handle);
+
+  if(error_code & (HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | HAL_CAN_ERROR_ACK |
+                   HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD | HAL_CAN_ERROR_CRC))
+  {
+    stats.protocol_errors++;
+  }
+  if(error_code & HAL_CAN_ERROR_TX_ALST0) stats.arbitration_lost++;
+  if(error_code & HAL_CAN_ERROR_TX_ALST1) stats.arbitration_lost++;
+  if(error_code & HAL_CAN_ERROR_TX_ALST2) stats.arbitration_lost++;
+  if(error_code & HAL_CAN_ERROR_TX_TERR0) stats.tx_errors++;
+  if(error_code & HAL_CAN_ERROR_TX_TERR1) stats.tx_errors++;
+  if(error_code & HAL_CAN_ERROR_TX_TERR2) stats.tx_errors++;
+  if(error_code & (HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1)) stats.rx_overruns++;
+}
+
+/**
+ * @brief	Recovers from bus-off after the backoff delay, and publishes the
+ * 		diagnostic frame once per CAN_HEALTH_PERIOD_MS. Call from the main loop.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void can_health_poll(can_handle* handle)
+{
+  const uint32_t now = HAL_GetTick();
+
+  /* Un mailbox que no termina no se arregla solo, el bus-off si se recupera */
+  if(busoff_pending || (stats.state & CAN_BUS_OFF) || can_tx_mailbox_age_ms() < CAN_HEALTH_MAILBOX_STUCK_MS)
+  {
+    watchdog_checkin(WATCHDOG_CAN_TX);
+  }
+
+  if(busoff_pending)
+  {
+    if(now - busoff_tick < backoff_ms)
+    {
+      return;
+    }
+
+    /* Si el bus-off anterior fue hace poco se duplica el retardo */
+    if(last_busoff_tick != 0 && now - last_busoff_tick < CAN_HEALTH_STABLE_MS)
+    {
+      backoff_ms = (backoff_ms * 2 > CAN_HEALTH_BACKOFF_MAX_MS) ? CAN_HEALTH_BACKOFF_MAX_MS : backoff_ms * 2;
+    }
+    else
+    {
+      backoff_ms = CAN_HEALTH_BACKOFF_MIN_MS;
+    }
+    last_busoff_tick = now;
+    busoff_pending = 0;
+
+    /* Entrar y salir del modo de inicialización inicia la secuencia de
+     * recuperación, 128 ocurrencias de 11 bits recesivos */
+    HAL_CAN_Stop(handle);
+    HAL_CAN_Start(handle);
+    return;
+  }
+
+  /* El primer marco es el reporte de arranque, en cuanto hay una lectura
+   * valida o al terminar la primera ventana sin ella */
+  if(!boot_reported && (boot_reached(BOOT_FIRST_READING) || now - window_start >= CAN_HEALTH_PERIOD_MS))
+  {
+    uint8_t report[CAN_MAX_BYTES];
+    boot_pack_report(report);
+    can_write_id_to_mailbox(handle, DIAGNOSTIC_CAN_STD_ID, report, CAN_MAX_BYTES);
+    boot_reported = 1;
+    return;
+  }
+
+  if(now - window_start < CAN_HEALTH_PERIOD_MS)
+  {
+    return;
+  }
+
+  __disable_irq();
+  const uint32_t bits = window_bits;
+  window_bits = 0;
+  __enable_irq();
+
+  const uint32_t elapsed = now - window_start;
+  window_start = now;
+
+  /* bits * 100 / (bit_rate * ms / 1000), reordenado para no desbordar */
+  const uint32_t capacity = (bit_rate(handle) / 1000U) * elapsed;
+  stats.bus_load = saturate_u8((capacity > 0) ? (uint32_t)(((uint64_t)bits * 100U) / capacity) : 0U);
+
+  /* Los flags se limpian sin interrupt al recuperarse el bus */
+  __disable_irq();
+  update_error_state(handle);
+  __enable_irq();
+
+  const uint32_t tx_lost = stats.tx_errors + stats.tx_aborted + stats.tx_dropped;
+
+  /* Formato del marco de diagnostico:
+   * [0] TEC [1] REC [2] can_bus_state [3] carga del bus %
+   * [4] bus-off acumulados [5] arbitrajes perdidos en la ventana
+   * [6] marcos TX perdidos en la ventana [7] errores de protocolo en la ventana
+   */
+  uint8_t data[CAN_MAX_BYTES];
+  data[0] = stats.tec;
+  data[1] = stats.rec;
+  data[2] = stats.state;
+  data[3] = stats.bus_load;
+  data[4] = saturate_u8(stats.bus_off);
+  data[5] = saturate_u8(stats.arbitration_lost - last_arbitration_lost);
+  data[6] = saturate_u8(tx_lost - last_tx_lost);
+  data[7] = saturate_u8(stats.protocol_errors - last_protocol_errors);
+
+  last_arbitration_lost = stats.arbitration_lost;
+  last_tx_lost = tx_lost;
+  last_protocol_errors = stats.protocol_errors;
+
+  can_write_id_to_mailbox(handle, DIAGNOSTIC_CAN_STD_ID, data, CAN_MAX_BYTES);
+}
+
+/**
+ * @brief	Returns the bus health counters
+ *
+ * @retval	can_health_stats*: Pointer to the counters
+ */
+const can_health_stats* can_health_get_stats(void)
+{
+  return &stats;
+}
+
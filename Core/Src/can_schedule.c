@@ -0,0 +1,217 @@
+/**
+ * @file 	can_schedule.c
+ * @brief	Time slots for the answers to control panel polls, and bus time SYNC
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Todos los nodos reciben el mismo RTR del panel y, sin ranuras, contestarian
+ * al mismo tiempo. Con AutoRetransmission deshabilitado un arbitraje perdido
+ * es un marco perdido. El panel asigna a cada nodo un indice y un ancho de
+ * ranura, el nodo contesta index * width microsegundos despues del RTR, que
+ * funciona como mensaje de referencia del ciclo.
+ *
+ * El retardo lo cuenta TIM6 en modo de un solo pulso a 1 MHz. Las marcas de
+ * tiempo de hardware (TTCM) de la petición y de la respuesta permiten al panel
+ * verificar la ranura real, ver can_poll_latency.
+ */
+
+#include "can_schedule.h"
+#include "timebase.h"
+#include "node_id.h"
+#include "isr_profile.h"
+
+static TIM_HandleTypeDef* slot_timer = NULL;
+static can_handle* slot_can = NULL;
+static uint32_t slot_offset_us = 0;
+static uint32_t slot_due_cycles; /* timebase_cycles() en que debe vencer la cuenta */
+
+/* Petición pendiente de contestar al terminar la cuenta */
+static uint32_t deferred_start_us;
+static uint16_t deferred_poll_time;
+
+static void slot_elapsed_callback(TIM_HandleTypeDef* htim)
+{
+  (void)htim;
+  if(slot_can != NULL)
+  {
+    can_queue_cached_response(slot_can, deferred_start_us, deferred_poll_time);
+  }
+}
+
+/**
+ * @brief	Configures the timer used to wait for the slot. It must run at 1 MHz.
+ * @param	TIM_HandleTypeDef*: Pointer to an initialized basic timer handle
+ *
+ * @retval	None
+ */
+void can_schedule_init(TIM_HandleTypeDef* htim)
+{
+  slot_timer = htim;
+  SET_BIT(htim->Instance->CR1, TIM_CR1_OPM);
+  __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE); /* Lo deja HAL_TIM_Base_Init */
+  __HAL_TIM_ENABLE_IT(htim, TIM_IT_UPDATE);
+  HAL_TIM_RegisterCallback(htim, HAL_TIM_PERIOD_ELAPSED_CB_ID, slot_elapsed_callback);
+
+  can_register_command(CAN_CMD_SET_SLOT, can_schedule_command);
+  can_register_command(CAN_CMD_SYNC, can_schedule_sync);
+}
+
+/**
+ * @brief	Sets the slot of this node. Index 0 answers immediately.
+ * @param	uint8_t: Slot index
+ * @param	uint16_t: Slot width in microseconds
+ *
+ * @retval	None
+ */
+void can_schedule_set_slot(uint8_t index, uint16_t width_us)
+{
+  can_schedule_set_offset((uint32_t)index * width_us);
+}
+
+/**
+ * @brief	Sets the delay of the answers directly, to resume the slot kept
+ * 		across a warm restart
+ * @param	uint32_t: Delay in microseconds, 0 answers immediately
+ *
+ * @retval	None
+ */
+void can_schedule_set_offset(uint32_t offset_us)
+{
+  if(offset_us > CAN_SCHEDULE_MAX_OFFSET_US)
+  {
+    offset_us = CAN_SCHEDULE_MAX_OFFSET_US;
+  }
+  slot_offset_us = offset_us;
+}
+
+/**
+ * @brief	Gets the delay of the answers of this node
+ * @param	None
+ *
+ * @retval	uint32_t: Delay in microseconds
+ */
+uint32_t can_schedule_offset(void)
+{
+  return slot_offset_us;
+}
+
+/**
+ * @brief	Defers the answer to a poll until the slot of this node, called from
+ * 		the RX interrupt. A new poll restarts the count.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: timebase_now_us() when the poll was received
+ * @param	uint16_t: Hardware timestamp of the poll
+ *
+ * @retval	1 if the answer was deferred, 0 if it should be sent right away
+ */
+int can_schedule_defer(can_handle* handle, uint32_t start_us, uint16_t poll_time)
+{
+  if(slot_timer == NULL || slot_offset_us == 0)
+  {
+    return 0;
+  }
+
+  slot_can = handle;
+  deferred_start_us = start_us;
+  deferred_poll_time = poll_time;
+
+  __HAL_TIM_DISABLE(slot_timer);
+  __HAL_TIM_SET_COUNTER(slot_timer, 0);
+  __HAL_TIM_SET_AUTORELOAD(slot_timer, slot_offset_us);
+  slot_due_cycles = timebase_cycles() + slot_offset_us * (SystemCoreClock / 1000000U);
+  __HAL_TIM_ENABLE(slot_timer);
+
+  return 1;
+}
+
+/**
+ * @brief	Latency of the slot interrupt. In one pulse mode TIM6 stops at 0, the
+ * 		due time is the one noted when the count started.
+ * @param	uint32_t: isr_profile_enter() at the start of the handler
+ *
+ * @retval	uint32_t: Cycles since the count ended, or ISR_PROFILE_NO_LATENCY
+ */
+uint32_t can_schedule_slot_latency(uint32_t entry_cycles)
+{
+  if(slot_timer == NULL || (slot_timer->Instance->SR & TIM_SR_UIF) == 0U)
+  {
+    return ISR_PROFILE_NO_LATENCY;
+  }
+
+  const int32_t late = (int32_t)(entry_cycles - slot_due_cycles);
+  return (late > 0) ? (uint32_t)late : 0U;
+}
+
+/**
+ * @brief	Direct TIM6 interrupt, replaces HAL_TIM_IRQHandler() with
+ * 		DIRECT_ISR_TIM6. The update is the only interrupt enabled.
+ * @param	TIM_HandleTypeDef*: Pointer to the TIM6 handle
+ *
+ * @retval	None
+ */
+void can_schedule_irq(TIM_HandleTypeDef* htim)
+{
+  if((htim->Instance->SR & TIM_SR_UIF) == 0U)
+  {
+    return;
+  }
+
+  __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+  slot_elapsed_callback(htim);
+}
+
+/**
+ * @brief	Handler of CAN_CMD_SET_SLOT. Payload:
+ * 		[1..2] target node number, little endian [3] slot index
+ * 		[4..5] slot width in microseconds, little endian
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void can_schedule_command(can_handle* handle, const can_rx_view* frame)
+{
+  (void)handle;
+  if(can_view_dlc(frame) < 6)
+  {
+    return;
+  }
+
+  const uint16_t target = can_view_byte(frame, 1) | (can_view_byte(frame, 2) << 8);
+  if(target != node_id_get())
+  {
+    return;
+  }
+
+  can_schedule_set_slot(can_view_byte(frame, 3),
+                        can_view_byte(frame, 4) | (can_view_byte(frame, 5) << 8));
+}
+
+/**
+ * @brief	Handler of CAN_CMD_SYNC, sent by the time master. Payload:
+ * 		[1..4] master time in microseconds at the SOF of this frame, little endian
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void can_schedule_sync(can_handle* handle, const can_rx_view* frame)
+{
+  (void)handle;
+  const uint32_t now_us = timebase_now_us();
+
+  if(can_view_dlc(frame) < 5)
+  {
+    return;
+  }
+
+  /* El instante del SOF, sin la latencia del interrupt */
+  const uint32_t local_us = timebase_sof_local_us(can_view_timestamp(frame), now_us);
+
+  /* Bytes 1 a 4, alineados en el registro bajo y alto del mailbox */
+  const uint32_t master_us = (can_view_low_word(frame) >> 8) | (can_view_high_word(frame) << 24);
+  timebase_sync(master_us, local_us);
+}
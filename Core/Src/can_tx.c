@@ -0,0 +1,594 @@
+/**
+ * @file 	can_tx.c
+ * @brief	Priority classed transmit queues with deadline based dropping
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Cada clase tiene su rango de identificadores, asi la prioridad en el bus la
+ * resuelve el arbitraje y, con TransmitFifoPriority deshabilitado, tambien el
+ * orden entre los mailboxes locales (gana el identificador menor).
+ *
+ * - Alarmas: cola FIFO, nunca expiran. Si no hay mailbox libre se aborta un
+ *   marco bulk o de telemetria, ademas esas clases nunca ocupan los tres
+ *   mailboxes. La latencia de una alarma queda acotada por un marco en curso.
+ * - Respuestas: cola FIFO, expiran a los CAN_TX_RESPONSE_DEADLINE_MS. Las
+ *   respuestas a los RTR del panel y de los PDO tambien pasan por aqui.
+ * - Telemetria: un lugar por identificador, una lectura nueva reemplaza a la
+ *   que seguia en cola, y las que no salen antes de su plazo se descartan.
+ * - Bulk: sin cola, los marcos se piden a una fuente cuando las demas clases
+ *   estan vacias y hay mailbox libre, desde el interrupt de TX, asi una
+ *   transferencia larga sale a la velocidad del bus. Comparte con la telemetria
+ *   el limite de mailboxes; un marco que falla o se aborta se devuelve a la
+ *   fuente para reintentarlo.
+ *
+ * La retransmisión automatica esta deshabilitada (ver MX_CAN_Init()), un marco
+ * que pierde el arbitraje o tiene un error no se repite solo. Las alarmas y las
+ * respuestas que fallan vuelven a la cabeza de su cola y se reintentan hasta su
+ * plazo; la telemetria fallida se descarta, la siguiente lectura la reemplaza.
+ *
+ * Las colas se tocan desde el ciclo principal y desde los interrupts de CAN,
+ * todo acceso se hace con los interrupts deshabilitados.
+ */
+
+#include "can_tx.h"
+
+/**
+ * @struct Queued frame
+ */
+typedef struct tx_entry {
+  can_tx_image image;
+  uint32_t queued_tick;
+  uint32_t deadline_ms;
+  uint32_t tag; /* Del que encolo, ver can_tx_mailbox_tag() */
+} tx_entry;
+
+/**
+ * @struct FIFO of queued frames
+ */
+typedef struct tx_fifo {
+  tx_entry* entries;
+  uint8_t depth;
+  uint8_t head;
+  uint8_t count;
+} tx_fifo;
+
+static tx_entry alarm_entries[CAN_TX_ALARM_DEPTH];
+static tx_entry response_entries[CAN_TX_RESPONSE_DEPTH];
+static tx_fifo alarm_fifo = { alarm_entries, CAN_TX_ALARM_DEPTH, 0, 0 };
+static tx_fifo response_fifo = { response_entries, CAN_TX_RESPONSE_DEPTH, 0, 0 };
+
+static tx_entry telemetry_slots[CAN_TX_TELEMETRY_DEPTH];
+static uint8_t telemetry_used = 0;
+
+/* Clase y momento de encolado del marco en cada mailbox, -1 si esta libre */
+static int8_t mailbox_class[3] = { -1, -1, -1 };
+static uint32_t mailbox_tick[3];
+static uint32_t mailbox_cookie[3];
+static can_tx_bulk_failed mailbox_failed[3]; /* Fuente bulk que escribió el marco */
+static tx_entry mailbox_entry[3]; /* Copia de alarmas y respuestas, para reintentarlas */
+static uint8_t abort_requested = 0;
+
+static can_tx_bulk_next bulk_next = NULL;
+static can_tx_bulk_failed bulk_failed = NULL;
+
+static can_tx_stats stats;
+
+static inline uint32_t enter_critical(void)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  return primask;
+}
+
+static inline void exit_critical(uint32_t primask)
+{
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief	Builds the TX mailbox register image of a standard data frame
+ * @param	uint32_t: Standard identifier
+ * @param	uint8_t*: Pointer to the data buffer
+ * @param	int: Number of bytes, can't be larger than CAN_MAX_BYTES
+ * @param	can_tx_image*: Image to fill
+ *
+ * @retval	None
+ */
+void can_tx_build_image(uint32_t std_id, const uint8_t* data, int bytes, can_tx_image* image)
+{
+  uint8_t padded[CAN_MAX_BYTES] = {0};
+  for(int i = 0; i < bytes; i++)
+  {
+    padded[i] = data[i];
+  }
+
+  image->tir = std_id << CAN_TI0R_STID_Pos; /* Estandar, de datos */
+  image->tdtr = (uint32_t)bytes;
+  image->tdlr = padded[0] | (padded[1] << 8) | (padded[2] << 16) | ((uint32_t)padded[3] << 24);
+  image->tdhr = padded[4] | (padded[5] << 8) | (padded[6] << 16) | ((uint32_t)padded[7] << 24);
+}
+
+static int fifo_push(tx_fifo* fifo, const tx_entry* entry)
+{
+  if(fifo->count >= fifo->depth)
+  {
+    return -1;
+  }
+
+  fifo->entries[(fifo->head + fifo->count) % fifo->depth] = *entry;
+  fifo->count++;
+  return 0;
+}
+
+/* Devuelve un marco que fallo a la cabeza, sale antes que los que esperaban */
+static int fifo_push_front(tx_fifo* fifo, const tx_entry* entry)
+{
+  if(fifo->count >= fifo->depth)
+  {
+    return -1;
+  }
+
+  fifo->head = (fifo->head + fifo->depth - 1) % fifo->depth;
+  fifo->entries[fifo->head] = *entry;
+  fifo->count++;
+  return 0;
+}
+
+static const tx_entry* fifo_peek(const tx_fifo* fifo)
+{
+  return (fifo->count > 0) ? &fifo->entries[fifo->head] : NULL;
+}
+
+static void fifo_pop(tx_fifo* fifo)
+{
+  fifo->head = (fifo->head + 1) % fifo->depth;
+  fifo->count--;
+}
+
+static int telemetry_push(const tx_entry* entry)
+{
+  int free_slot = -1;
+
+  for(int i = 0; i < CAN_TX_TELEMETRY_DEPTH; i++)
+  {
+    if(telemetry_used & (1U << i))
+    {
+      /* Mismo identificador, la lectura vieja ya no sirve */
+      if(telemetry_slots[i].image.tir == entry->image.tir)
+      {
+        telemetry_slots[i] = *entry;
+        stats.superseded++;
+        return 0;
+      }
+    }
+    else if(free_slot < 0)
+    {
+      free_slot = i;
+    }
+  }
+
+  if(free_slot < 0)
+  {
+    return -1;
+  }
+
+  telemetry_slots[free_slot] = *entry;
+  telemetry_used |= (1U << free_slot);
+  return 0;
+}
+
+/* Lugar de telemetria encolado hace mas tiempo, -1 si no hay */
+static int telemetry_oldest(void)
+{
+  int oldest = -1;
+
+  for(int i = 0; i < CAN_TX_TELEMETRY_DEPTH; i++)
+  {
+    if((telemetry_used & (1U << i)) &&
+       (oldest < 0 || (int32_t)(telemetry_slots[i].queued_tick - telemetry_slots[oldest].queued_tick) < 0))
+    {
+      oldest = i;
+    }
+  }
+
+  return oldest;
+}
+
+static inline int expired(const tx_entry* entry, uint32_t now)
+{
+  return entry->deadline_ms != CAN_TX_NO_DEADLINE && now - entry->queued_tick > entry->deadline_ms;
+}
+
+static int mailboxes_of_class(can_tx_class tx_class)
+{
+  int count = 0;
+  for(int i = 0; i < 3; i++)
+  {
+    if(mailbox_class[i] == (int8_t)tx_class)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief	Queues a frame in the queue of its class and tries to send it
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_tx_class: Transmit class
+ * @param	uint32_t: Standard identifier, should be within the range of the class
+ * @param	uint8_t*: Pointer to the data buffer
+ * @param	int: Number of bytes, can't be larger than CAN_MAX_BYTES
+ * @param	uint32_t: Milliseconds after which the frame is dropped, or CAN_TX_NO_DEADLINE
+ *
+ * @retval	0 if queued, -1 if the queue of the class is full or the frame is too long
+ */
+int can_tx_send(can_handle* handle, can_tx_class tx_class, uint32_t std_id,
+                const uint8_t* data, int bytes, uint32_t deadline_ms)
+{
+  if(bytes > CAN_MAX_BYTES)
+  {
+    return -1;
+  }
+
+  can_tx_image image;
+  can_tx_build_image(std_id, data, bytes, &image);
+  return can_tx_send_image(handle, tx_class, &image, deadline_ms, CAN_TX_NO_TAG);
+}
+
+/**
+ * @brief	Queues a prebuilt frame, such as a cached RTR answer, in the queue of
+ * 		its class and tries to send it. Safe from the CAN and slot timer
+ * 		interrupts.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_tx_class: Transmit class, CAN_TX_BULK frames come from the bulk source
+ * @param	can_tx_image*: Frame to send
+ * @param	uint32_t: Milliseconds after which the frame is dropped, or CAN_TX_NO_DEADLINE
+ * @param	uint32_t: Returned by can_tx_mailbox_tag() while the frame is in a
+ * 		mailbox, or CAN_TX_NO_TAG
+ *
+ * @retval	0 if queued, -1 if the queue of the class is full
+ */
+int can_tx_send_image(can_handle* handle, can_tx_class tx_class, const can_tx_image* image,
+                      uint32_t deadline_ms, uint32_t tag)
+{
+  if(tx_class >= CAN_TX_BULK)
+  {
+    return -1;
+  }
+
+  tx_entry entry;
+  entry.image = *image;
+  entry.queued_tick = HAL_GetTick();
+  entry.deadline_ms = deadline_ms;
+  entry.tag = tag;
+
+  const uint32_t primask = enter_critical();
+  int result;
+  switch(tx_class)
+  {
+  case CAN_TX_ALARM:
+    result = fifo_push(&alarm_fifo, &entry);
+    break;
+  case CAN_TX_RESPONSE:
+    result = fifo_push(&response_fifo, &entry);
+    break;
+  default:
+    result = telemetry_push(&entry);
+    break;
+  }
+
+  if(result == 0)
+  {
+    stats.queued[tx_class]++;
+  }
+  else
+  {
+    stats.overflow[tx_class]++;
+  }
+  exit_critical(primask);
+
+  can_tx_pump(handle);
+  return result;
+}
+
+/**
+ * @brief	Writes an image into the next free TX mailbox. Safe from any context,
+ * 		can_tx_pump() from the main loop and from the interrupts selects
+ * 		mailboxes here.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_tx_image*: Frame to send
+ * @param	can_tx_class: Class the frame is accounted to
+ *
+ * @retval	Mailbox number, -1 if all mailboxes are busy
+ */
+int can_tx_write_mailbox(can_handle* handle, const can_tx_image* image, can_tx_class tx_class)
+{
+  CAN_TypeDef* can_ip = handle->Instance;
+
+  /* Desde que se lee CODE hasta que TXRQ ocupa el mailbox nadie mas puede
+   * elegirlo, aunque luego cambien las prioridades de los interrupts */
+  const uint32_t primask = enter_critical();
+  const uint32_t tsr = can_ip->TSR;
+
+  if((tsr & CAN_TSR_TME) == 0U)
+  {
+    exit_critical(primask);
+    return -1;
+  }
+
+  /* CODE indica el siguiente mailbox libre */
+  const uint32_t mailbox = (tsr & CAN_TSR_CODE) >> CAN_TSR_CODE_Pos;
+
+  mailbox_class[mailbox] = (int8_t)tx_class;
+  mailbox_tick[mailbox] = HAL_GetTick();
+
+  can_ip->sTxMailBox[mailbox].TDTR = image->tdtr;
+  can_ip->sTxMailBox[mailbox].TDLR = image->tdlr;
+  can_ip->sTxMailBox[mailbox].TDHR = image->tdhr;
+  can_ip->sTxMailBox[mailbox].TIR = image->tir | CAN_TI0R_TXRQ;
+  exit_critical(primask);
+
+  return (int)mailbox;
+}
+
+/**
+ * @brief	Aborts a bulk or telemetry transmission so that a pending alarm gets
+ * 		a mailbox. Bulk goes first, its source sends the frame again.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+static void preempt_mailbox(can_handle* handle)
+{
+  if(abort_requested)
+  {
+    return;
+  }
+
+  for(int8_t tx_class = CAN_TX_BULK; tx_class >= CAN_TX_TELEMETRY; tx_class--)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      if(mailbox_class[i] == tx_class)
+      {
+        /* ABRQ0, ABRQ1 y ABRQ2 estan separados por 8 bits. Se escribe directo:
+         * RQCP, TXOK, ALST y TERR se borran escribiendo 1 y un SET_BIT perderia
+         * el fin de transmisión pendiente de los otros mailboxes */
+        handle->Instance->TSR = CAN_TSR_ABRQ0 << (8 * i);
+        abort_requested |= (1U << i);
+        stats.preempted++;
+        return;
+      }
+    }
+  }
+}
+
+/* Llena los mailboxes libres con marcos de la fuente bulk, dentro del limite
+ * compartido con la telemetria. Se llama con los interrupts deshabilitados. */
+static void pump_bulk(can_handle* handle)
+{
+  if(bulk_next == NULL)
+  {
+    return;
+  }
+
+  while(mailboxes_of_class(CAN_TX_TELEMETRY) + mailboxes_of_class(CAN_TX_BULK) < CAN_TX_TELEMETRY_MAILBOXES &&
+        (handle->Instance->TSR & CAN_TSR_TME) != 0U)
+  {
+    can_tx_image image;
+    uint32_t cookie;
+    if(!bulk_next(&image, &cookie))
+    {
+      return;
+    }
+
+    const int mailbox = can_tx_write_mailbox(handle, &image, CAN_TX_BULK);
+    mailbox_cookie[mailbox] = cookie;
+    mailbox_failed[mailbox] = bulk_failed;
+    stats.queued[CAN_TX_BULK]++;
+  }
+}
+
+/**
+ * @brief	Moves queued frames into the free mailboxes, highest class first.
+ * 		Expired frames are dropped here instead of being sent late.
+ * 		Called after queueing and from the TX interrupts.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void can_tx_pump(can_handle* handle)
+{
+  const uint32_t primask = enter_critical();
+  const uint32_t now = HAL_GetTick();
+
+  while(1)
+  {
+    tx_fifo* fifo = NULL;
+    const tx_entry* entry = NULL;
+    int slot = -1;
+    can_tx_class tx_class;
+
+    if((entry = fifo_peek(&alarm_fifo)) != NULL)
+    {
+      fifo = &alarm_fifo;
+      tx_class = CAN_TX_ALARM;
+    }
+    else if((entry = fifo_peek(&response_fifo)) != NULL)
+    {
+      fifo = &response_fifo;
+      tx_class = CAN_TX_RESPONSE;
+    }
+    else if((slot = telemetry_oldest()) >= 0)
+    {
+      entry = &telemetry_slots[slot];
+      tx_class = CAN_TX_TELEMETRY;
+    }
+    else
+    {
+      pump_bulk(handle);
+      break;
+    }
+
+    if(expired(entry, now))
+    {
+      stats.expired[tx_class]++;
+    }
+    else if(tx_class == CAN_TX_TELEMETRY && mailboxes_of_class(CAN_TX_TELEMETRY) >= CAN_TX_TELEMETRY_MAILBOXES)
+    {
+      break;
+    }
+    else
+    {
+      const int mailbox = can_tx_write_mailbox(handle, &entry->image, tx_class);
+      if(mailbox < 0)
+      {
+        if(tx_class == CAN_TX_ALARM)
+        {
+          preempt_mailbox(handle);
+        }
+        break;
+      }
+
+      /* La latencia se cuenta desde que el marco se encolo */
+      mailbox_tick[mailbox] = entry->queued_tick;
+      mailbox_entry[mailbox] = *entry;
+    }
+
+    if(fifo != NULL)
+    {
+      fifo_pop(fifo);
+    }
+    else
+    {
+      telemetry_used &= ~(1U << slot);
+    }
+  }
+
+  exit_critical(primask);
+}
+
+/**
+ * @brief	Releases the bookkeeping of a mailbox, called from the TX complete,
+ * 		abort and error callbacks, then refills the mailboxes
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Mailbox number, 0 to 2
+ * @param	int: 1 if the frame was sent, 0 if it was aborted or failed
+ *
+ * @retval	None
+ */
+void can_tx_mailbox_done(can_handle* handle, uint32_t mailbox, int sent)
+{
+  const int8_t tx_class = mailbox_class[mailbox];
+
+  if(tx_class >= 0 && sent)
+  {
+    stats.sent[tx_class]++;
+
+    if(tx_class == CAN_TX_ALARM)
+    {
+      const uint32_t latency = HAL_GetTick() - mailbox_tick[mailbox];
+      if(latency > stats.alarm_max_latency_ms)
+      {
+        stats.alarm_max_latency_ms = latency;
+      }
+    }
+  }
+
+  /* El cookie es de la fuente que escribió el marco, aunque ya no sea la actual */
+  if(tx_class == CAN_TX_BULK && !sent && mailbox_failed[mailbox] != NULL)
+  {
+    mailbox_failed[mailbox](mailbox_cookie[mailbox]);
+  }
+
+  /* Sin retransmisión automatica, las alarmas y respuestas se reintentan aqui */
+  if((tx_class == CAN_TX_ALARM || tx_class == CAN_TX_RESPONSE) && !sent)
+  {
+    const tx_entry* entry = &mailbox_entry[mailbox];
+    if(expired(entry, HAL_GetTick()))
+    {
+      stats.expired[tx_class]++;
+    }
+    else if(fifo_push_front((tx_class == CAN_TX_ALARM) ? &alarm_fifo : &response_fifo, entry) == 0)
+    {
+      stats.retried[tx_class]++;
+    }
+    else
+    {
+      stats.overflow[tx_class]++;
+    }
+  }
+
+  mailbox_class[mailbox] = -1;
+  abort_requested &= ~(1U << mailbox);
+
+  can_tx_pump(handle);
+}
+
+/**
+ * @brief	Gets the tag given to can_tx_send_image() of the response in a
+ * 		mailbox. Call from the TX callbacks, before can_tx_mailbox_done().
+ * @param	uint32_t: Mailbox number, 0 to 2
+ *
+ * @retval	uint32_t: Tag, CAN_TX_NO_TAG if the mailbox doesn't hold a response
+ */
+uint32_t can_tx_mailbox_tag(uint32_t mailbox)
+{
+  return (mailbox_class[mailbox] == CAN_TX_RESPONSE) ? mailbox_entry[mailbox].tag : CAN_TX_NO_TAG;
+}
+
+/**
+ * @brief	Sets the source of CAN_TX_BULK frames, NULL stops the transfer. The
+ * 		functions are called from the TX interrupts; after new frames become
+ * 		available, call can_tx_pump() to restart an idle transfer.
+ * @param	can_tx_bulk_next: Function that gives the next frame
+ * @param	can_tx_bulk_failed: Function called with a frame that was not sent
+ *
+ * @retval	None
+ */
+void can_tx_set_bulk_source(can_tx_bulk_next next, can_tx_bulk_failed failed)
+{
+  const uint32_t primask = enter_critical();
+  bulk_next = next;
+  bulk_failed = failed;
+  exit_critical(primask);
+}
+
+/**
+ * @brief	Gets the time the oldest occupied mailbox has been waiting, counted
+ * 		from when its frame was queued
+ * @param	None
+ *
+ * @retval	uint32_t: Milliseconds, 0 if every mailbox is free
+ */
+uint32_t can_tx_mailbox_age_ms(void)
+{
+  const uint32_t now = HAL_GetTick();
+  uint32_t age = 0;
+
+  const uint32_t primask = enter_critical();
+  for(int i = 0; i < 3; i++)
+  {
+    if(mailbox_class[i] >= 0 && now - mailbox_tick[i] > age)
+    {
+      age = now - mailbox_tick[i];
+    }
+  }
+  exit_critical(primask);
+
+  return age;
+}
+
+/**
+ * @brief	Returns the transmit counters
+ *
+ * @retval	can_tx_stats*: Pointer to the counters
+ */
+const can_tx_stats* can_tx_get_stats(void)
+{
+  return &stats;
+}
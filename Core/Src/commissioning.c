@@ -0,0 +1,189 @@
+/**
+ * @file 	commissioning.c
+ * @brief	Raw sample stream over USART1 with DMA, for tuning the filters of a
+ * 		new probe
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#include "commissioning.h"
+
+#ifdef COMMISSIONING_STREAM
+
+#include "crc.h"
+#include "timebase.h"
+
+/*
+ * Un marco son palabras de 32 bits:
+ *   [0] sincronia, tipo, palabras de carga, secuencia (un byte cada uno)
+ *   [1] timebase_now_us() al armar el marco
+ *   [2..] carga
+ *   [n] CRC-32 de las palabras anteriores, ver crc.c
+ * El receptor se resincroniza buscando el byte de sincronia y verificando el CRC.
+ *
+ * Los marcos se copian a un anillo y el DMA saca tramos contiguos al USART; al
+ * terminar un tramo el interrupt arranca el siguiente. Si el anillo no tiene
+ * lugar el marco se descarta y se cuenta, el ciclo de lecturas nunca espera
+ * al puerto. El HAL de UART no esta en el arbol, los registros se manejan
+ * directamente como en crc.c.
+ */
+static uint32_t ring[COMMISSIONING_RING_WORDS];
+static volatile uint32_t head; /* Siguiente palabra a escribir */
+static volatile uint32_t tail; /* Primera palabra sin transmitir */
+static volatile uint32_t in_flight; /* Palabras del tramo en el DMA, 0 si esta libre */
+static uint8_t sequence;
+static commissioning_stats stats;
+
+/* Arranca el siguiente tramo si el DMA esta libre, con interrupts deshabilitados */
+static void kick(void)
+{
+  if(in_flight != 0U || tail == head)
+  {
+    return;
+  }
+
+  const uint32_t start = tail % COMMISSIONING_RING_WORDS;
+  uint32_t span = head - tail;
+  if(start + span > COMMISSIONING_RING_WORDS)
+  {
+    span = COMMISSIONING_RING_WORDS - start;
+  }
+  in_flight = span;
+
+  COMMISSIONING_DMA_CHANNEL->CCR = 0;
+  COMMISSIONING_DMA->IFCR = COMMISSIONING_DMA_CLEAR;
+  COMMISSIONING_DMA_CHANNEL->CMAR = (uint32_t)&ring[start];
+  COMMISSIONING_DMA_CHANNEL->CNDTR = span * 4U;
+  COMMISSIONING_DMA_CHANNEL->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE | DMA_CCR_EN;
+}
+
+/**
+ * @brief	Brings up USART1 TX on PA9 and its DMA channel
+ * @param	None
+ *
+ * @retval	None
+ */
+void commissioning_init(void)
+{
+  GPIO_InitTypeDef gpio = {0};
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_USART1_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  gpio.Pin = GPIO_PIN_9;
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_NOPULL;
+  gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+  gpio.Alternate = GPIO_AF1_USART1;
+  HAL_GPIO_Init(GPIOA, &gpio);
+
+  /* Sobremuestreo de 16 */
+  COMMISSIONING_USART->CR1 = 0;
+  COMMISSIONING_USART->BRR = (SystemCoreClock + COMMISSIONING_BAUD / 2U) / COMMISSIONING_BAUD;
+  COMMISSIONING_USART->CR3 = USART_CR3_DMAT;
+  COMMISSIONING_USART->CR1 = USART_CR1_TE | USART_CR1_UE;
+
+  COMMISSIONING_DMA->CSELR = (COMMISSIONING_DMA->CSELR & ~DMA_CSELR_C2S) | DMA1_CSELR_CH2_USART1_TX;
+  COMMISSIONING_DMA_CHANNEL->CCR = 0;
+  COMMISSIONING_DMA_CHANNEL->CPAR = (uint32_t)&COMMISSIONING_USART->TDR;
+
+  HAL_NVIC_SetPriority(DMA1_Ch2_3_DMA2_Ch1_2_IRQn, COMMISSIONING_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Ch2_3_DMA2_Ch1_2_IRQn);
+}
+
+/**
+ * @brief	Queues a frame without waiting, the frame is dropped if the ring is
+ * 		full. Called from the main loop.
+ * @param	commissioning_frame: Frame type
+ * @param	uint32_t*: Payload
+ * @param	uint32_t: Payload words, up to COMMISSIONING_MAX_PAYLOAD
+ *
+ * @retval	None
+ */
+void commissioning_send(commissioning_frame type, const uint32_t* payload, uint32_t words)
+{
+  if(words > COMMISSIONING_MAX_PAYLOAD)
+  {
+    words = COMMISSIONING_MAX_PAYLOAD;
+  }
+
+  uint32_t frame[COMMISSIONING_MAX_PAYLOAD + 3U];
+  frame[0] = COMMISSIONING_SYNC | ((uint32_t)type << 8) | (words << 16) | ((uint32_t)sequence << 24);
+  frame[1] = timebase_now_us();
+  for(uint32_t i = 0; i < words; i++)
+  {
+    frame[2U + i] = payload[i];
+  }
+  frame[2U + words] = crc_words(frame, words + 2U);
+  const uint32_t length = words + 3U;
+
+  /* Solo este contexto avanza head, tail solo avanza */
+  if(COMMISSIONING_RING_WORDS - (head - tail) < length)
+  {
+    stats.dropped++;
+    return;
+  }
+
+  const uint32_t start = head;
+  for(uint32_t i = 0; i < length; i++)
+  {
+    ring[(start + i) % COMMISSIONING_RING_WORDS] = frame[i];
+  }
+  sequence++;
+  stats.frames++;
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  head = start + length;
+  kick();
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief	Queues the raw counts of one temperature reading
+ * @param	uint32_t: Counts of the Vref channel
+ * @param	uint32_t: Counts of the LM35 channel
+ *
+ * @retval	None
+ */
+void commissioning_adc(uint32_t v_ref_counts, uint32_t temp_counts)
+{
+  const uint32_t counts = (v_ref_counts & 0xFFFFU) | (temp_counts << 16);
+  commissioning_send(COMMISSIONING_ADC, &counts, 1U);
+}
+
+/**
+ * @brief	Transfer complete interrupt of the TX channel, starts the next span
+ * @param	None
+ *
+ * @retval	None
+ */
+void commissioning_dma_irq(void)
+{
+  if((COMMISSIONING_DMA->ISR & COMMISSIONING_DMA_DONE) == 0U)
+  {
+    return;
+  }
+
+  COMMISSIONING_DMA->IFCR = COMMISSIONING_DMA_CLEAR;
+  COMMISSIONING_DMA_CHANNEL->CCR = 0;
+  tail += in_flight;
+  stats.words += in_flight;
+  in_flight = 0;
+  kick();
+}
+
+/**
+ * @brief	Gets the stream counters
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const commissioning_stats* commissioning_get_stats(void)
+{
+  return &stats;
+}
+
+#endif /* COMMISSIONING_STREAM */
@@ -0,0 +1,516 @@
+/**
+ * @file 	config.c
+ * @brief	Calibration and configuration store: A/B copies in flash, read in
+ * 		place and replaced over CAN without a reset
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Hay dos paginas, cada una con un bloque: encabezado con version, secuencia y
+ * CRC, y los valores. Al arrancar se toma la copia valida con la secuencia
+ * mayor, o los valores de fabrica compilados si ninguna lo es. Los modulos leen
+ * los valores en la flash por medio de config_get(), no hay copia en RAM.
+ *
+ * El panel reemplaza la configuración con CAN_CMD_CONFIG:
+ * - CONFIG_CMD_BEGIN borra la copia inactiva.
+ * - CONFIG_CMD_DATA programa una palabra de los valores en ella; el panel
+ *   espera la respuesta antes de mandar la siguiente.
+ * - CONFIG_CMD_COMMIT compara el CRC de la copia con el del panel, revisa los
+ *   valores y programa el encabezado, la marca al final.
+ * Desde el commit config_get() apunta a la copia nueva. Un corte de energía
+ * antes de la marca deja la copia anterior activa.
+ *
+ * Los comandos llegan en el interrupt de RX y se ejecutan en config_poll(),
+ * uno a la vez, porque programar y borrar detienen al CPU. Cada uno se contesta
+ * en el identificador de respuestas al terminar.
+ */
+
+#include <stddef.h>
+#include "config.h"
+#include "main.h"
+#include "crc.h"
+#include "can_tx.h"
+#include "node_id.h"
+#include "od.h"
+#include "trace.h"
+
+_Static_assert(sizeof(config_block) <= FLASH_PAGE_SIZE, "config_block must fit in a page");
+_Static_assert(sizeof(config_values) % 4U == 0U, "config_values must be made of words");
+_Static_assert(CONFIG_WORDS <= 0xFFU, "the word index of CONFIG_CMD_DATA is a byte");
+_Static_assert(FLASH_IMAGE_LIMIT <= CONFIG_FLASH_START, "the program image overlaps the configuration pages");
+
+#define ERASED_WORD 0xFFFFFFFFU
+
+/* Valores de fabrica. Los negativos de la LUT indican un estado de error, no se
+ * especifican en la hoja de datos porque no son factibles en la practica. */
+static const config_block defaults = {
+  .magic = CONFIG_MAGIC,
+  .version = CONFIG_VERSION,
+  .sequence = 0,
+  .values = {
+    .freq_lut = {
+      -1.0, -1.0, 7155, 7080, 7010, 6945,
+      6880, 6820, 6760, 6705, 6650, 6600,
+      6550, 6500, 6450, 6400, 6355, 6305,
+      6260, 6210, -1.0
+    },
+    .adc_timeout_ms = ADC_TIMEOUT,
+    .timer_samples = MAX_TIMER_SAMPLES - 1,
+    .adc_v_ref = 1.25f,
+    .temp_gradient = 0.01f,
+    .telemetry_base = CAN_TX_TELEMETRY_BASE
+  }
+};
+
+static const config_block* volatile active = &defaults;
+
+static config_hook hooks[CONFIG_MAX_HOOKS];
+static int hook_count = 0;
+
+/* Copia en escritura, NULL sin transferencia */
+static const config_block* staging = NULL;
+
+/* Comando pendiente, lo guarda el interrupt de RX */
+static volatile uint8_t request_pending = 0;
+static uint8_t request_subcommand;
+static uint8_t request_index;
+static uint32_t request_value;
+
+static inline const config_block* copy(uint32_t i)
+{
+  return (const config_block*)(CONFIG_FLASH_START + i * FLASH_PAGE_SIZE);
+}
+
+static uint32_t values_crc(const config_block* block)
+{
+  return crc_words((const uint32_t*)&block->values, CONFIG_WORDS);
+}
+
+/* Rangos de las otras clases de marcos, ver can_tx.h y can_health.h */
+static const uint32_t reserved_bases[] = {
+  0x000U, CAN_TX_ALARM_BASE, CAN_TX_RESPONSE_BASE, CAN_TX_AGG_BASE, CAN_TX_AGG_CLAIM_BASE,
+  CAN_TX_BULK_BASE, CAN_TX_HEARTBEAT_BASE, 0x700U, CAN_TX_TRACE_BASE
+};
+
+/* Las frecuencias bajan con la humedad. Los negativos marcan error y solo van
+ * en los extremos, lerp_rh_from_lut() interpola entre los demas. */
+static int lut_valid(const float* lut)
+{
+  int first = -1;
+  int last = -1;
+
+  for(int i = 0; i < FREQ_LUT_SIZE; i++)
+  {
+    if(lut[i] != lut[i])
+    {
+      return 0;
+    }
+    if(lut[i] >= 0.f)
+    {
+      if(last >= 0 && (last != i - 1 || !(lut[i] < lut[last])))
+      {
+        return 0;
+      }
+      if(first < 0)
+      {
+        first = i;
+      }
+      last = i;
+    }
+  }
+
+  return last > first;
+}
+
+static int telemetry_base_valid(uint32_t base)
+{
+  if((base & CAN_NODE_ID_MASK) != 0U || base > (0x7FFU & ~CAN_NODE_ID_MASK))
+  {
+    return 0;
+  }
+
+  return !config_base_reserved(base);
+}
+
+/* Limites de los valores, los mismos que aceptaba el diccionario de objetos. El
+ * primer flanco de la captura ocupa una muestra, estimate_freq() lee hasta
+ * timer_samples + 1. */
+static int values_valid(const config_values* values)
+{
+  return values->adc_timeout_ms >= 1U && values->adc_timeout_ms <= 1000U &&
+         values->timer_samples >= 1U && values->timer_samples < MAX_TIMER_SAMPLES &&
+         values->adc_v_ref > 0.f && values->temp_gradient > 0.f &&
+         lut_valid(values->freq_lut) && telemetry_base_valid(values->telemetry_base);
+}
+
+static int block_valid(const config_block* block)
+{
+  return block->magic == CONFIG_MAGIC && block->version == CONFIG_VERSION &&
+         block->crc == values_crc(block) && values_valid(&block->values);
+}
+
+/* Escritura expedita del diccionario, desde el interrupt de RX. La palabra se
+ * guarda con CONFIG_CMD_WRITE en config_poll(), como una transferencia de un
+ * solo valor */
+static od_status stage_od_write(volatile void* address, uint32_t value)
+{
+  const uint32_t offset = (uint32_t)address - (uint32_t)&active->values;
+
+  if(offset >= sizeof(config_values))
+  {
+    return OD_NO_ENTRY;
+  }
+  if(request_pending)
+  {
+    return OD_BUSY;
+  }
+
+  request_subcommand = CONFIG_CMD_WRITE;
+  request_index = (uint8_t)(offset / 4U);
+  request_value = value;
+  request_pending = 1;
+  return OD_PENDING;
+}
+
+/* Las entradas apuntan a la copia activa, se registran de nuevo al cambiarla */
+static void register_od(void)
+{
+  const config_block* block = active;
+  static const uint8_t staged[] = {
+    OD_SENSOR_ADC_TIMEOUT, OD_SENSOR_TIMER_SAMPLES, OD_SENSOR_FREQ_LUT,
+    OD_SENSOR_ADC_V_REF, OD_SENSOR_TEMP_GRADIENT, OD_CONFIG_TELEMETRY_BASE
+  };
+
+  od_register(OD_SENSOR_ADC_TIMEOUT, (volatile void*)&block->values.adc_timeout_ms, OD_U32, 1, OD_RW, 1, 1000);
+  od_register(OD_SENSOR_TIMER_SAMPLES, (volatile void*)&block->values.timer_samples, OD_U32, 1, OD_RW, 1, MAX_TIMER_SAMPLES - 1);
+  od_register(OD_SENSOR_FREQ_LUT, (volatile void*)block->values.freq_lut, OD_F32, FREQ_LUT_SIZE, OD_RW, 0, 0);
+  od_register(OD_SENSOR_ADC_V_REF, (volatile void*)&block->values.adc_v_ref, OD_F32, 1, OD_RW, 0, 0);
+  od_register(OD_SENSOR_TEMP_GRADIENT, (volatile void*)&block->values.temp_gradient, OD_F32, 1, OD_RW, 0, 0);
+  od_register(OD_CONFIG_TELEMETRY_BASE, (volatile void*)&block->values.telemetry_base, OD_U32, 1, OD_RW, 0, 0);
+  od_register(OD_CONFIG_SEQUENCE, (volatile void*)&block->sequence, OD_U32, 1, OD_RO, 0, 0);
+
+  for(uint32_t i = 0; i < sizeof(staged); i++)
+  {
+    od_set_write_hook(staged[i], stage_od_write);
+  }
+}
+
+/**
+ * @brief	Picks the valid copy with the highest sequence, or the factory
+ * 		values. Call it before the modules that read the configuration.
+ * @param	None
+ *
+ * @retval	None
+ */
+void config_init(void)
+{
+  for(uint32_t i = 0; i < CONFIG_FLASH_PAGES; i++)
+  {
+    const config_block* block = copy(i);
+    if(block_valid(block) && block->sequence >= active->sequence)
+    {
+      active = block;
+    }
+  }
+
+  register_od();
+  can_register_command(CAN_CMD_CONFIG, config_command);
+}
+
+/**
+ * @brief	Registers a function called after every commit, to move what was set
+ * 		up from the previous values
+ * @param	config_hook: Function to call
+ *
+ * @retval	0 on success, -1 if the table is full
+ */
+int config_register_hook(config_hook hook)
+{
+  if(hook_count >= CONFIG_MAX_HOOKS)
+  {
+    return -1;
+  }
+
+  hooks[hook_count++] = hook;
+  return 0;
+}
+
+/**
+ * @brief	Tells whether an identifier range belongs to a class other than the
+ * 		telemetry, such as alarms, responses or heartbeats
+ * @param	uint32_t: Base of the range, without the node number
+ *
+ * @retval	1 if reserved, 0 if it may carry telemetry or process data
+ */
+int config_base_reserved(uint32_t base)
+{
+  for(uint32_t i = 0; i < sizeof(reserved_bases) / sizeof(reserved_bases[0]); i++)
+  {
+    if(base == reserved_bases[i])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief	Gets the configuration in use. The values are read from flash and
+ * 		may change after every call to config_poll(), don't keep the pointer.
+ * @param	None
+ *
+ * @retval	Pointer to the values
+ */
+const config_values* config_get(void)
+{
+  return &active->values;
+}
+
+/**
+ * @brief	Gets the sequence of the configuration in use, 0 for the factory values
+ * @param	None
+ *
+ * @retval	Sequence
+ */
+uint32_t config_sequence(void)
+{
+  return active->sequence;
+}
+
+static int program_word(uint32_t address, uint32_t value)
+{
+  /* Cortex-M0 es little endian, la media palabra baja va primero */
+  return HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, (uint16_t)value) == HAL_OK &&
+         HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address + 2U, (uint16_t)(value >> 16)) == HAL_OK;
+}
+
+/* Borra la copia inactiva y la deja como la de escritura */
+static config_status begin(void)
+{
+  const config_block* block = (active == copy(0)) ? copy(1) : copy(0);
+  const uint32_t* words = (const uint32_t*)block;
+  int blank = 1;
+
+  for(uint32_t i = 0; i < sizeof(config_block) / 4U; i++)
+  {
+    blank &= words[i] == ERASED_WORD;
+  }
+
+  staging = NULL;
+  if(!blank)
+  {
+    FLASH_EraseInitTypeDef erase;
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.PageAddress = (uint32_t)block;
+    erase.NbPages = 1;
+    uint32_t page_error;
+
+    HAL_FLASH_Unlock();
+    const HAL_StatusTypeDef result = HAL_FLASHEx_Erase(&erase, &page_error);
+    HAL_FLASH_Lock();
+    if(result != HAL_OK)
+    {
+      return CONFIG_WRITE_FAIL;
+    }
+  }
+
+  staging = block;
+  return CONFIG_OK;
+}
+
+/* Una palabra ya programada con el mismo valor es un reintento del panel */
+static config_status data(uint8_t index, uint32_t value)
+{
+  if(staging == NULL)
+  {
+    return CONFIG_NOT_STARTED;
+  }
+  if(index >= CONFIG_WORDS)
+  {
+    return CONFIG_BAD_INDEX;
+  }
+
+  const uint32_t address = (uint32_t)&staging->values + index * 4U;
+  const uint32_t current = *(const uint32_t*)address;
+  if(current == value)
+  {
+    return CONFIG_OK;
+  }
+  if(current != ERASED_WORD)
+  {
+    return CONFIG_BAD_INDEX;
+  }
+
+  HAL_FLASH_Unlock();
+  const int ok = program_word(address, value);
+  HAL_FLASH_Lock();
+  return ok ? CONFIG_OK : CONFIG_WRITE_FAIL;
+}
+
+static config_status commit(can_handle* handle, uint32_t crc)
+{
+  if(staging == NULL)
+  {
+    return CONFIG_NOT_STARTED;
+  }
+  if(values_crc(staging) != crc)
+  {
+    return CONFIG_BAD_CRC;
+  }
+  if(!values_valid(&staging->values))
+  {
+    return CONFIG_BAD_VALUE;
+  }
+
+  const uint32_t base = (uint32_t)staging;
+  HAL_FLASH_Unlock();
+  int ok = program_word(base + offsetof(config_block, sequence), active->sequence + 1U);
+  ok = ok && program_word(base + offsetof(config_block, crc), crc);
+  ok = ok && HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, base + offsetof(config_block, version), CONFIG_VERSION) == HAL_OK;
+  /* La marca al final, un corte de energía a medias deja la copia invalida */
+  ok = ok && HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, base + offsetof(config_block, magic), CONFIG_MAGIC) == HAL_OK;
+  HAL_FLASH_Lock();
+
+  if(!ok || !block_valid(staging))
+  {
+    return CONFIG_WRITE_FAIL;
+  }
+
+  const config_block* previous = active;
+  active = staging;
+  staging = NULL;
+  register_od();
+
+  for(int i = 0; i < hook_count; i++)
+  {
+    hooks[i](handle, &previous->values);
+  }
+  return CONFIG_OK;
+}
+
+/* Cambia una palabra de los valores activos: los copia con la palabra nueva a la
+ * copia inactiva y la activa, igual que BEGIN, DATA y COMMIT seguidos. Una
+ * transferencia del panel a medias se descarta. */
+static config_status write_word(can_handle* handle, uint8_t index, uint32_t value)
+{
+  if(index >= CONFIG_WORDS)
+  {
+    return CONFIG_BAD_INDEX;
+  }
+
+  config_values values = active->values;
+  uint32_t* words = (uint32_t*)&values;
+  words[index] = value;
+
+  config_status status = begin();
+  for(uint8_t i = 0; i < CONFIG_WORDS && status == CONFIG_OK; i++)
+  {
+    status = data(i, words[i]);
+  }
+  if(status == CONFIG_OK)
+  {
+    status = commit(handle, crc_words(words, CONFIG_WORDS));
+  }
+  return status;
+}
+
+static void reply(can_handle* handle, uint8_t subcommand, uint8_t index, config_status status)
+{
+  const uint32_t sequence = active->sequence;
+  const uint8_t data[CAN_MAX_BYTES] = {
+    CAN_CMD_CONFIG, subcommand, index, (uint8_t)status,
+    (uint8_t)sequence, (uint8_t)(sequence >> 8), (uint8_t)(sequence >> 16), (uint8_t)(sequence >> 24)
+  };
+  can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), data, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+}
+
+/**
+ * @brief	Runs the pending configuration command, called from the main loop.
+ * 		The erase of CONFIG_CMD_BEGIN and CONFIG_CMD_WRITE waits for idle time.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Microseconds until the next sample
+ *
+ * @retval	None
+ */
+void config_poll(can_handle* handle, uint32_t idle_us)
+{
+  if(!request_pending)
+  {
+    return;
+  }
+
+  const uint8_t subcommand = request_subcommand;
+  if((subcommand == CONFIG_CMD_BEGIN || subcommand == CONFIG_CMD_WRITE) && idle_us < FLASH_LOG_ERASE_IDLE_US)
+  {
+    return;
+  }
+
+  config_status status;
+  switch(subcommand)
+  {
+    case CONFIG_CMD_BEGIN:
+      status = begin();
+      break;
+    case CONFIG_CMD_DATA:
+      status = data(request_index, request_value);
+      break;
+    case CONFIG_CMD_COMMIT:
+      status = commit(handle, request_value);
+      TRACE(TRACE_CONFIG_COMMIT, status);
+      break;
+    case CONFIG_CMD_WRITE:
+      status = write_word(handle, request_index, request_value);
+      TRACE(TRACE_CONFIG_COMMIT, status);
+      break;
+    default:
+      status = CONFIG_BAD_VALUE;
+      break;
+  }
+
+  reply(handle, subcommand, request_index, status);
+  request_pending = 0;
+}
+
+/**
+ * @brief	Command handler for CAN_CMD_CONFIG, called from the RX interrupt. The
+ * 		payload is:
+ * 		[1] node (0 for all)
+ * 		[2] config_subcommand
+ * 		[3] word index of config_values, in CONFIG_CMD_DATA and CONFIG_CMD_WRITE
+ * 		[4..7] little endian: the word in CONFIG_CMD_DATA and CONFIG_CMD_WRITE,
+ * 		the CRC-32 of config_values in CONFIG_CMD_COMMIT
+ * 		The answer goes on the response identifier as [0] command
+ * 		[1] subcommand [2] index [3] config_status [4..7] sequence of the
+ * 		configuration in use, after the command is run by config_poll().
+ * 		A command that arrives before the answer is refused with CONFIG_BUSY.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void config_command(can_handle* handle, const can_rx_view* frame)
+{
+  if(can_view_dlc(frame) < 8)
+  {
+    return;
+  }
+
+  const uint8_t node = can_view_byte(frame, 1);
+  if(node != CAN_NODE_BROADCAST && node != node_id_get())
+  {
+    return;
+  }
+
+  if(request_pending)
+  {
+    reply(handle, can_view_byte(frame, 2), can_view_byte(frame, 3), CONFIG_BUSY);
+    return;
+  }
+
+  request_subcommand = can_view_byte(frame, 2);
+  request_index = can_view_byte(frame, 3);
+  request_value = can_view_high_word(frame);
+  request_pending = 1;
+}
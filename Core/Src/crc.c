@@ -0,0 +1,187 @@
+/**
+ * @file 	crc.c
+ * @brief	CRC-32 used to validate records in flash and transfers, computed by
+ * 		the CRC unit of the STM32 or in software
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Mismo calculo que el periferico CRC del STM32F0 en su configuración por
+ * defecto: polinomio 0x04C11DB7, valor inicial 0xFFFFFFFF, palabras de 32 bits
+ * procesadas desde el bit mas significativo, sin inversión ni XOR final. Asi
+ * el resultado no depende de quien lo calcule.
+ *
+ * crc_init() enciende la unidad, compara su resultado con el de software y mide
+ * los tres métodos sobre CRC_BENCH_WORDS palabras de flash; crc_words() usa el
+ * mas rapido que dé el mismo resultado. La unidad es una sola, en interrupts y
+ * antes de crc_init() se calcula en software, asi un interrupt no corrompe el
+ * calculo del ciclo principal.
+ *
+ * Sin USE_HAL_DRIVER, en el host, solo queda el calculo en software y las
+ * herramientas de Tools/ compilan este mismo archivo.
+ *
+ * La tabla es de 16 entradas, un nibble por paso, para no ocupar 1 KB de flash.
+ */
+
+#include "crc.h"
+#ifdef USE_HAL_DRIVER
+#include "main.h"
+#endif
+
+static const uint32_t nibble_table[16] = {
+  0x00000000U, 0x04C11DB7U, 0x09823B6EU, 0x0D4326D9U,
+  0x130476DCU, 0x17C56B6BU, 0x1A864DB2U, 0x1E475005U,
+  0x2608EDB8U, 0x22C9F00FU, 0x2F8AD6D6U, 0x2B4BCB61U,
+  0x350C9B64U, 0x31CD86D3U, 0x3C8EA00AU, 0x384FBDBDU
+};
+
+static crc_stats stats;
+
+/**
+ * @brief	Computes the CRC-32 of a block of words in software
+ * @param	uint32_t*: Pointer to the words, aligned
+ * @param	uint32_t: Number of words
+ *
+ * @retval	uint32_t: CRC of the block
+ */
+uint32_t crc_words_software(const volatile uint32_t* words, uint32_t count)
+{
+  uint32_t crc = CRC_INITIAL;
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    crc ^= words[i];
+    for(int nibble = 0; nibble < 8; nibble++)
+    {
+      crc = (crc << 4) ^ nibble_table[crc >> 28];
+    }
+  }
+
+  return crc;
+}
+
+#ifdef USE_HAL_DRIVER
+
+static uint32_t crc_words_hardware(const volatile uint32_t* words, uint32_t count)
+{
+  CRC->CR |= CRC_CR_RESET;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    CRC->DR = words[i];
+  }
+  return CRC->DR;
+}
+
+/* El DMA escribe las palabras en el registro de datos; el CPU espera, la
+ * ganancia es que cada palabra cuesta menos ciclos de bus */
+static uint32_t crc_words_dma(const volatile uint32_t* words, uint32_t count)
+{
+  CRC->CR |= CRC_CR_RESET;
+
+  CRC_DMA_CHANNEL->CCR = 0;
+  CRC_DMA->IFCR = CRC_DMA_CLEAR;
+  CRC_DMA_CHANNEL->CPAR = (uint32_t)&CRC->DR;
+  CRC_DMA_CHANNEL->CMAR = (uint32_t)words;
+  CRC_DMA_CHANNEL->CNDTR = count;
+  CRC_DMA_CHANNEL->CCR = DMA_CCR_MEM2MEM | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 | DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN;
+
+  while(!(CRC_DMA->ISR & CRC_DMA_DONE))
+  {
+  }
+
+  CRC_DMA_CHANNEL->CCR = 0;
+  CRC_DMA->IFCR = CRC_DMA_CLEAR;
+  return CRC->DR;
+}
+
+/* Ciclos de un calculo, SysTick cuenta hacia abajo y recarga cada milisegundo */
+static uint32_t measure(uint32_t (*method)(const volatile uint32_t*, uint32_t),
+                        const volatile uint32_t* words, uint32_t* crc)
+{
+  const uint32_t reload = SysTick->LOAD + 1U;
+  const uint32_t start = SysTick->VAL;
+  *crc = method(words, CRC_BENCH_WORDS);
+  return (start + reload - SysTick->VAL) % reload;
+}
+
+#endif /* USE_HAL_DRIVER */
+
+/**
+ * @brief	Brings up the CRC unit and the DMA channel that feeds it, checks them
+ * 		against the software CRC and picks the fastest method
+ * @param	None
+ *
+ * @retval	0 if the CRC unit is used, -1 if crc_words() stays in software
+ */
+int crc_init(void)
+{
+#ifdef USE_HAL_DRIVER
+  __HAL_RCC_CRC_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  CRC->INIT = CRC_INITIAL;
+  CRC->POL = CRC_POLYNOMIAL;
+  CRC->CR = CRC_CR_RESET;
+
+  /* El inicio de la imagen siempre esta programado */
+  const volatile uint32_t* sample = (const volatile uint32_t*)FLASH_BASE;
+  uint32_t expected;
+  uint32_t hardware;
+  uint32_t dma;
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  stats.software_cycles = measure(crc_words_software, sample, &expected);
+  stats.hardware_cycles = measure(crc_words_hardware, sample, &hardware);
+  stats.dma_cycles = measure(crc_words_dma, sample, &dma);
+  __set_PRIMASK(primask);
+
+  if(hardware != expected)
+  {
+    stats.mode = CRC_SOFTWARE;
+    return -1;
+  }
+
+  stats.mode = (dma == expected && stats.dma_cycles < stats.hardware_cycles) ? CRC_HARDWARE_DMA : CRC_HARDWARE;
+  return 0;
+#else
+  stats.mode = CRC_SOFTWARE;
+  return -1;
+#endif
+}
+
+/**
+ * @brief	Computes the CRC-32 of a block of words, with the method chosen by
+ * 		crc_init()
+ * @param	uint32_t*: Pointer to the words, aligned
+ * @param	uint32_t: Number of words
+ *
+ * @retval	uint32_t: CRC of the block
+ */
+uint32_t crc_words(const volatile uint32_t* words, uint32_t count)
+{
+#ifdef USE_HAL_DRIVER
+  if(stats.mode != CRC_SOFTWARE && __get_IPSR() == 0U)
+  {
+    if(stats.mode == CRC_HARDWARE_DMA && count >= CRC_DMA_MIN_WORDS && count <= 0xFFFFU)
+    {
+      return crc_words_dma(words, count);
+    }
+    return crc_words_hardware(words, count);
+  }
+#endif
+  return crc_words_software(words, count);
+}
+
+/**
+ * @brief	Gets the method in use and the measured cycles
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const crc_stats* crc_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,1129 @@
+/**
+ * @file 	flash_log.c
+ * @brief	Append-only ring log of readings in the internal flash, kept in tiers
+ * 		of decreasing resolution and replayed over CAN after the control
+ * 		panel comes back
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Hay un anillo de paginas por nivel: todas las lecturas, medias de 1 minuto y
+ * medias de 1 hora. Las medias se calculan al llegar cada lectura, sin releer
+ * la flash, y se guardan como una lectura mas con el tiempo de inicio de su
+ * periodo; sus banderas son el OR de las del periodo y las lecturas con falla
+ * del sensor no entran en la media. Cuando el anillo de lecturas da la vuelta
+ * sus paginas mas viejas se borran, la historia sigue en los niveles gruesos.
+ *
+ * Las lecturas se comprimen con log_codec.c, cada pagina es un bloque que se
+ * decodifica sin las demas. En cada anillo la pagina con numero de secuencia s
+ * ocupa la posición s % paginas del nivel, y todas se borran el mismo numero
+ * de veces. Un registro se identifica por su indice absoluto dentro del nivel,
+ * s * FLASH_LOG_INDEX_STRIDE + posición, valido mientras su pagina no se
+ * reutilice.
+ *
+ * El reloj del registro cuenta segundos a partir del tiempo de muestreo de las
+ * lecturas y sigue despues de un reinicio desde la ultima lectura guardada. El
+ * panel lo pone en hora Unix con CAN_CMD_LOG_TIME; solo se adelanta, asi nunca
+ * retrocede. El encabezado de cada pagina lleva el reloj de su primer registro,
+ * los demas se obtienen sumando las diferencias de tiempo; un salto del reloj
+ * empieza otra pagina.
+ *
+ * Los encabezados forman un indice disperso: en cada anillo el reloj de inicio
+ * crece con la secuencia, una consulta por tiempo (CAN_CMD_LOG_QUERY) busca la
+ * pagina por bisección y decodifica solo esa. El costo no depende del tamaño
+ * del registro.
+ *
+ * Programar media palabra toma unos 50 us, borrar una pagina hasta 40 ms en
+ * los que el CPU no puede leer la flash. Los borrados se hacen en
+ * flash_log_poll() solo si falta tiempo suficiente para la siguiente lectura.
+ * Si una pagina se llena antes, se borra en el momento y se cuenta.
+ *
+ * Solo se programan medias palabras completas, los bits de la ultima quedan en
+ * RAM. Tras un reinicio, la pagina a medias de cada nivel se decodifica hasta
+ * la ultima media palabra programada y se cierra; las lecturas que seguian en
+ * RAM y los periodos sin terminar se pierden.
+ *
+ * Al volver el panel despues de FLASH_LOG_OUTAGE_MS sin contacto, las lecturas
+ * del corte salen sin comprimir como marcos bulk (CAN_TX_BULK_BASE | nodo) a la
+ * velocidad del bus, decodificadas en el interrupt de TX. El ciclo principal
+ * revisa el CRC de cada pagina y posiciona el decodificador antes de reenviarla.
+ */
+
+#include <stddef.h>
+#include "flash_log.h"
+#include "main.h"
+#include "crc.h"
+#include "can_tx.h"
+#include "log_codec.h"
+#include "sensors.h"
+#include "trace.h"
+
+_Static_assert(sizeof(flash_log_page) == FLASH_PAGE_SIZE, "flash_log_page must fill a page");
+_Static_assert(FLASH_LOG_DATA_BITS / 4U < FLASH_LOG_INDEX_STRIDE, "a page may hold more records than the stride");
+
+#define PAGE_CRC_WORDS ((offsetof(flash_log_page, crc)) / 4U)
+#define NO_PAGE 0xFFFFFFFFU
+#define NO_TIME 0xFFFFFFFFU
+#define SNAPSHOTS 4 /* Mas que los marcos bulk que pueden estar en los mailboxes */
+#define MAX_ADVANCE_S ((uint32_t)(((1ULL << LOG_CODEC_TIME_BITS) * 256U) / 1000000U)) /* Avance que cabe en el tiempo de 24 bits */
+#define QUERY_RESOLUTIONS 3
+
+/**
+ * @struct Pages and period of a tier
+ */
+typedef struct tier_config {
+  uint16_t first_page;
+  uint16_t pages;
+  uint32_t period_s; /* 0 en el nivel de lecturas */
+} tier_config;
+
+/**
+ * @struct Write position of a tier
+ */
+typedef struct ring {
+  log_encoder encoder;
+  volatile uint32_t head_sequence;
+  volatile uint32_t head_committed; /* Registros completos en flash */
+  uint32_t head_written; /* Medias palabras programadas */
+  uint8_t head_open; /* Encabezado de la pagina actual programado */
+  uint8_t head_erased; /* Pagina actual lista para programar */
+  uint8_t next_erased; /* Siguiente pagina lista para programar */
+  uint32_t last_seconds; /* Reloj del ultimo registro agregado */
+} ring;
+
+typedef flash_log_window window;
+
+static const tier_config tiers[FLASH_LOG_TIERS] = {
+  { 0, FLASH_LOG_RAW_PAGES, 0 },
+  { FLASH_LOG_RAW_PAGES, FLASH_LOG_MINUTE_PAGES, 60 },
+  { FLASH_LOG_RAW_PAGES + FLASH_LOG_MINUTE_PAGES, FLASH_LOG_HOUR_PAGES, 3600 }
+};
+
+/* Resolución en segundos y unidad de la duración de cada codigo de consulta */
+static const uint32_t query_resolution_s[QUERY_RESOLUTIONS] = { 0, 60, 3600 };
+static const uint32_t query_unit_s[QUERY_RESOLUTIONS] = { 60, 60, 3600 };
+
+static ring rings[FLASH_LOG_TIERS];
+static window windows[FLASH_LOG_TIERS];
+
+/* Reloj del registro */
+static uint32_t clock_seconds = 0;
+static uint32_t clock_us = 0;
+static uint32_t clock_time = NO_TIME;
+static volatile uint32_t panel_seconds = NO_TIME; /* Hora pendiente de aplicar */
+
+/* Consulta pendiente, la recibe el interrupt de RX y la resuelve el ciclo principal */
+static volatile uint8_t query_pending = 0;
+static uint8_t query_tier;
+static uint32_t query_from;
+static uint32_t query_to;
+
+/* Reenvio, el cursor lo avanza el interrupt de TX mientras stream_ready */
+static volatile uint8_t stream_tier = FLASH_LOG_RAW;
+static volatile uint32_t stream_start = 0;
+static volatile uint32_t stream_cursor = 0;
+static volatile uint32_t stream_end = 0;
+static volatile uint8_t stream_ready = 0;
+static uint32_t verified_sequence = NO_PAGE;
+static log_decoder stream_decoder;
+
+/* Estado del decodificador antes de cada marco en vuelo, para reintentarlo */
+static log_decoder snapshots[SNAPSHOTS];
+static uint32_t snapshot_index[SNAPSHOTS];
+
+/* Contacto con el panel */
+static uint32_t last_contact = 0;
+static uint32_t contact_index = 0;
+static uint8_t outage = 0;
+static uint32_t outage_index = 0;
+static uint8_t backfill_pending = 0; /* Corte terminado, espera a que acabe la transferencia en curso */
+
+static flash_log_stats stats;
+
+static inline int32_t time_delta(uint32_t to, uint32_t from)
+{
+  return (int32_t)((to - from) << (32U - LOG_CODEC_TIME_BITS)) >> (32U - LOG_CODEC_TIME_BITS);
+}
+
+/* Avance del reloj entre dos registros seguidos, en unidades de 256 us. Entre
+ * lecturas solo cuenta si es positivo; entre medias, que solo avanzan, es el
+ * modulo de 24 bits, una hora no cabe en la diferencia con signo. */
+static inline uint32_t record_advance(uint8_t tier, uint32_t to, uint32_t from)
+{
+  if(tier != FLASH_LOG_RAW)
+  {
+    return (to - from) & ((1UL << LOG_CODEC_TIME_BITS) - 1U);
+  }
+  const int32_t delta = time_delta(to, from);
+  return (delta > 0) ? (uint32_t)delta : 0U;
+}
+
+static inline uint32_t page_address(uint8_t tier, uint32_t sequence)
+{
+  return FLASH_LOG_START + (tiers[tier].first_page + sequence % tiers[tier].pages) * FLASH_PAGE_SIZE;
+}
+
+static inline const flash_log_page* page_of(uint8_t tier, uint32_t sequence)
+{
+  return (const flash_log_page*)page_address(tier, sequence);
+}
+
+/* Encabezado programado para esa secuencia, la pagina no se ha reutilizado */
+static int page_valid(uint8_t tier, uint32_t sequence)
+{
+  const flash_log_page* page = page_of(tier, sequence);
+  return page->magic == FLASH_LOG_MAGIC && page->tier == tier && page->sequence == sequence;
+}
+
+static int page_blank(const flash_log_page* page)
+{
+  const uint32_t* words = (const uint32_t*)page;
+  for(uint32_t i = 0; i < FLASH_PAGE_SIZE / 4U; i++)
+  {
+    if(words[i] != 0xFFFFFFFFU)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void program(uint32_t address, uint16_t value)
+{
+  if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, value) != HAL_OK)
+  {
+    stats.write_errors++;
+  }
+}
+
+static void erase(uint8_t tier, uint32_t sequence)
+{
+  FLASH_EraseInitTypeDef request;
+  request.TypeErase = FLASH_TYPEERASE_PAGES;
+  request.PageAddress = page_address(tier, sequence);
+  request.NbPages = 1;
+  uint32_t page_error;
+
+  HAL_FLASH_Unlock();
+  if(HAL_FLASHEx_Erase(&request, &page_error) != HAL_OK)
+  {
+    stats.write_errors++;
+  }
+  HAL_FLASH_Lock();
+  stats.erases++;
+}
+
+/* Deja lista una pagina, sin borrarla si ya esta en blanco */
+static void prepare(uint8_t tier, uint32_t sequence)
+{
+  if(!page_blank(page_of(tier, sequence)))
+  {
+    erase(tier, sequence);
+  }
+}
+
+/* Decodifica hasta max registros de una pagina, parando en el primero con reloj
+ * de until o mas. Devuelve cuantos hay antes y el reloj del ultimo decodificado. */
+static uint32_t scan_page(const flash_log_page* page, uint32_t limit_bits, uint32_t max, uint32_t until,
+                          uint32_t* last_seconds)
+{
+  log_decoder decoder;
+  log_sample sample;
+  uint32_t count = 0;
+  uint32_t previous = 0;
+  uint64_t units = 0;
+
+  *last_seconds = page->start_seconds;
+  log_decoder_reset(&decoder, page->data, limit_bits);
+  while(count < max && log_decode(&decoder, &sample))
+  {
+    if(count > 0)
+    {
+      units += record_advance(page->tier, sample.time, previous);
+    }
+    previous = sample.time;
+
+    *last_seconds = page->start_seconds + (uint32_t)((units * 256U) / 1000000U);
+    if(*last_seconds >= until)
+    {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+/* Programa el CRC y el numero de registros y pasa a la siguiente pagina. Se
+ * llama con la flash desbloqueada. */
+static void close_page(uint8_t tier, uint32_t count)
+{
+  ring* r = &rings[tier];
+  const uint32_t base = page_address(tier, r->head_sequence);
+  const uint32_t crc = crc_words((const uint32_t*)base, PAGE_CRC_WORDS);
+
+  program(base + offsetof(flash_log_page, crc), (uint16_t)crc);
+  program(base + offsetof(flash_log_page, crc) + 2U, (uint16_t)(crc >> 16));
+  program(base + offsetof(flash_log_page, count), (uint16_t)count);
+  program(base + offsetof(flash_log_page, end_magic), FLASH_LOG_MAGIC);
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  r->head_sequence++;
+  r->head_committed = 0;
+  __set_PRIMASK(primask);
+
+  r->head_written = 0;
+  r->head_open = 0;
+  r->head_erased = r->next_erased;
+  r->next_erased = 0;
+}
+
+/* Cierra la pagina actual con los registros que tenga. Se llama con la flash
+ * desbloqueada. */
+static void finish_page(uint8_t tier)
+{
+  ring* r = &rings[tier];
+  uint16_t out;
+
+  if(log_encoder_flush(&r->encoder, &out))
+  {
+    program(page_address(tier, r->head_sequence) + offsetof(flash_log_page, data) + r->head_written * 2U, out);
+    r->head_written++;
+  }
+  close_page(tier, r->encoder.last.count);
+}
+
+/* Encuentra la pagina mas nueva de un nivel y cierra la que quedo a medias.
+ * Devuelve 1 si el nivel tiene registros, con el reloj del ultimo. */
+static int init_tier(uint8_t tier, uint32_t* last_seconds)
+{
+  ring* r = &rings[tier];
+  int found = 0;
+  uint32_t sequence = 0;
+
+  for(uint32_t i = 0; i < tiers[tier].pages; i++)
+  {
+    const flash_log_page* page = (const flash_log_page*)(FLASH_LOG_START + (tiers[tier].first_page + i) * FLASH_PAGE_SIZE);
+    if(page->magic == FLASH_LOG_MAGIC && page->tier == tier && page->sequence % tiers[tier].pages == i &&
+       (!found || page->sequence > sequence))
+    {
+      sequence = page->sequence;
+      found = 1;
+    }
+  }
+
+  r->head_sequence = sequence;
+  r->head_erased = 0;
+  const flash_log_page* head = page_of(tier, sequence);
+
+  if(found && head->end_magic != FLASH_LOG_MAGIC)
+  {
+    /* Pagina a medias: cuenta los registros hasta la ultima media palabra
+     * programada y la cierra */
+    uint32_t written = FLASH_LOG_DATA_HALFWORDS;
+    while(written > 0 && head->data[written - 1U] == 0xFFFFU)
+    {
+      written--;
+    }
+
+    const uint32_t count = scan_page(head, written * 16U, FLASH_LOG_INDEX_STRIDE, NO_TIME, last_seconds);
+    r->next_erased = 0;
+    HAL_FLASH_Unlock();
+    close_page(tier, count);
+    HAL_FLASH_Lock();
+  }
+  else if(found)
+  {
+    scan_page(head, FLASH_LOG_DATA_BITS, head->count, NO_TIME, last_seconds);
+    r->head_sequence = sequence + 1U;
+  }
+
+  if(!r->head_erased)
+  {
+    prepare(tier, r->head_sequence);
+    r->head_erased = 1;
+  }
+  r->next_erased = page_blank(page_of(tier, r->head_sequence + 1U));
+  return found;
+}
+
+/**
+ * @brief	Finds the write position of every tier from the page headers and
+ * 		closes the pages left open by a reset. May erase, call it before
+ * 		sampling.
+ * @param	None
+ *
+ * @retval	None
+ */
+void flash_log_init(void)
+{
+  for(uint8_t tier = 0; tier < FLASH_LOG_TIERS; tier++)
+  {
+    uint32_t last_seconds;
+    if(init_tier(tier, &last_seconds) && tier == FLASH_LOG_RAW)
+    {
+      /* El reloj sigue despues de la ultima lectura */
+      clock_seconds = last_seconds + 1U;
+    }
+  }
+
+  contact_index = flash_log_head(FLASH_LOG_RAW);
+  stream_cursor = stream_end = contact_index;
+
+  can_register_command(CAN_CMD_LOG_TIME, flash_log_command);
+  can_register_command(CAN_CMD_LOG_QUERY, flash_log_command);
+}
+
+/* Comprime y agrega un registro a un nivel */
+static void append_to(uint8_t tier, const log_sample* sample, uint32_t seconds)
+{
+  ring* r = &rings[tier];
+
+  /* Los registros de una pagina avanzan el reloj con su diferencia de tiempo, un
+   * salto que no cabe empieza otra */
+  if(r->head_open && seconds - r->last_seconds > MAX_ADVANCE_S)
+  {
+    HAL_FLASH_Unlock();
+    finish_page(tier);
+    HAL_FLASH_Lock();
+  }
+
+  if(!r->head_erased)
+  {
+    stats.forced_erases++;
+    prepare(tier, r->head_sequence);
+    r->head_erased = 1;
+  }
+
+  const uint32_t base = page_address(tier, r->head_sequence);
+
+  HAL_FLASH_Unlock();
+
+  if(!r->head_open)
+  {
+    program(base + offsetof(flash_log_page, start_seconds), (uint16_t)seconds);
+    program(base + offsetof(flash_log_page, start_seconds) + 2U, (uint16_t)(seconds >> 16));
+    program(base + offsetof(flash_log_page, sequence), (uint16_t)r->head_sequence);
+    program(base + offsetof(flash_log_page, sequence) + 2U, (uint16_t)(r->head_sequence >> 16));
+    program(base + offsetof(flash_log_page, tier), (uint16_t)(0xFF00U | tier));
+    program(base + offsetof(flash_log_page, magic), FLASH_LOG_MAGIC);
+    log_encoder_reset(&r->encoder);
+    r->head_open = 1;
+  }
+
+  uint16_t out[LOG_CODEC_MAX_HALFWORDS];
+
+  /* SysTick cuenta hacia abajo y recarga cada milisegundo */
+  const uint32_t start_bits = r->encoder.total_bits;
+  const uint32_t reload = SysTick->LOAD + 1U;
+  const uint32_t start_cycles = SysTick->VAL;
+  const int count = log_encode(&r->encoder, sample, out);
+  const uint32_t cycles = (start_cycles + reload - SysTick->VAL) % reload;
+
+  stats.encode_cycles_last = cycles;
+  if(cycles > stats.encode_cycles_max)
+  {
+    stats.encode_cycles_max = cycles;
+  }
+  stats.encoded_bits += r->encoder.total_bits - start_bits;
+
+  for(int i = 0; i < count; i++)
+  {
+    program(base + offsetof(flash_log_page, data) + r->head_written * 2U, out[i]);
+    r->head_written++;
+  }
+
+  /* Un registro esta en flash cuando su ultimo bit lo esta; los anteriores al
+   * actual terminan donde empieza este */
+  const uint32_t flushed = r->head_written * 16U;
+  const uint32_t index = r->encoder.last.count;
+  if(r->encoder.total_bits <= flushed)
+  {
+    r->head_committed = index;
+  }
+  else if(start_bits <= flushed)
+  {
+    r->head_committed = index - 1U;
+  }
+
+  r->last_seconds = seconds;
+  if(FLASH_LOG_DATA_BITS - r->encoder.total_bits < LOG_CODEC_MAX_SAMPLE_BITS)
+  {
+    finish_page(tier);
+  }
+
+  HAL_FLASH_Lock();
+}
+
+/* Guarda la media de un periodo terminado */
+static void close_window(uint8_t tier, const window* w)
+{
+  log_sample mean;
+
+  /* El tiempo del periodo en unidades de 256 us, exacto para multiplos de 4 s */
+  mean.time = (uint32_t)(((uint64_t)w->start * 15625U) / 4U) & ((1UL << LOG_CODEC_TIME_BITS) - 1U);
+  mean.temp = (w->temp_count > 0) ? (int16_t)(w->temp_sum / w->temp_count) : 0;
+  mean.rh = (w->rh_count > 0) ? (uint16_t)(w->rh_sum / w->rh_count) : 0;
+  mean.flags = w->flags;
+
+  append_to(tier, &mean, w->start);
+  stats.aggregates++;
+}
+
+static void aggregate(uint8_t tier, const log_sample* sample)
+{
+  window* w = &windows[tier];
+  const uint32_t start = clock_seconds - clock_seconds % tiers[tier].period_s;
+
+  if(w->open && w->start != start)
+  {
+    close_window(tier, w);
+    w->open = 0;
+  }
+
+  if(!w->open)
+  {
+    *w = (window){ 0 };
+    w->start = start;
+    w->open = 1;
+  }
+
+  if(!(sample->flags & TEMP_SENSOR_FAIL))
+  {
+    w->temp_sum += sample->temp;
+    w->temp_count++;
+  }
+  if(!(sample->flags & HUM_SENSOR_FAIL))
+  {
+    w->rh_sum += sample->rh;
+    w->rh_count++;
+  }
+  w->flags |= sample->flags;
+}
+
+/**
+ * @brief	Appends a reading to the log and to the means of the coarser tiers.
+ * 		Never erases unless a page could not be erased in idle time.
+ * @param	uint8_t*: Reading of FLASH_LOG_RECORD_BYTES bytes, see can_pack_reading()
+ *
+ * @retval	None
+ */
+void flash_log_append(const uint8_t* record)
+{
+  log_sample sample;
+  log_sample_from_record(record, &sample);
+
+  /* Solo avanza, un SYNC que atrasa el tiempo del bus no lo regresa */
+  if(clock_time != NO_TIME)
+  {
+    const int32_t delta = time_delta(sample.time, clock_time);
+    if(delta > 0)
+    {
+      clock_us += (uint32_t)delta * 256U;
+      clock_seconds += clock_us / 1000000U;
+      clock_us %= 1000000U;
+    }
+  }
+  clock_time = sample.time;
+
+  /* La hora del panel; las lecturas de la pagina actual no verian el salto */
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const uint32_t panel = panel_seconds;
+  panel_seconds = NO_TIME;
+  __set_PRIMASK(primask);
+
+  if(panel != NO_TIME && panel > clock_seconds && panel - clock_seconds >= FLASH_LOG_CLOCK_STEP_S)
+  {
+    if(rings[FLASH_LOG_RAW].head_open)
+    {
+      HAL_FLASH_Unlock();
+      finish_page(FLASH_LOG_RAW);
+      HAL_FLASH_Lock();
+    }
+    clock_seconds = panel;
+    clock_us = 0;
+  }
+
+  append_to(FLASH_LOG_RAW, &sample, clock_seconds);
+  stats.records++;
+
+  for(uint8_t tier = FLASH_LOG_RAW + 1; tier < FLASH_LOG_TIERS; tier++)
+  {
+    aggregate(tier, &sample);
+  }
+}
+
+/**
+ * @brief	Absolute index of the next record of a tier that will be complete
+ * 		in flash
+ * @param	flash_log_tier: Tier
+ *
+ * @retval	Record index
+ */
+uint32_t flash_log_head(flash_log_tier tier)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const uint32_t index = rings[tier].head_sequence * FLASH_LOG_INDEX_STRIDE + rings[tier].head_committed;
+  __set_PRIMASK(primask);
+  return index;
+}
+
+/**
+ * @brief	Gets the clock of the log, the one of the page headers
+ * @param	None
+ *
+ * @retval	Seconds
+ */
+uint32_t flash_log_seconds(void)
+{
+  return clock_seconds;
+}
+
+/**
+ * @brief	Copies the running means of the tiers, to keep them across a warm
+ * 		restart, see warm.c
+ * @param	flash_log_window*: FLASH_LOG_TIERS windows
+ *
+ * @retval	None
+ */
+void flash_log_get_windows(flash_log_window* out)
+{
+  for(uint8_t tier = 0; tier < FLASH_LOG_TIERS; tier++)
+  {
+    out[tier] = windows[tier];
+  }
+}
+
+/**
+ * @brief	Resumes the running means kept across a warm restart. Called after
+ * 		flash_log_init(), before the first reading; a window of a period
+ * 		that already ended is closed with the next reading.
+ * @param	flash_log_window*: FLASH_LOG_TIERS windows
+ *
+ * @retval	None
+ */
+void flash_log_set_windows(const flash_log_window* in)
+{
+  for(uint8_t tier = 0; tier < FLASH_LOG_TIERS; tier++)
+  {
+    windows[tier] = in[tier];
+  }
+}
+
+/**
+ * @brief	Picks the coarsest tier with records at least as close as a resolution
+ * @param	uint32_t: Time between records the reader needs, in seconds
+ *
+ * @retval	Tier
+ */
+flash_log_tier flash_log_tier_for(uint32_t resolution_s)
+{
+  for(uint8_t tier = FLASH_LOG_TIERS - 1U; tier > FLASH_LOG_RAW; tier--)
+  {
+    if(tiers[tier].period_s <= resolution_s)
+    {
+      return (flash_log_tier)tier;
+    }
+  }
+  return FLASH_LOG_RAW;
+}
+
+/* Fuente bulk, desde el interrupt de TX. Solo decodifica la pagina verificada. */
+static int stream_next(can_tx_image* image, uint32_t* cookie)
+{
+  const uint32_t index = stream_cursor;
+  if(!stream_ready || index >= stream_end)
+  {
+    return 0;
+  }
+
+  const uint8_t tier = stream_tier;
+  const uint32_t sequence = index / FLASH_LOG_INDEX_STRIDE;
+  const int is_head = sequence == rings[tier].head_sequence;
+  const uint32_t available = is_head ? rings[tier].head_committed : page_of(tier, sequence)->count;
+
+  log_decoder* snapshot = &snapshots[index % SNAPSHOTS];
+  *snapshot = stream_decoder;
+  snapshot_index[index % SNAPSHOTS] = index;
+
+  log_sample sample;
+  if(index % FLASH_LOG_INDEX_STRIDE >= available || !log_decode(&stream_decoder, &sample))
+  {
+    /* Fin de la pagina, el ciclo principal prepara la siguiente */
+    if(!is_head)
+    {
+      stream_cursor = (sequence + 1U) * FLASH_LOG_INDEX_STRIDE;
+      stream_ready = 0;
+    }
+    return 0;
+  }
+
+  uint8_t record[FLASH_LOG_RECORD_BYTES];
+  log_sample_to_record(&sample, record);
+  can_tx_build_image(CAN_TX_ID(CAN_TX_BULK_BASE), record, FLASH_LOG_RECORD_BYTES, image);
+
+  *cookie = index;
+  stream_cursor = index + 1U;
+  return 1;
+}
+
+static void stream_failed(uint32_t cookie)
+{
+  /* Un marco de una transferencia anterior no mueve el cursor de esta */
+  if(cookie < stream_start || cookie >= stream_cursor)
+  {
+    return;
+  }
+
+  const uint32_t slot = cookie % SNAPSHOTS;
+  if(snapshot_index[slot] == cookie && cookie / FLASH_LOG_INDEX_STRIDE == verified_sequence)
+  {
+    stream_decoder = snapshots[slot];
+    stream_ready = 1;
+  }
+  else
+  {
+    stream_ready = 0;
+  }
+  stream_cursor = cookie;
+}
+
+/**
+ * @brief	Tells whether a transfer still has records to send
+ * @param	None
+ *
+ * @retval	1 if a transfer is in progress, 0 if not
+ */
+int flash_log_streaming(void)
+{
+  return stream_cursor < stream_end;
+}
+
+/**
+ * @brief	Sends a range of records of a tier as bulk frames. A transfer in
+ * 		progress is never replaced, the caller answers busy or retries once
+ * 		flash_log_streaming() is 0. Records already overwritten are skipped.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	flash_log_tier: Tier
+ * @param	uint32_t: Index of the first record
+ * @param	uint32_t: Index after the last record
+ *
+ * @retval	0 if started, -1 if another transfer is in progress
+ */
+int flash_log_stream(can_handle* handle, flash_log_tier tier, uint32_t from, uint32_t to)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if(stream_cursor < stream_end)
+  {
+    __set_PRIMASK(primask);
+    return -1;
+  }
+  stream_tier = tier;
+  stream_start = from;
+  stream_cursor = from;
+  stream_end = to;
+  stream_ready = 0;
+  verified_sequence = NO_PAGE;
+  __set_PRIMASK(primask);
+
+  can_tx_set_bulk_source(stream_next, stream_failed);
+  return 0;
+}
+
+/* Secuencias con registros de un nivel, devuelve 0 si no tiene */
+static int valid_range(uint8_t tier, uint32_t* first, uint32_t* last)
+{
+  const ring* r = &rings[tier];
+  const uint32_t pages = tiers[tier].pages;
+  uint32_t lo = (r->head_sequence + 1U > pages) ? r->head_sequence + 1U - pages : 0U;
+  uint32_t hi = r->head_sequence;
+
+  if(r->head_committed == 0U)
+  {
+    if(hi == 0U)
+    {
+      return 0;
+    }
+    hi--;
+  }
+
+  /* La mas vieja puede estar borrada o a medio borrar */
+  while(lo <= hi && !page_valid(tier, lo))
+  {
+    lo++;
+  }
+
+  *first = lo;
+  *last = hi;
+  return lo <= hi;
+}
+
+/* Registros completos de una pagina */
+static uint32_t page_records(uint8_t tier, uint32_t sequence)
+{
+  if(sequence == rings[tier].head_sequence)
+  {
+    return rings[tier].head_committed;
+  }
+  return page_valid(tier, sequence) ? page_of(tier, sequence)->count : 0U;
+}
+
+/**
+ * @brief	Finds the first record of a tier taken at a time or later, with a binary
+ * 		search over the page headers and the decoding of a single page. Takes
+ * 		up to tens of ms, call it from the main loop.
+ * @param	flash_log_tier: Tier
+ * @param	uint32_t: Time in seconds of the log clock
+ * @param	uint32_t*: Time of the record found, may be NULL
+ *
+ * @retval	Record index, the head of the tier if every record is older
+ */
+uint32_t flash_log_find(flash_log_tier tier, uint32_t seconds, uint32_t* found_seconds)
+{
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t at = clock_seconds;
+
+  if(!valid_range(tier, &lo, &hi))
+  {
+    if(found_seconds != NULL)
+    {
+      *found_seconds = at;
+    }
+    return flash_log_head(tier);
+  }
+
+  /* Ultima pagina que empieza antes o en el tiempo buscado */
+  uint32_t index = lo * FLASH_LOG_INDEX_STRIDE;
+  at = page_of(tier, lo)->start_seconds;
+  if(at < seconds)
+  {
+    while(lo < hi)
+    {
+      const uint32_t middle = lo + (hi - lo + 1U) / 2U;
+      if(page_of(tier, middle)->start_seconds <= seconds)
+      {
+        lo = middle;
+      }
+      else
+      {
+        hi = middle - 1U;
+      }
+    }
+
+    const uint32_t available = page_records(tier, lo);
+    const uint32_t position = scan_page(page_of(tier, lo), FLASH_LOG_DATA_BITS, available, seconds, &at);
+    index = lo * FLASH_LOG_INDEX_STRIDE + position;
+
+    if(position == available)
+    {
+      /* Todos los de la pagina son anteriores, el siguiente empieza la otra o
+       * todavia no se guarda */
+      at = clock_seconds;
+      if(lo != rings[tier].head_sequence)
+      {
+        index = (lo + 1U) * FLASH_LOG_INDEX_STRIDE;
+        if(page_valid(tier, lo + 1U))
+        {
+          at = page_of(tier, lo + 1U)->start_seconds;
+        }
+      }
+    }
+  }
+
+  if(found_seconds != NULL)
+  {
+    *found_seconds = at;
+  }
+  return index;
+}
+
+/* Registros entre dos indices de un nivel, sin los de paginas reutilizadas */
+static uint32_t count_records(uint8_t tier, uint32_t from, uint32_t to)
+{
+  uint32_t count = 0;
+
+  for(uint32_t sequence = from / FLASH_LOG_INDEX_STRIDE; from < to && sequence <= to / FLASH_LOG_INDEX_STRIDE; sequence++)
+  {
+    const uint32_t first = (sequence == from / FLASH_LOG_INDEX_STRIDE) ? from % FLASH_LOG_INDEX_STRIDE : 0U;
+    uint32_t last = page_records(tier, sequence);
+    if(sequence == to / FLASH_LOG_INDEX_STRIDE && to % FLASH_LOG_INDEX_STRIDE < last)
+    {
+      last = to % FLASH_LOG_INDEX_STRIDE;
+    }
+    if(last > first)
+    {
+      count += last - first;
+    }
+  }
+  return count;
+}
+
+/* Resuelve la consulta pendiente: contesta con el nivel, cuantos registros y el
+ * reloj del primero, y los manda como marcos bulk. Con una transferencia en
+ * curso contesta FLASH_LOG_QUERY_BUSY sin registros, el panel repite despues */
+static void run_query(can_handle* handle)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const flash_log_tier tier = (flash_log_tier)query_tier;
+  const uint32_t from_s = query_from;
+  const uint32_t to_s = query_to;
+  query_pending = 0;
+  __set_PRIMASK(primask);
+
+  if(flash_log_streaming())
+  {
+    const uint8_t busy[CAN_MAX_BYTES] = { CAN_CMD_LOG_QUERY, FLASH_LOG_QUERY_BUSY, 0, 0, 0, 0, 0, 0 };
+    can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), busy, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+    stats.queries_busy++;
+    return;
+  }
+
+  uint32_t first_seconds;
+  const uint32_t from = flash_log_find(tier, from_s, &first_seconds);
+  const uint32_t to = flash_log_find(tier, to_s, NULL);
+  const uint32_t count = count_records(tier, from, to);
+  const uint16_t records = (count > 0xFFFFU) ? 0xFFFFU : (uint16_t)count;
+
+  const uint8_t reply[CAN_MAX_BYTES] = {
+    CAN_CMD_LOG_QUERY, (uint8_t)tier, (uint8_t)records, (uint8_t)(records >> 8),
+    (uint8_t)first_seconds, (uint8_t)(first_seconds >> 8), (uint8_t)(first_seconds >> 16), (uint8_t)(first_seconds >> 24)
+  };
+  can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), reply, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+
+  if(count > 0U)
+  {
+    flash_log_stream(handle, tier, from, to);
+  }
+  stats.queries++;
+  TRACE(TRACE_LOG_QUERY, records);
+}
+
+/**
+ * @brief	Command handler for CAN_CMD_LOG_TIME and CAN_CMD_LOG_QUERY, called from
+ * 		the RX interrupt. The payload is:
+ * 		[1] node (0 for all)
+ * 		[2..5] Unix time in seconds, little endian: the current time in
+ * 		CAN_CMD_LOG_TIME, the start of the range in CAN_CMD_LOG_QUERY
+ * 		[6..7] only in CAN_CMD_LOG_QUERY, little endian: length of the range
+ * 		in the bits of FLASH_LOG_QUERY_LENGTH_MASK, and in the two upper
+ * 		bits the resolution, 0 every reading, 1 one minute and 2 one hour.
+ * 		The length is in minutes, or in hours with a resolution of one hour.
+ * 		A query is answered from the main loop on the response identifier as
+ * 		[0] command [1] tier [2..3] number of records [4..7] time of the
+ * 		first one, followed by the records as bulk frames. While another
+ * 		transfer is in progress the tier is FLASH_LOG_QUERY_BUSY and nothing
+ * 		is sent.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void flash_log_command(can_handle* handle, const can_rx_view* frame)
+{
+  const uint8_t code = can_view_byte(frame, 0);
+  if(can_view_dlc(frame) < ((code == CAN_CMD_LOG_QUERY) ? 8 : 6))
+  {
+    return;
+  }
+
+  const uint8_t node = can_view_byte(frame, 1);
+  if(node != CAN_NODE_BROADCAST && node != node_id_get())
+  {
+    return;
+  }
+
+  const uint32_t seconds = (can_view_low_word(frame) >> 16) | (can_view_high_word(frame) << 16);
+  if(code == CAN_CMD_LOG_TIME)
+  {
+    panel_seconds = seconds;
+    return;
+  }
+
+  const uint16_t argument = (uint16_t)(can_view_high_word(frame) >> 16);
+  const uint32_t resolution = argument >> 14;
+  if(resolution >= QUERY_RESOLUTIONS || query_pending)
+  {
+    return;
+  }
+
+  const uint32_t length_s = (argument & FLASH_LOG_QUERY_LENGTH_MASK) * query_unit_s[resolution];
+  query_tier = flash_log_tier_for(query_resolution_s[resolution]);
+  query_from = seconds;
+  query_to = (seconds + length_s < seconds) ? NO_TIME : seconds + length_s;
+  query_pending = 1;
+}
+
+/* Verifica la pagina del cursor y deja el decodificador en el registro del
+ * cursor. Las paginas reutilizadas o corruptas se saltan. */
+static void prepare_stream(uint32_t idle_us)
+{
+  const uint8_t tier = stream_tier;
+  const uint32_t cursor = stream_cursor;
+  const uint32_t sequence = cursor / FLASH_LOG_INDEX_STRIDE;
+  const uint32_t skip = cursor % FLASH_LOG_INDEX_STRIDE;
+  const flash_log_page* page = page_of(tier, sequence);
+
+  /* Llegar a un registro a mitad de pagina cuesta hasta decenas de ms */
+  if(skip > 0U && idle_us < FLASH_LOG_ERASE_IDLE_US)
+  {
+    return;
+  }
+
+  int usable = page_valid(tier, sequence);
+  if(!usable)
+  {
+    stats.overwritten++;
+  }
+  else if(sequence != verified_sequence && sequence != rings[tier].head_sequence)
+  {
+    usable = page->end_magic == FLASH_LOG_MAGIC && page->crc == crc_words((const uint32_t*)page, PAGE_CRC_WORDS);
+    if(!usable)
+    {
+      stats.crc_errors++;
+    }
+  }
+
+  log_decoder decoder;
+  log_sample sample;
+  log_decoder_reset(&decoder, page->data, FLASH_LOG_DATA_BITS);
+  for(uint32_t i = 0; usable && i < skip; i++)
+  {
+    usable = log_decode(&decoder, &sample);
+  }
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if(stream_cursor == cursor && stream_tier == tier && !stream_ready)
+  {
+    if(usable)
+    {
+      stream_decoder = decoder;
+      verified_sequence = sequence;
+      stream_ready = 1;
+    }
+    else
+    {
+      stream_cursor = (sequence + 1U) * FLASH_LOG_INDEX_STRIDE;
+    }
+  }
+  __set_PRIMASK(primask);
+}
+
+/* Borra una pagina pendiente, la primera que encuentre */
+static void erase_pending(void)
+{
+  for(uint8_t tier = 0; tier < FLASH_LOG_TIERS; tier++)
+  {
+    ring* r = &rings[tier];
+    if(!r->head_erased)
+    {
+      prepare(tier, r->head_sequence);
+      r->head_erased = 1;
+      return;
+    }
+    if(!r->next_erased)
+    {
+      /* Borra la pagina mas vieja del nivel, con ella se van sus registros */
+      prepare(tier, r->head_sequence + 1U);
+      r->next_erased = 1;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief	Erases a page if there is idle time, follows the contact with the
+ * 		control panel and feeds the transfer in progress. Called from the main
+ * 		loop.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	uint32_t: Microseconds until the next sample
+ *
+ * @retval	None
+ */
+void flash_log_poll(can_handle* handle, uint32_t idle_us)
+{
+  if(idle_us >= FLASH_LOG_ERASE_IDLE_US)
+  {
+    /* La busqueda de una consulta decodifica hasta dos paginas */
+    if(query_pending)
+    {
+      run_query(handle);
+    }
+    else
+    {
+      erase_pending();
+    }
+  }
+
+  const uint32_t contact = can_get_panel_tick();
+  if(contact != last_contact)
+  {
+    last_contact = contact;
+    if(outage)
+    {
+      outage = 0;
+      backfill_pending = 1;
+    }
+    contact_index = flash_log_head(FLASH_LOG_RAW);
+  }
+  else if(!outage && (HAL_GetTick() - last_contact) > FLASH_LOG_OUTAGE_MS)
+  {
+    /* Un corte nuevo con el reenvio del anterior en espera lo extiende */
+    outage = 1;
+    if(!backfill_pending)
+    {
+      outage_index = contact_index;
+    }
+  }
+
+  /* El reenvio espera a que termine una consulta en curso, no la corta */
+  if(backfill_pending && !outage &&
+     flash_log_stream(handle, FLASH_LOG_RAW, outage_index, flash_log_head(FLASH_LOG_RAW)) == 0)
+  {
+    backfill_pending = 0;
+    stats.backfills++;
+  }
+
+  if(stream_cursor < stream_end)
+  {
+    /* Las paginas que el borrado alcanzo ya no se pueden reenviar */
+    const ring* r = &rings[stream_tier];
+    const uint32_t pages = tiers[stream_tier].pages;
+    const uint32_t oldest = (r->head_sequence + 2U > pages) ?
+        (r->head_sequence + 2U - pages) * FLASH_LOG_INDEX_STRIDE : 0U;
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(r->next_erased && stream_cursor < oldest)
+    {
+      stats.overwritten += oldest / FLASH_LOG_INDEX_STRIDE - stream_cursor / FLASH_LOG_INDEX_STRIDE;
+      stream_cursor = oldest;
+      stream_ready = 0;
+    }
+    __set_PRIMASK(primask);
+
+    if(!stream_ready)
+    {
+      prepare_stream(idle_us);
+    }
+    can_tx_pump(handle);
+  }
+}
+
+/**
+ * @brief	Gets the log counters
+ * @param	None
+ *
+ * @retval	Pointer to the counters
+ */
+const flash_log_stats* flash_log_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file 	isr_profile.c
+ * @brief	Latency and duration histograms of the interrupt handlers
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * El M0 no tiene DWT, los tiempos salen de SysTick (ver timebase_cycles()),
+ * con resolución de un ciclo. Cada handler toma la marca al entrar y registra
+ * al salir; medir cuesta unas decenas de ciclos por interrupción.
+ *
+ * La latencia solo se mide cuando el periférico deja saber cuando ocurrio el
+ * evento: SysTick por lo que conto desde la recarga, TIM6 por el vencimiento
+ * que anoto can_schedule.c y TIM2 por la captura del flanco en CCR1, que el
+ * callback de %RH pasa a ciclos (ver sensors_edge_latency()). Un flanco que
+ * llega cuando el anterior no se ha leido se pierde (CC1OF) y no cuenta.
+ *
+ * CAN marca con TTCM el SOF de cada marco recibido o transmitido, en bits, y
+ * avisa al terminar el marco. La latencia es el tiempo local menos el SOF y la
+ * duración del marco sin bits de relleno, menos el minimo visto: el contador
+ * de CAN no se puede leer, la relación con el tiempo local sale del marco mas
+ * rapido, con el mismo envejecimiento que timebase_sof_local_us(). La
+ * resolución es de un bit (48 ciclos) y los bits de relleno, hasta 24 en un
+ * marco de 8 bytes, cuentan como latencia.
+ *
+ * Los histogramas se leen y se borran (escribiendo 0) por el diccionario de
+ * objetos, 0x70 + 2 * isr_id la latencia y la siguiente la duración.
+ */
+
+#include "isr_profile.h"
+#include "od.h"
+
+static isr_histogram histograms[ISR_COUNT];
+
+/* Minimo de (tiempo local - SOF - duración) mod 2^16 de los marcos de CAN */
+static uint16_t can_offset;
+static uint8_t can_offset_valid = 0;
+static uint8_t can_frames = 0;
+
+/* Bucket log2, sin CLZ en el M0 */
+static uint32_t bucket(uint32_t cycles)
+{
+  uint32_t k = 0;
+
+  if(cycles >= (1UL << 16)) { cycles >>= 16; k += 16; }
+  if(cycles >= (1UL << 8)) { cycles >>= 8; k += 8; }
+  if(cycles >= (1UL << 4)) { cycles >>= 4; k += 4; }
+  if(cycles >= (1UL << 2)) { cycles >>= 2; k += 2; }
+  if(cycles >= (1UL << 1)) { cycles >>= 1; k += 1; }
+  k += cycles;
+
+  return (k < ISR_PROFILE_BUCKETS) ? k : ISR_PROFILE_BUCKETS - 1U;
+}
+
+/**
+ * @brief	Registers the histograms in the object dictionary
+ * @param	None
+ *
+ * @retval	None
+ */
+void isr_profile_init(void)
+{
+  for(uint8_t id = 0; id < ISR_COUNT; id++)
+  {
+    od_register(OD_ISR_LATENCY + 2U * id, histograms[id].latency, OD_U32, ISR_PROFILE_BUCKETS, OD_RW, 0, 0);
+    od_register(OD_ISR_DURATION + 2U * id, histograms[id].duration, OD_U32, ISR_PROFILE_BUCKETS, OD_RW, 0, 0);
+  }
+}
+
+/**
+ * @brief	Records one run of a handler, called at its end
+ * @param	isr_id: Handler
+ * @param	uint32_t: isr_profile_enter() at the start of the handler
+ * @param	uint32_t: Cycles from the event to the start, or ISR_PROFILE_NO_LATENCY
+ *
+ * @retval	None
+ */
+void isr_profile_exit(isr_id id, uint32_t entry_cycles, uint32_t latency_cycles)
+{
+  isr_histogram* histogram = &histograms[id];
+
+  histogram->duration[bucket(timebase_cycles() - entry_cycles)]++;
+  if(latency_cycles != ISR_PROFILE_NO_LATENCY)
+  {
+    histogram->latency[bucket(latency_cycles)]++;
+  }
+}
+
+/**
+ * @brief	Records one run of the SysTick handler. The tick moves inside it, so
+ * 		it is measured on the counter alone.
+ * @param	uint32_t: SysTick->VAL at the start of the handler
+ *
+ * @retval	None
+ */
+void isr_profile_systick(uint32_t entry_val)
+{
+  const uint32_t load = SysTick->LOAD;
+  const uint32_t exit_val = SysTick->VAL;
+
+  histograms[ISR_SYSTICK].latency[bucket(load - entry_val)]++;
+  histograms[ISR_SYSTICK].duration[bucket((entry_val >= exit_val) ? entry_val - exit_val : entry_val + load + 1U - exit_val)]++;
+}
+
+/**
+ * @brief	Latency of the CAN interrupt from the end of the oldest frame waiting
+ * 		in a receive FIFO, or else of a frame just transmitted, by its TTCM
+ * 		timestamp. Relative to the fastest frame seen, see above.
+ * @param	CAN_TypeDef*: CAN peripheral, read before its handler releases the frame
+ * @param	uint32_t: timebase_now_us() at the start of the handler
+ *
+ * @retval	uint32_t: Cycles since the end of the frame, or ISR_PROFILE_NO_LATENCY
+ */
+uint32_t isr_profile_can_latency(const CAN_TypeDef* can, uint32_t now_us)
+{
+  uint32_t stamp_dlc;
+  uint32_t remote;
+
+  if((can->RF0R & CAN_RF0R_FMP0) != 0U)
+  {
+    stamp_dlc = can->sFIFOMailBox[0].RDTR;
+    remote = can->sFIFOMailBox[0].RIR & CAN_RI0R_RTR;
+  }
+  else if((can->RF1R & CAN_RF1R_FMP1) != 0U)
+  {
+    stamp_dlc = can->sFIFOMailBox[1].RDTR;
+    remote = can->sFIFOMailBox[1].RIR & CAN_RI0R_RTR;
+  }
+  else
+  {
+    int mailbox = -1;
+    for(int i = 0; i < 3; i++)
+    {
+      /* RQCP y TXOK de cada mailbox estan a 8 bits del anterior */
+      if((can->TSR & ((CAN_TSR_RQCP0 | CAN_TSR_TXOK0) << (8 * i))) == ((CAN_TSR_RQCP0 | CAN_TSR_TXOK0) << (8 * i)))
+      {
+        mailbox = i;
+        break;
+      }
+    }
+    if(mailbox < 0)
+    {
+      return ISR_PROFILE_NO_LATENCY;
+    }
+    stamp_dlc = can->sTxMailBox[mailbox].TDTR;
+    remote = can->sTxMailBox[mailbox].TIR & CAN_TI0R_RTR;
+  }
+
+  /* SOF a EOF de un marco estandar: 44 bits mas los datos */
+  const uint32_t dlc = stamp_dlc & CAN_RDT0R_DLC;
+  const uint32_t bits = 44U + (remote ? 0U : 8U * ((dlc > 8U) ? 8U : dlc));
+  const uint16_t stamp = (uint16_t)(stamp_dlc >> CAN_RDT0R_TIME_Pos);
+  const uint16_t delay = (uint16_t)((uint16_t)now_us - (uint16_t)((stamp + bits) * TIMEBASE_CAN_BIT_US));
+
+  if(++can_frames >= TIMEBASE_SOF_AGING)
+  {
+    can_frames = 0;
+    can_offset++;
+  }
+  if(!can_offset_valid || (int16_t)(delay - can_offset) < 0)
+  {
+    can_offset = delay;
+    can_offset_valid = 1;
+  }
+
+  return (uint32_t)(uint16_t)(delay - can_offset) * (SystemCoreClock / 1000000U);
+}
+
+/**
+ * @brief	Gets the histograms of a handler
+ * @param	isr_id: Handler
+ *
+ * @retval	Pointer to the histograms
+ */
+const isr_histogram* isr_profile_get(isr_id id)
+{
+  return &histograms[id];
+}
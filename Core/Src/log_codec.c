@@ -0,0 +1,299 @@
+/**
+ * @file 	log_codec.c
+ * @brief	Incremental compression of readings for the flash log, in the style of
+ * 		Gorilla, with integer arithmetic only
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Cada muestra se codifica contra la anterior del mismo bloque:
+ * - Tiempo: diferencia de la diferencia (delta-of-delta). Con el periodo fijo
+ *   es 0, o ±1 por el redondeo a 256 µs.
+ * - Temperatura y %RH: diferencia con el valor anterior.
+ * - Banderas: 1 bit si no cambian.
+ *
+ * Las diferencias usan un prefijo de longitud variable:
+ *   0                 cero
+ *   10   + ancho[0]   bits con signo
+ *   110  + ancho[1]
+ *   1110 + ancho[2]
+ *   1111 + ancho completo del campo
+ * Una muestra en régimen estable ocupa unos 19 bits en vez de 64.
+ *
+ * Los bits se escriben desde el mas significativo de cada media palabra, la
+ * unidad que programa la flash. El primer tiempo de un bloque se codifica contra
+ * 0, y su diferencia se toma como 0, asi cada bloque se decodifica solo.
+ *
+ * Las restas son modulo el ancho del campo, el tiempo de 24 bits puede dar la
+ * vuelta dentro de un bloque.
+ */
+
+#include "log_codec.h"
+
+#define FLAGS_BITS 8
+
+static const uint8_t time_widths[3] = { 4, 9, 14 };
+static const uint8_t value_widths[3] = { 4, 7, 10 };
+
+static inline int32_t sign_extend(uint32_t value, uint8_t width)
+{
+  return (int32_t)(value << (32U - width)) >> (32U - width);
+}
+
+/* Agrega hasta 16 bits, saca las medias palabras completas */
+static void put_bits(log_encoder* encoder, uint32_t value, uint8_t width, uint16_t* out, int* written)
+{
+  encoder->pending = (encoder->pending << width) | (value & ((1UL << width) - 1U));
+  encoder->pending_bits += width;
+  encoder->total_bits += width;
+
+  if(encoder->pending_bits >= 16U)
+  {
+    encoder->pending_bits -= 16U;
+    out[(*written)++] = (uint16_t)(encoder->pending >> encoder->pending_bits);
+  }
+}
+
+/* Prefijo y valor de una diferencia, ver la tabla al inicio */
+static void put_delta(log_encoder* encoder, int32_t delta, const uint8_t* widths, uint8_t full,
+                      uint16_t* out, int* written)
+{
+  if(delta == 0)
+  {
+    put_bits(encoder, 0, 1, out, written);
+    return;
+  }
+
+  for(uint32_t i = 0; i < 3; i++)
+  {
+    const int32_t range = 1L << (widths[i] - 1U);
+    if(delta >= -range && delta < range)
+    {
+      /* i + 1 unos y un cero */
+      put_bits(encoder, (2UL << (i + 1U)) - 2U, (uint8_t)(i + 2U), out, written);
+      put_bits(encoder, (uint32_t)delta, widths[i], out, written);
+      return;
+    }
+  }
+
+  put_bits(encoder, 0xFU, 4, out, written);
+  if(full > 16U)
+  {
+    put_bits(encoder, (uint32_t)delta >> 16, (uint8_t)(full - 16U), out, written);
+    put_bits(encoder, (uint32_t)delta, 16, out, written);
+  }
+  else
+  {
+    put_bits(encoder, (uint32_t)delta, full, out, written);
+  }
+}
+
+/* Lee hasta 16 bits. Fuera del limite deja position mas alla de limit. */
+static uint32_t get_bits(log_decoder* decoder, uint8_t width)
+{
+  uint32_t value = 0;
+
+  if(decoder->position + width > decoder->limit)
+  {
+    decoder->position = decoder->limit + 1U;
+    return 0;
+  }
+
+  for(uint8_t i = 0; i < width; i++)
+  {
+    const uint32_t position = decoder->position++;
+    const uint16_t halfword = decoder->data[position >> 4];
+    value = (value << 1) | ((halfword >> (15U - (position & 0xFU))) & 1U);
+  }
+  return value;
+}
+
+static int32_t get_delta(log_decoder* decoder, const uint8_t* widths, uint8_t full)
+{
+  uint32_t ones = 0;
+  while(ones < 4U && get_bits(decoder, 1))
+  {
+    ones++;
+  }
+
+  if(ones == 0U)
+  {
+    return 0;
+  }
+  if(ones < 4U)
+  {
+    return sign_extend(get_bits(decoder, widths[ones - 1U]), widths[ones - 1U]);
+  }
+  if(full > 16U)
+  {
+    const uint32_t high = get_bits(decoder, (uint8_t)(full - 16U));
+    return sign_extend((high << 16) | get_bits(decoder, 16), full);
+  }
+  return sign_extend(get_bits(decoder, full), full);
+}
+
+/**
+ * @brief	Reads a sample from a record in the format of can_pack_reading()
+ * @param	uint8_t*: Record of 8 bytes
+ * @param	log_sample*: Sample
+ *
+ * @retval	None
+ */
+void log_sample_from_record(const uint8_t* record, log_sample* sample)
+{
+  sample->temp = (int16_t)(record[0] | (record[1] << 8));
+  sample->rh = (uint16_t)(record[2] | (record[3] << 8));
+  sample->flags = record[4];
+  sample->time = record[5] | ((uint32_t)record[6] << 8) | ((uint32_t)record[7] << 16);
+}
+
+/**
+ * @brief	Writes a sample as a record in the format of can_pack_reading()
+ * @param	log_sample*: Sample
+ * @param	uint8_t*: Record of 8 bytes
+ *
+ * @retval	None
+ */
+void log_sample_to_record(const log_sample* sample, uint8_t* record)
+{
+  record[0] = (uint8_t)sample->temp;
+  record[1] = (uint8_t)((uint16_t)sample->temp >> 8);
+  record[2] = (uint8_t)sample->rh;
+  record[3] = (uint8_t)(sample->rh >> 8);
+  record[4] = sample->flags;
+  record[5] = (uint8_t)sample->time;
+  record[6] = (uint8_t)(sample->time >> 8);
+  record[7] = (uint8_t)(sample->time >> 16);
+}
+
+/**
+ * @brief	Starts a new block, which can be decoded without the previous ones
+ * @param	log_encoder*: Encoder
+ *
+ * @retval	None
+ */
+void log_encoder_reset(log_encoder* encoder)
+{
+  encoder->last = (log_codec_state){ 0 };
+  encoder->pending = 0;
+  encoder->pending_bits = 0;
+  encoder->total_bits = 0;
+}
+
+/**
+ * @brief	Encodes a sample
+ * @param	log_encoder*: Encoder
+ * @param	log_sample*: Sample
+ * @param	uint16_t*: Buffer of LOG_CODEC_MAX_HALFWORDS for the completed halfwords
+ *
+ * @retval	Number of halfwords completed
+ */
+int log_encode(log_encoder* encoder, const log_sample* sample, uint16_t* out)
+{
+  log_codec_state* last = &encoder->last;
+  int written = 0;
+
+  const int32_t delta = sign_extend(sample->time - last->time, LOG_CODEC_TIME_BITS);
+  const int32_t dod = sign_extend((uint32_t)(delta - last->delta), LOG_CODEC_TIME_BITS);
+  put_delta(encoder, dod, time_widths, LOG_CODEC_TIME_BITS, out, &written);
+
+  put_delta(encoder, (int16_t)(sample->temp - last->temp), value_widths, 16, out, &written);
+  put_delta(encoder, (int16_t)(sample->rh - last->rh), value_widths, 16, out, &written);
+
+  if(sample->flags == last->flags)
+  {
+    put_bits(encoder, 0, 1, out, &written);
+  }
+  else
+  {
+    put_bits(encoder, 1, 1, out, &written);
+    put_bits(encoder, sample->flags, FLAGS_BITS, out, &written);
+  }
+
+  last->delta = (last->count == 0U) ? 0 : delta;
+  last->time = sample->time & ((1UL << LOG_CODEC_TIME_BITS) - 1U);
+  last->temp = sample->temp;
+  last->rh = sample->rh;
+  last->flags = sample->flags;
+  last->count++;
+
+  return written;
+}
+
+/**
+ * @brief	Completes the last halfword with ones, the value of erased flash
+ * @param	log_encoder*: Encoder
+ * @param	uint16_t*: Buffer for the halfword
+ *
+ * @retval	1 if a halfword was completed, 0 if there were no pending bits
+ */
+int log_encoder_flush(log_encoder* encoder, uint16_t* out)
+{
+  if(encoder->pending_bits == 0U)
+  {
+    return 0;
+  }
+
+  const uint8_t padding = (uint8_t)(16U - encoder->pending_bits);
+  out[0] = (uint16_t)((encoder->pending << padding) | ((1UL << padding) - 1U));
+  encoder->pending_bits = 0;
+  encoder->total_bits += padding;
+  return 1;
+}
+
+/**
+ * @brief	Starts decoding a block
+ * @param	log_decoder*: Decoder
+ * @param	uint16_t*: First halfword of the block
+ * @param	uint32_t: Bits of the block that may be read
+ *
+ * @retval	None
+ */
+void log_decoder_reset(log_decoder* decoder, const uint16_t* data, uint32_t limit_bits)
+{
+  decoder->last = (log_codec_state){ 0 };
+  decoder->data = data;
+  decoder->position = 0;
+  decoder->limit = limit_bits;
+}
+
+/**
+ * @brief	Decodes the next sample. A sample that doesn't fit within the limit
+ * 		leaves the decoder unchanged.
+ * @param	log_decoder*: Decoder
+ * @param	log_sample*: Sample
+ *
+ * @retval	1 if decoded, 0 at the end of the block
+ */
+int log_decode(log_decoder* decoder, log_sample* sample)
+{
+  const uint32_t start = decoder->position;
+  log_codec_state* last = &decoder->last;
+
+  const int32_t dod = get_delta(decoder, time_widths, LOG_CODEC_TIME_BITS);
+  const int32_t delta = sign_extend((uint32_t)(last->delta + dod), LOG_CODEC_TIME_BITS);
+  const int16_t temp = (int16_t)(last->temp + get_delta(decoder, value_widths, 16));
+  const uint16_t rh = (uint16_t)(last->rh + get_delta(decoder, value_widths, 16));
+  const uint8_t flags = get_bits(decoder, 1) ? (uint8_t)get_bits(decoder, FLAGS_BITS) : last->flags;
+
+  if(decoder->position > decoder->limit)
+  {
+    decoder->position = start;
+    return 0;
+  }
+
+  sample->time = (last->time + (uint32_t)delta) & ((1UL << LOG_CODEC_TIME_BITS) - 1U);
+  sample->temp = temp;
+  sample->rh = rh;
+  sample->flags = flags;
+
+  last->delta = (last->count == 0U) ? 0 : delta;
+  last->time = sample->time;
+  last->temp = temp;
+  last->rh = rh;
+  last->flags = flags;
+  last->count++;
+  return 1;
+}
@@ -26,6 +26,24 @@
 /* USER CODE BEGIN Includes */
 #include "sensors.h"
 #include "can.h"
+#include "can_health.h"
+#include "can_schedule.h"
+#include "can_tx.h"
+#include "pdo.h"
+#include "od.h"
+#include "node_id.h"
+#include "aggregator.h"
+#include "flash_log.h"
+#include "config.h"
+#include "crc.h"
+#include "timebase.h"
+#include "trace.h"
+#include "commissioning.h"
+#include "isr_profile.h"
+#include "sysmem.h"
+#include "boot.h"
+#include "warm.h"
+#include "watchdog.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -48,6 +66,10 @@ typedef enum Error_State {
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define SAMPLE_PERIOD_MS 1000 /* Periodo de lectura de los sensores */
+#define SAMPLE_PERIOD_US (SAMPLE_PERIOD_MS * 1000U)
+#define LOOP_DEADLINE_MS 2500U /* Una vuelta del ciclo, dos tiempos limite del ADC de hasta 1 s mas la captura de %RH */
+#define SAMPLE_DEADLINE_MS (3U * SAMPLE_PERIOD_MS) /* Entre lecturas, un SYNC puede correr la siguiente un periodo */
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -61,6 +83,7 @@ ADC_HandleTypeDef hadc;
 CAN_HandleTypeDef hcan;
 
 TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim6;
 
 /* USER CODE BEGIN PV */
 
@@ -72,6 +95,7 @@ static void MX_GPIO_Init(void);
 static void MX_CAN_Init(void);
 static void MX_ADC_Init(void);
 static void MX_TIM2_Init(void);
+static void MX_TIM6_Init(void);
 /* USER CODE BEGIN PFP */
 
 /* USER CODE END PFP */
@@ -88,7 +112,8 @@ static void MX_TIM2_Init(void);
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+  /* Antes de que algo use la pila o el heap, ver sysmem.c */
+  sysmem_paint_stack();
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -97,28 +122,26 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  boot_init();
+  /* La traza sobrevive a un reset en caliente, se revisa antes del primer evento */
+  trace_init();
+  /* Desde aqui un bloqueo termina en un reset, ver watchdog.c */
+  watchdog_init();
   /* USER CODE END Init */
 
   /* Configure the system clock */
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  boot_mark(BOOT_CLOCK);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
   MX_CAN_Init();
-  MX_ADC_Init();
-  MX_TIM2_Init();
+  MX_TIM6_Init();
   /* USER CODE BEGIN 2 */
 
-  /* Copia handles al struct del usuario */
-  sensors_handle sensors_h;
-  sensors_h.adc = hadc;
-  sensors_h.htim2 = htim2;
-
   /* Datos de lectura */
   float temp = -1;
   float rh = -1;
@@ -127,6 +150,66 @@ int main(void)
   uint8_t data[CAN_MAX_BYTES];
   for (int i = 0; i < CAN_MAX_BYTES; i++)
     data[i] = 0;
+
+  /* Si la unidad CRC falla (CRC_INIT_FAIL) el calculo sigue en software */
+  crc_init();
+
+  /* La configuración primero, los demas modulos la leen al iniciar */
+  config_init();
+
+#ifdef COMMISSIONING_STREAM
+  commissioning_init();
+#endif
+
+  /* Los handlers de recepción se registran antes de arrancar el periférico */
+  if(can_register_handler(&hcan, CONTROL_PANEL_CAN_STD_ID, CAN_RTR_REMOTE, can_answer_poll) < 0 ||
+     can_register_handler(&hcan, CONTROL_PANEL_CAN_STD_ID, CAN_RTR_DATA, can_dispatch_command) < 0)
+  {
+    Error_Handler();
+  }
+  can_schedule_init(&htim6);
+  node_id_init(&hcan);
+  aggregator_init(&hcan);
+  can_health_init(&hcan);
+  pdo_init(&hcan);
+  od_init();
+  isr_profile_init();
+
+  /* Tras un reset en caliente los modulos siguen desde el estado guardado en
+   * RAM, antes de que un comando del panel pueda cambiarlo */
+  warm_restore(&hcan);
+  can_start(&hcan);
+
+  /* El nodo se anuncia antes de configurar los sensores y de recorrer el
+   * registro. MX_ADC_Init() y MX_TIM2_Init() se llaman aqui, en el .ioc estan
+   * marcadas para que CubeMX no genere la llamada. */
+  node_id_poll(&hcan);
+  boot_mark(BOOT_CAN);
+
+  MX_ADC_Init();
+  MX_TIM2_Init();
+
+  /* Copia handles al struct del usuario */
+  sensors_handle sensors_h;
+  sensors_h.adc = hadc;
+  sensors_h.htim2 = &htim2;
+  sensors_time_conversion();
+  boot_mark(BOOT_SENSORS);
+
+  /* Los comandos del registro que lleguen antes se ignoran */
+  flash_log_init();
+  warm_restore_log();
+  boot_mark(BOOT_LOG);
+
+  /* Las lecturas se toman en multiplos del periodo en tiempo del bus, asi todos
+   * los nodos sincronizados muestrean al mismo tiempo. La primera se toma de
+   * inmediato, las siguientes ya alineadas. */
+  sensor_error last_error_flags = ALL_OK;
+
+  uint32_t next_sample_us = timebase_bus_us();
+
+  watchdog_register(WATCHDOG_LOOP, LOOP_DEADLINE_MS);
+  watchdog_register(WATCHDOG_SENSORS, SAMPLE_DEADLINE_MS);
   
   /* USER CODE END 2 */
 
@@ -137,6 +220,68 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    watchdog_checkin(WATCHDOG_LOOP);
+    watchdog_poll();
+
+    can_health_poll(&hcan);
+    node_id_poll(&hcan);
+
+    /* Los marcos de datos de proceso esperan a que el numero de nodo sea firme */
+    if(node_id_is_claimed())
+    {
+      pdo_poll(&hcan);
+    }
+
+    const uint32_t bus_now = timebase_bus_us();
+    const int32_t late = (int32_t)(bus_now - next_sample_us);
+
+    /* Un SYNC puede mover el tiempo del bus mas de un periodo, se realinea */
+    if(late >= (int32_t)SAMPLE_PERIOD_US || late < -(int32_t)SAMPLE_PERIOD_US)
+    {
+      next_sample_us = bus_now - (bus_now % SAMPLE_PERIOD_US) + SAMPLE_PERIOD_US;
+    }
+    else if(late >= 0)
+    {
+      const uint32_t sample_us = next_sample_us;
+      next_sample_us = sample_us - (sample_us % SAMPLE_PERIOD_US) + SAMPLE_PERIOD_US;
+
+      /* La respuesta a las peticiones del panel se codifica al terminar cada
+       * lectura, los errores viajan en el mismo marco */
+      const sensor_error error_flags = read_sensors(&sensors_h, &temp, &rh);
+      watchdog_checkin(WATCHDOG_SENSORS);
+      can_pack_reading(temp, rh, (uint8_t)error_flags, sample_us, data);
+      can_cache_response(data, CAN_MAX_BYTES);
+      pdo_update_reading(temp, rh, (uint8_t)error_flags, sample_us);
+      aggregator_add_reading(&hcan, temp, rh, (uint8_t)error_flags, sample_us);
+      flash_log_append(data);
+      warm_save();
+      sysmem_poll();
+      if(error_flags == ALL_OK)
+      {
+        boot_mark(BOOT_FIRST_READING);
+      }
+
+      /* Un cambio en el estado de los sensores se avisa como alarma */
+      if(error_flags != last_error_flags)
+      {
+        const uint8_t alarm = (uint8_t)error_flags;
+        can_tx_send(&hcan, CAN_TX_ALARM, CAN_TX_ID(CAN_TX_ALARM_BASE), &alarm, 1, CAN_TX_NO_DEADLINE);
+        last_error_flags = error_flags;
+      }
+    }
+    else
+    {
+      /* La captura de %RH corre antes de la lectura, read_rh() la convierte */
+      if((uint32_t)-late <= RH_CAPTURE_LEAD_US)
+      {
+        sensors_arm_rh(sensors_h.htim2);
+      }
+
+      /* La configuración y el registro borran paginas solo si alcanza antes de
+       * la siguiente lectura */
+      config_poll(&hcan, (uint32_t)-late);
+      flash_log_poll(&hcan, (uint32_t)-late);
+    }
   }
   /* USER CODE END 3 */
 }
@@ -271,7 +416,7 @@ static void MX_CAN_Init(void)
   hcan.Init.SyncJumpWidth = CAN_SJW_1TQ;
   hcan.Init.TimeSeg1 = CAN_BS1_13TQ;
   hcan.Init.TimeSeg2 = CAN_BS2_2TQ;
-  hcan.Init.TimeTriggeredMode = DISABLE;
+  hcan.Init.TimeTriggeredMode = ENABLE;
   hcan.Init.AutoBusOff = DISABLE;
   hcan.Init.AutoWakeUp = DISABLE;
   hcan.Init.AutoRetransmission = DISABLE;
@@ -301,6 +446,7 @@ static void MX_TIM2_Init(void)
 
   TIM_ClockConfigTypeDef sClockSourceConfig = {0};
   TIM_MasterConfigTypeDef sMasterConfig = {0};
+  TIM_IC_InitTypeDef sConfigIC = {0};
 
   /* USER CODE BEGIN TIM2_Init 1 */
 
@@ -320,18 +466,60 @@ static void MX_TIM2_Init(void)
   {
     Error_Handler();
   }
+  if (HAL_TIM_IC_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
   sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
   sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
   if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
   {
     Error_Handler();
   }
+  sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_RISING;
+  sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 0;
+  if (HAL_TIM_IC_ConfigChannel(&htim2, &sConfigIC, TIM_CHANNEL_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE BEGIN TIM2_Init 2 */
 
   /* USER CODE END TIM2_Init 2 */
 
 }
 
+/**
+  * @brief TIM6 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM6_Init(void)
+{
+
+  /* USER CODE BEGIN TIM6_Init 0 */
+
+  /* USER CODE END TIM6_Init 0 */
+
+  /* USER CODE BEGIN TIM6_Init 1 */
+
+  /* USER CODE END TIM6_Init 1 */
+  htim6.Instance = TIM6;
+  htim6.Init.Prescaler = 47;
+  htim6.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim6.Init.Period = 65535;
+  htim6.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim6) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM6_Init 2 */
+
+  /* USER CODE END TIM6_Init 2 */
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -359,6 +547,8 @@ void Error_Handler(void)
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
   __disable_irq();
+  /* El IWDG resetea al nodo */
+  watchdog_fault();
   while (1)
   {
   }
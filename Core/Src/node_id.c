@@ -0,0 +1,292 @@
+/**
+ * @file 	node_id.c
+ * @brief	Runtime node number: claimed on the bus with the unique device ID,
+ * 		defended with heartbeats and kept in flash
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Todos los nodos usan la misma imagen. Al arrancar, el nodo toma como
+ * candidato el numero guardado en flash o, si no hay, uno derivado de su UID,
+ * y lo reclama mandando su heartbeat en CAN_TX_HEARTBEAT_BASE | numero con el
+ * UID en la carga. Si en NODE_ID_CLAIM_MS nadie reclama el mismo numero, el
+ * nodo lo adopta y lo guarda.
+ *
+ * Un conflicto se resuelve por UID, como el address claim de J1939: el UID
+ * menor conserva el numero y contesta con su heartbeat, el mayor pasa al
+ * siguiente numero sin heartbeats recientes. El conflicto puede darse tambien
+ * despues, al unir dos segmentos del bus, por eso los heartbeats de todos los
+ * nodos se revisan siempre. La misma tabla sirve para descubrir los nodos vivos.
+ *
+ * Con AutoRetransmission deshabilitado, dos reclamos simultaneos del mismo
+ * numero se destruyen entre si; la ventana lleva un retardo derivado del UID
+ * para que el siguiente intento no coincida.
+ */
+
+#include "node_id.h"
+#include "main.h"
+#include "can_tx.h"
+#include "comm_defs.h"
+
+static volatile uint8_t node = 0;
+static volatile uint8_t state = NODE_ID_CLAIMING;
+
+/* Huella de 56 bits del UID de 96 bits, viaja en los bytes 1 a 7 del heartbeat */
+static uint64_t fingerprint;
+
+static uint32_t claim_tick;
+static uint32_t claim_window;
+static uint32_t heartbeat_tick;
+
+/* Banderas del ISR para el ciclo principal */
+static volatile uint8_t lost_claim = 0;
+static volatile uint8_t defend_claim = 0;
+
+/* Tick del ultimo heartbeat de cada numero, 0 si nunca se recibió */
+static volatile uint32_t peer_seen[NODE_ID_MAX + 1];
+
+typedef struct node_id_record {
+  uint16_t magic;
+  uint16_t node;
+  uint16_t node_inverted;
+} node_id_record;
+
+static uint8_t read_stored(void)
+{
+  const node_id_record* record = (const node_id_record*)NODE_ID_FLASH_PAGE;
+
+  if(record->magic != NODE_ID_FLASH_MAGIC || (record->node ^ record->node_inverted) != 0xFFFFU ||
+     record->node == CAN_NODE_BROADCAST || record->node > NODE_ID_MAX)
+  {
+    return 0;
+  }
+  return (uint8_t)record->node;
+}
+
+/* Borra la pagina y escribe el registro. El CPU se detiene mientras se borra,
+ * solo pasa cuando cambia el numero asignado. */
+static void store(uint8_t number)
+{
+  if(read_stored() == number)
+  {
+    return;
+  }
+
+  FLASH_EraseInitTypeDef erase;
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.PageAddress = NODE_ID_FLASH_PAGE;
+  erase.NbPages = 1;
+  uint32_t page_error;
+
+  HAL_FLASH_Unlock();
+  if(HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK)
+  {
+    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, NODE_ID_FLASH_PAGE + 2U, number);
+    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, NODE_ID_FLASH_PAGE + 4U, (uint16_t)~number);
+    /* La marca al final, un corte de energía a medias deja el registro invalido */
+    HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, NODE_ID_FLASH_PAGE, NODE_ID_FLASH_MAGIC);
+  }
+  HAL_FLASH_Lock();
+}
+
+static int alive(uint8_t number, uint32_t now)
+{
+  const uint32_t seen = peer_seen[number];
+  return seen != 0U && (now - seen) < NODE_ID_PEER_TIMEOUT_MS;
+}
+
+static void start_claim(uint8_t number)
+{
+  node = number;
+  state = NODE_ID_CLAIMING;
+  claim_tick = HAL_GetTick();
+  claim_window = NODE_ID_CLAIM_MS + (uint32_t)(fingerprint & 0x3FU);
+
+  /* El reclamo sale en el siguiente node_id_poll() */
+  heartbeat_tick = claim_tick - NODE_ID_HEARTBEAT_MS;
+}
+
+/* Siguiente numero sin heartbeats recientes, el actual si todos estan ocupados */
+static uint8_t next_free(uint8_t number)
+{
+  const uint32_t now = HAL_GetTick();
+  uint8_t candidate = number;
+
+  for(uint32_t i = 0; i < NODE_ID_MAX; i++)
+  {
+    candidate = (uint8_t)(candidate % NODE_ID_MAX + 1U);
+    if(!alive(candidate, now))
+    {
+      return candidate;
+    }
+  }
+  return number;
+}
+
+static void send_heartbeat(can_handle* handle)
+{
+  uint8_t data[CAN_MAX_BYTES];
+  data[0] = state;
+  for(int i = 0; i < 7; i++)
+  {
+    data[1 + i] = (uint8_t)(fingerprint >> (8 * i));
+  }
+
+  can_tx_send(handle, CAN_TX_TELEMETRY, CAN_TX_ID(CAN_TX_HEARTBEAT_BASE), data, CAN_MAX_BYTES, NODE_ID_HEARTBEAT_MS);
+}
+
+/**
+ * @brief	Picks the first candidate and registers the heartbeat range. Must be
+ * 		called before can_health_init() and can_start(), the claim begins
+ * 		with the first node_id_poll().
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void node_id_init(can_handle* handle)
+{
+  const uint32_t* uid = (const uint32_t*)UID_BASE;
+
+  /* Palabra 0: coordenadas en la oblea, 1 y 2: numero de oblea y de lote */
+  const uint64_t folded = ((uint64_t)uid[2] << 32 | uid[1]) ^ ((uint64_t)uid[0] << 24) ^ uid[0];
+  fingerprint = folded & 0x00FFFFFFFFFFFFFFULL;
+
+  uint8_t candidate = read_stored();
+  if(candidate == 0)
+  {
+#ifdef SENSOR_OUTPUT_CAN_STD_ID
+    candidate = (uint8_t)(SENSOR_OUTPUT_CAN_STD_ID & NODE_ID_MAX);
+#endif
+  }
+  if(candidate == 0)
+  {
+    candidate = (uint8_t)(1U + (uint32_t)(fingerprint ^ (fingerprint >> 32)) % NODE_ID_MAX);
+  }
+
+  start_claim(candidate);
+
+  if(can_register_mask_handler(handle, CAN_TX_HEARTBEAT_BASE, ~CAN_NODE_ID_MASK & 0x7FFU, node_id_heartbeat) < 0)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+ * @brief	Runs the claim and sends the heartbeat. Called from the main loop.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void node_id_poll(can_handle* handle)
+{
+  const uint32_t now = HAL_GetTick();
+
+  if(lost_claim)
+  {
+    lost_claim = 0;
+    defend_claim = 0;
+    start_claim(next_free(node));
+  }
+
+  if(state == NODE_ID_CLAIMING && (now - claim_tick) >= claim_window)
+  {
+    state = NODE_ID_ACTIVE;
+    store(node);
+    heartbeat_tick = now - NODE_ID_HEARTBEAT_MS;
+  }
+
+  if(defend_claim || (now - heartbeat_tick) >= NODE_ID_HEARTBEAT_MS)
+  {
+    defend_claim = 0;
+    heartbeat_tick = now;
+    send_heartbeat(handle);
+  }
+}
+
+/**
+ * @brief	Gets the node number, the candidate while the claim is running
+ * @param	None
+ *
+ * @retval	Node number, 1 to NODE_ID_MAX
+ */
+uint8_t node_id_get(void)
+{
+  return node;
+}
+
+/**
+ * @brief	Gets the address of the node number, for the object dictionary
+ * @param	None
+ *
+ * @retval	Address of the node number
+ */
+const volatile uint8_t* node_id_location(void)
+{
+  return &node;
+}
+
+/**
+ * @brief	Tells if the claim is over and the node number is in use
+ * @param	None
+ *
+ * @retval	1 if claimed, 0 while claiming
+ */
+int node_id_is_claimed(void)
+{
+  return state == NODE_ID_ACTIVE;
+}
+
+/**
+ * @brief	Tells if another node sent a heartbeat with a number recently
+ * @param	uint8_t: Node number
+ *
+ * @retval	1 if alive, 0 if not
+ */
+int node_id_peer_alive(uint8_t number)
+{
+  if(number == CAN_NODE_BROADCAST || number > NODE_ID_MAX)
+  {
+    return 0;
+  }
+  return alive(number, HAL_GetTick());
+}
+
+/**
+ * @brief	Handler of the heartbeat range, called from the RX interrupt. Payload:
+ * 		[0] node_id_state [1..7] fingerprint of the unique device ID, little endian
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the heartbeat
+ *
+ * @retval	None
+ */
+void node_id_heartbeat(can_handle* handle, const can_rx_view* frame)
+{
+  (void)handle;
+  if(can_view_dlc(frame) < 8)
+  {
+    return;
+  }
+
+  const uint8_t number = (uint8_t)(can_view_std_id(frame) & CAN_NODE_ID_MASK);
+  const uint64_t other = ((uint64_t)can_view_high_word(frame) << 24) | (can_view_low_word(frame) >> 8);
+
+  const uint32_t now = HAL_GetTick();
+  peer_seen[number] = (now != 0U) ? now : 1U;
+
+  if(number != node || other == fingerprint)
+  {
+    return;
+  }
+
+  /* Dos nodos con el mismo numero, gana el UID menor */
+  if(other < fingerprint)
+  {
+    lost_claim = 1;
+  }
+  else
+  {
+    defend_claim = 1;
+  }
+}
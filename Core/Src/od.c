@@ -0,0 +1,329 @@
+/**
+ * @file 	od.c
+ * @brief	Object dictionary: indexed parameters and measurements of the node,
+ * 		read and written by the control panel over CAN
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * El indice es la posición en la tabla, la búsqueda es de tiempo constante y
+ * las peticiones se contestan en el ISR de recepción, sin pasar por el ciclo
+ * principal. Cada transferencia lleva hasta OD_VALUE_BYTES bytes en un solo
+ * marco, como una transferencia expedita de CANopen.
+ *
+ * Los accesos usan el tamaño del tipo de la entrada, con direcciones alineadas,
+ * asi que una lectura o escritura de 32 bits es atómica respecto al ciclo
+ * principal.
+ */
+
+#include "od.h"
+#include "pdo.h"
+#include "can_health.h"
+#include "can_tx.h"
+#include "node_id.h"
+#include "flash_log.h"
+#include "crc.h"
+#include "sysmem.h"
+#include "boot.h"
+#include "warm.h"
+#include "watchdog.h"
+#include "sensors.h"
+
+static od_entry entries[OD_SIZE];
+
+static const uint8_t type_size[] = { 1, 2, 4, 2, 4 };
+
+/* Las variables de solo lectura de otros modulos se exponen sin const */
+static void register_var(uint8_t index, pdo_var var, od_type type)
+{
+  uint8_t size;
+  const void* address = pdo_get_var(var, &size);
+  od_register(index, (volatile void*)address, type, 1, OD_RO, 0, 0);
+}
+
+/**
+ * @brief	Registers the entries of the node. Must be called after pdo_init().
+ * @param	None
+ *
+ * @retval	None
+ */
+void od_init(void)
+{
+  const can_health_stats* health = can_health_get_stats();
+  const flash_log_stats* log = flash_log_get_stats();
+  const crc_stats* crc = crc_get_stats();
+  const sysmem_stats* mem = sysmem_get_stats();
+  const boot_stats* boot = boot_get_stats();
+  const warm_stats* warm = warm_get_stats();
+  const watchdog_stats* watchdog = watchdog_get_stats();
+  const sensors_stats* sensors = sensors_get_stats();
+
+  od_register(OD_NODE_ID, (volatile void*)node_id_location(), OD_U8, 1, OD_RO, 0, 0);
+
+  /* Los parametros de los sensores los registra config.c, viven en la copia
+   * activa de la configuración */
+
+  register_var(OD_READING_TEMP, PDO_VAR_TEMP, OD_I16);
+  register_var(OD_READING_RH, PDO_VAR_RH, OD_U16);
+  register_var(OD_READING_FLAGS, PDO_VAR_ERROR_FLAGS, OD_U8);
+  register_var(OD_READING_TIME, PDO_VAR_SAMPLE_TIME, OD_U32);
+
+  od_register(OD_CAN_TEC, (volatile void*)&health->tec, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_REC, (volatile void*)&health->rec, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_STATE, (volatile void*)&health->state, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_BUS_LOAD, (volatile void*)&health->bus_load, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_RX_FRAMES, (volatile void*)&health->rx_frames, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_TX_FRAMES, (volatile void*)&health->tx_frames, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_CAN_TX_DROPPED, (volatile void*)&health->tx_dropped, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_LOG_RECORDS, (volatile void*)&log->records, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_LOG_ENCODED_BITS, (volatile void*)&log->encoded_bits, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_LOG_ENCODE_CYCLES, (volatile void*)&log->encode_cycles_last, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_LOG_ENCODE_CYCLES_MAX, (volatile void*)&log->encode_cycles_max, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_CRC_MODE, (volatile void*)&crc->mode, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_CRC_SOFTWARE_CYCLES, (volatile void*)&crc->software_cycles, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_CRC_HARDWARE_CYCLES, (volatile void*)&crc->hardware_cycles, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_CRC_DMA_CYCLES, (volatile void*)&crc->dma_cycles, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_SENSOR_RH_CYCLES, (volatile void*)&sensors->rh_cycles_last, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_SENSOR_RH_CYCLES_MAX, (volatile void*)&sensors->rh_cycles_max, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_MEM_STACK_PEAK, (volatile void*)&mem->stack_peak, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_MEM_STACK_RESERVED, (volatile void*)&mem->stack_reserved, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_MEM_HEAP_PEAK, (volatile void*)&mem->heap_peak, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_MEM_HEAP_FAILURES, (volatile void*)&mem->heap_failures, OD_U32, 1, OD_RO, 0, 0);
+  od_register(OD_MEM_FREE_MIN, (volatile void*)&mem->free_min, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_BOOT_PHASES, (volatile void*)boot->phases, OD_U32, BOOT_PHASES, OD_RO, 0, 0);
+  od_register(OD_BOOT_RESET_FLAGS, (volatile void*)&boot->reset_flags, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_WARM_RESTARTS, (volatile void*)&warm->restarts, OD_U32, 1, OD_RO, 0, 0);
+
+  od_register(OD_WATCHDOG_MISSED, (volatile void*)&watchdog->missed, OD_U8, 1, OD_RO, 0, 0);
+  od_register(OD_WATCHDOG_RESETS, (volatile void*)&watchdog->resets, OD_U32, 1, OD_RO, 0, 0);
+
+  can_register_command(CAN_CMD_OD_READ, od_command);
+  can_register_command(CAN_CMD_OD_WRITE, od_command);
+}
+
+/**
+ * @brief	Adds an entry to the dictionary
+ * @param	uint8_t: Index, up to OD_SIZE
+ * @param	void*: Address of the variable or of the first element of the array,
+ * 		aligned to the size of its type
+ * @param	od_type: Type of the variable
+ * @param	uint8_t: Number of elements, 1 for a variable
+ * @param	od_access: Access rights
+ * @param	int32_t: Smallest value accepted by a write
+ * @param	int32_t: Largest value accepted by a write
+ *
+ * @retval	0 if registered, -1 if the index is not valid
+ */
+int od_register(uint8_t index, volatile void* address, od_type type, uint8_t count,
+                od_access access, int32_t min, int32_t max)
+{
+  if(index >= OD_SIZE || address == NULL || count == 0)
+  {
+    return -1;
+  }
+
+  od_entry* entry = &entries[index];
+  entry->address = address;
+  entry->hook = NULL;
+  entry->min = min;
+  entry->max = max;
+  entry->type = type;
+  entry->access = access;
+  entry->count = count;
+
+  return 0;
+}
+
+/**
+ * @brief	Sends the writes of a registered entry to a function instead of
+ * 		storing them, after the access and range checks. od_register()
+ * 		clears it.
+ * @param	uint8_t: Index, registered with OD_RW
+ * @param	od_write_hook: Function that takes the write
+ *
+ * @retval	0 if set, -1 if the index is not registered
+ */
+int od_set_write_hook(uint8_t index, od_write_hook hook)
+{
+  if(index >= OD_SIZE || entries[index].address == NULL)
+  {
+    return -1;
+  }
+
+  entries[index].hook = hook;
+  return 0;
+}
+
+static volatile void* element(const od_entry* entry, uint8_t subindex)
+{
+  return (volatile uint8_t*)entry->address + subindex * type_size[entry->type];
+}
+
+/**
+ * @brief	Reads an entry
+ * @param	uint8_t: Index
+ * @param	uint8_t: Subindex, 0 for a variable
+ * @param	uint32_t*: Where to store the value, sign extended for signed types
+ *
+ * @retval	OD_OK or the reason of the failure
+ */
+od_status od_read(uint8_t index, uint8_t subindex, uint32_t* value)
+{
+  if(index >= OD_SIZE || entries[index].address == NULL || subindex >= entries[index].count)
+  {
+    return OD_NO_ENTRY;
+  }
+
+  const od_entry* entry = &entries[index];
+  volatile void* address = element(entry, subindex);
+
+  switch(entry->type)
+  {
+    case OD_U8:
+      *value = *(volatile uint8_t*)address;
+      break;
+    case OD_U16:
+      *value = *(volatile uint16_t*)address;
+      break;
+    case OD_I16:
+      *value = (uint32_t)(int32_t)*(volatile int16_t*)address;
+      break;
+    default:
+      /* OD_U32 y OD_F32, el flotante viaja con su representación IEEE 754 */
+      *value = *(volatile uint32_t*)address;
+      break;
+  }
+
+  return OD_OK;
+}
+
+/**
+ * @brief	Writes an entry
+ * @param	uint8_t: Index
+ * @param	uint8_t: Subindex, 0 for a variable
+ * @param	uint32_t: New value, in the representation of od_read()
+ *
+ * @retval	OD_OK or the reason of the failure
+ */
+od_status od_write(uint8_t index, uint8_t subindex, uint32_t value)
+{
+  if(index >= OD_SIZE || entries[index].address == NULL || subindex >= entries[index].count)
+  {
+    return OD_NO_ENTRY;
+  }
+
+  const od_entry* entry = &entries[index];
+  if(entry->access != OD_RW)
+  {
+    return OD_READ_ONLY;
+  }
+
+  if(entry->type != OD_F32 && entry->min < entry->max)
+  {
+    /* Las entradas sin signo usan rangos no negativos */
+    const int out = (entry->type == OD_I16) ?
+        ((int32_t)value < entry->min || (int32_t)value > entry->max) :
+        (value < (uint32_t)entry->min || value > (uint32_t)entry->max);
+    if(out)
+    {
+      return OD_OUT_OF_RANGE;
+    }
+  }
+
+  volatile void* address = element(entry, subindex);
+
+  if(entry->hook != NULL)
+  {
+    return entry->hook(address, value);
+  }
+
+  switch(entry->type)
+  {
+    case OD_U8:
+      if(value > 0xFFU)
+      {
+        return OD_OUT_OF_RANGE;
+      }
+      *(volatile uint8_t*)address = (uint8_t)value;
+      break;
+    case OD_U16:
+      if(value > 0xFFFFU)
+      {
+        return OD_OUT_OF_RANGE;
+      }
+      *(volatile uint16_t*)address = (uint16_t)value;
+      break;
+    case OD_I16:
+      if((int32_t)value < INT16_MIN || (int32_t)value > INT16_MAX)
+      {
+        return OD_OUT_OF_RANGE;
+      }
+      *(volatile int16_t*)address = (int16_t)value;
+      break;
+    default:
+      *(volatile uint32_t*)address = value;
+      break;
+  }
+
+  return OD_OK;
+}
+
+/**
+ * @brief	Handler of CAN_CMD_OD_READ and CAN_CMD_OD_WRITE, answered from the RX
+ * 		interrupt. Payload:
+ * 		[1] node number, CAN_NODE_BROADCAST for every node [2] index [3] subindex
+ * 		[4..7] value to write, little endian, only in CAN_CMD_OD_WRITE
+ * 		The answer goes on the response identifier as [0] command [1] index
+ * 		[2] subindex [3] od_status [4..7] value read back, little endian.
+ * 		A write taken by a hook is answered with OD_PENDING and the value in
+ * 		use; the configuration answers again when it is applied.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void od_command(can_handle* handle, const can_rx_view* frame)
+{
+  const uint8_t code = can_view_byte(frame, 0);
+  if(can_view_dlc(frame) < ((code == CAN_CMD_OD_WRITE) ? 8 : 4))
+  {
+    return;
+  }
+
+  const uint8_t node = can_view_byte(frame, 1);
+  if(node != CAN_NODE_BROADCAST && node != node_id_get())
+  {
+    return;
+  }
+
+  const uint8_t index = can_view_byte(frame, 2);
+  const uint8_t subindex = can_view_byte(frame, 3);
+  uint32_t value = 0;
+  od_status status = OD_OK;
+
+  if(code == CAN_CMD_OD_WRITE)
+  {
+    status = od_write(index, subindex, can_view_high_word(frame));
+  }
+  if(status == OD_OK)
+  {
+    status = od_read(index, subindex, &value);
+  }
+  else if(status == OD_PENDING)
+  {
+    (void)od_read(index, subindex, &value);
+  }
+
+  const uint8_t reply[CAN_MAX_BYTES] = {
+    code, index, subindex, (uint8_t)status,
+    (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)
+  };
+  can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), reply, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+}
@@ -0,0 +1,573 @@
+/**
+ * @file 	pdo.c
+ * @brief	Process data frames: configurable mapping of variables into frames,
+ * 		sent cyclically, on change or on request
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Cada marco de datos de proceso (PDO) tiene un identificador, un modo de
+ * transmisión y una lista de variables con su posición en el marco. El panel
+ * cambia la configuración con CAN_CMD_PDO_CONFIG sin reiniciar el nodo.
+ *
+ * Los marcos cíclicos y por cambio salen como telemetría desde pdo_poll(), en
+ * el ciclo principal. Los marcos por RTR se codifican en el ciclo principal y
+ * el ISR de recepción solo copia la imagen ya armada, igual que can_answer_poll().
+ * Los cambios de configuración que llegan en el ISR se validan ahí, para poder
+ * contestar, y se aplican al inicio del siguiente pdo_poll(). Los filtros de
+ * RTR también se registran ahí: programar un banco no se hace desde el ISR.
+ */
+
+#include "pdo.h"
+#include "main.h"
+#include "can_health.h"
+#include "can_tx.h"
+#include "config.h"
+#include "aggregator.h"
+
+/* Variables disponibles para el mapeo, en el formato del bus */
+static int16_t reading_temp;
+static uint16_t reading_rh;
+static uint8_t reading_flags;
+static uint32_t reading_time;
+static uint32_t reading_time_256us;
+
+typedef struct pdo_var_info {
+  const void* address;
+  uint8_t size;
+} pdo_var_info;
+
+static pdo_var_info vars[PDO_VAR_COUNT];
+
+static pdo_config configs[PDO_MAX];
+
+/* Cambios recibidos del panel, se aplican en el ciclo principal */
+static pdo_config pending[PDO_MAX];
+static volatile uint8_t pending_mask = 0;
+
+/* Estado de transmisión de cada marco */
+static uint32_t last_tick[PDO_MAX];
+static uint8_t last_data[PDO_MAX][CAN_MAX_BYTES];
+static uint8_t sent_once[PDO_MAX];
+
+/* Imagen de las respuestas a RTR, con doble buffer como en can.c */
+static can_tx_image rtr_cache[PDO_MAX][2];
+static volatile uint8_t rtr_index[PDO_MAX];
+static volatile uint8_t rtr_valid[PDO_MAX];
+
+/* Identificadores con filtro de RTR ya registrado, los filtros no se liberan */
+static uint16_t rtr_ids[PDO_MAX];
+static int rtr_id_count = 0;
+
+/* Numero de nodo incluido en los identificadores actuales */
+static uint8_t mapped_node;
+
+static int register_rtr(can_handle* handle, uint16_t std_id);
+static void send_reply(can_handle* handle, uint8_t pdo, pdo_reply result);
+static void config_applied(can_handle* handle, const config_values* previous);
+
+/**
+ * @brief	Sets the variables and the default mapping. PDO 0 carries the reading
+ * 		in the layout of can_pack_reading(), disabled until the panel enables it.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void pdo_init(can_handle* handle)
+{
+  (void)handle;
+  const can_health_stats* health = can_health_get_stats();
+
+  vars[PDO_VAR_TEMP] = (pdo_var_info){ &reading_temp, sizeof(reading_temp) };
+  vars[PDO_VAR_RH] = (pdo_var_info){ &reading_rh, sizeof(reading_rh) };
+  vars[PDO_VAR_ERROR_FLAGS] = (pdo_var_info){ &reading_flags, sizeof(reading_flags) };
+  vars[PDO_VAR_SAMPLE_TIME] = (pdo_var_info){ &reading_time, sizeof(reading_time) };
+  vars[PDO_VAR_SAMPLE_TIME_256US] = (pdo_var_info){ &reading_time_256us, sizeof(reading_time_256us) };
+  vars[PDO_VAR_TEC] = (pdo_var_info){ &health->tec, sizeof(health->tec) };
+  vars[PDO_VAR_REC] = (pdo_var_info){ &health->rec, sizeof(health->rec) };
+  vars[PDO_VAR_BUS_LOAD] = (pdo_var_info){ &health->bus_load, sizeof(health->bus_load) };
+
+  const pdo_config reading = {
+    .std_id = CAN_TX_ID(config_get()->telemetry_base),
+    .mode = PDO_OFF,
+    .entry_count = 4,
+    .period_ms = 1000,
+    .inhibit_ms = 100,
+    .entries = {
+      { PDO_VAR_TEMP, 0, 2 },
+      { PDO_VAR_RH, 2, 2 },
+      { PDO_VAR_ERROR_FLAGS, 4, 1 },
+      { PDO_VAR_SAMPLE_TIME_256US, 5, 3 }
+    }
+  };
+  mapped_node = node_id_get();
+  pdo_configure(0, &reading);
+
+  can_register_command(CAN_CMD_PDO_CONFIG, pdo_command);
+  if(config_register_hook(config_applied) != 0)
+  {
+    Error_Handler();
+  }
+}
+
+/* Cambia el identificador de un PDO, con su filtro de RTR */
+static void move_id(can_handle* handle, int pdo, uint16_t std_id)
+{
+  pdo_config* config = &configs[pdo];
+
+  rtr_valid[pdo] = 0;
+  config->std_id = std_id;
+  sent_once[pdo] = 0;
+  if(config->mode == PDO_ON_RTR && register_rtr(handle, config->std_id) != 0)
+  {
+    config->mode = PDO_OFF;
+  }
+}
+
+/* Los PDO en el identificador de las lecturas, como el 0, pasan al rango nuevo */
+static void config_applied(can_handle* handle, const config_values* previous)
+{
+  const uint16_t from = (uint16_t)(previous->telemetry_base | mapped_node);
+  const uint16_t to = (uint16_t)(config_get()->telemetry_base | mapped_node);
+  if(from == to)
+  {
+    return;
+  }
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    if(configs[pdo].std_id == from)
+    {
+      move_id(handle, pdo, to);
+    }
+  }
+}
+
+/**
+ * @brief	Updates the reading variables, called after every sample
+ * @param	float: Temperature in degrees Celsius
+ * @param	float: RH in percent
+ * @param	uint8_t: Error flags of the reading
+ * @param	uint32_t: Bus time at which the sample was taken
+ *
+ * @retval	None
+ */
+void pdo_update_reading(float temp, float rh, uint8_t error_flags, uint32_t sample_us)
+{
+  reading_temp = can_centi_signed(temp);
+  reading_rh = can_centi_unsigned(rh);
+  reading_flags = error_flags;
+  reading_time = sample_us;
+  reading_time_256us = sample_us >> 8;
+}
+
+/* Arma el contenido del marco, devuelve el número de bytes usados */
+static int encode(const pdo_config* config, uint8_t* data)
+{
+  int bytes = 0;
+
+  for(int i = 0; i < CAN_MAX_BYTES; i++)
+  {
+    data[i] = 0;
+  }
+
+  for(int i = 0; i < config->entry_count; i++)
+  {
+    const pdo_entry* entry = &config->entries[i];
+    const uint8_t* source = (const uint8_t*)vars[entry->var].address;
+
+    /* Cortex-M0 es little endian, igual que el bus */
+    for(int b = 0; b < entry->size; b++)
+    {
+      data[entry->offset + b] = source[b];
+    }
+
+    if(entry->offset + entry->size > bytes)
+    {
+      bytes = entry->offset + entry->size;
+    }
+  }
+
+  return bytes;
+}
+
+static void remember(int pdo, const uint8_t* data, uint32_t tick)
+{
+  for(int i = 0; i < CAN_MAX_BYTES; i++)
+  {
+    last_data[pdo][i] = data[i];
+  }
+  last_tick[pdo] = tick;
+  sent_once[pdo] = 1;
+}
+
+static int same_data(const uint8_t* a, const uint8_t* b)
+{
+  for(int i = 0; i < CAN_MAX_BYTES; i++)
+  {
+    if(a[i] != b[i])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief	Sends the cyclic and on-change frames that are due and refreshes the
+ * 		answers to RTR requests. Called from the main loop.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	None
+ */
+void pdo_poll(can_handle* handle)
+{
+  uint8_t data[CAN_MAX_BYTES];
+
+  /* Los identificadores que llevan el numero del nodo se mueven con él si el
+   * reclamo termina en otro numero */
+  const uint8_t number = node_id_get();
+  if(number != mapped_node)
+  {
+    for(int pdo = 0; pdo < PDO_MAX; pdo++)
+    {
+      const uint16_t std_id = configs[pdo].std_id;
+      if((std_id & CAN_NODE_ID_MASK) == mapped_node)
+      {
+        move_id(handle, pdo, (uint16_t)((std_id & ~CAN_NODE_ID_MASK) | number));
+      }
+    }
+    mapped_node = number;
+  }
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    if(pending_mask & (1U << pdo))
+    {
+      const uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      pdo_config config = pending[pdo];
+      pending_mask &= ~(1U << pdo);
+      __set_PRIMASK(primask);
+
+      /* Sin filtro no llegarian los RTR, queda la configuración anterior y
+       * el panel recibe un segundo resultado con el error */
+      if(config.mode == PDO_ON_RTR && register_rtr(handle, config.std_id) != 0)
+      {
+        send_reply(handle, pdo, PDO_REPLY_NO_FILTER);
+        continue;
+      }
+
+      pdo_configure(pdo, &config);
+    }
+  }
+
+  const uint32_t now = HAL_GetTick();
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    const pdo_config* config = &configs[pdo];
+    if(config->mode == PDO_OFF || config->entry_count == 0)
+    {
+      continue;
+    }
+
+    const int bytes = encode(config, data);
+    const int changed = !sent_once[pdo] || !same_data(data, last_data[pdo]);
+    const uint32_t elapsed = now - last_tick[pdo];
+
+    if(config->mode == PDO_ON_RTR)
+    {
+      if(changed)
+      {
+        const uint8_t next = rtr_index[pdo] ^ 1U;
+        can_tx_build_image(config->std_id, data, bytes, &rtr_cache[pdo][next]);
+        rtr_index[pdo] = next;
+        rtr_valid[pdo] = 1;
+        remember(pdo, data, last_tick[pdo]);
+      }
+      continue;
+    }
+
+    /* Reclamado por un agregador, la lectura solo va a él (ver aggregator.c) */
+    if(aggregator_is_claimed())
+    {
+      continue;
+    }
+
+    const int send = (config->mode == PDO_CYCLIC) ? (elapsed >= config->period_ms)
+                                                  : (changed && elapsed >= config->inhibit_ms);
+    if(!send)
+    {
+      continue;
+    }
+
+    /* Un marco cíclico vence al llegar el siguiente */
+    const uint32_t deadline = (config->mode == PDO_CYCLIC) ? config->period_ms : CAN_TX_TELEMETRY_DEADLINE_MS;
+    if(can_tx_send(handle, CAN_TX_TELEMETRY, config->std_id, data, bytes, deadline) != 0)
+    {
+      can_health_count_drop();
+    }
+
+    /* Los cíclicos avanzan un periodo desde el vencimiento anterior, asi el
+     * retardo del ciclo principal no se acumula. Atrasados mas de un periodo
+     * se alinean con el tiempo actual en vez de mandar una ráfaga */
+    uint32_t tick = now;
+    if(config->mode == PDO_CYCLIC && elapsed < 2U * config->period_ms)
+    {
+      tick = last_tick[pdo] + config->period_ms;
+    }
+    remember(pdo, data, tick);
+  }
+}
+
+/**
+ * @brief	Gets the address of a mappable variable, little endian
+ * @param	pdo_var: Variable
+ * @param	uint8_t*: Where to store the size in bytes of the variable
+ *
+ * @retval	Address of the variable, NULL if it doesn't exist
+ */
+const void* pdo_get_var(pdo_var var, uint8_t* size)
+{
+  if(var >= PDO_VAR_COUNT)
+  {
+    return NULL;
+  }
+  *size = vars[var].size;
+  return vars[var].address;
+}
+
+/* Mismas reglas para la configuración local y la del panel */
+static int validate(int pdo, const pdo_config* config)
+{
+  if(pdo < 0 || pdo >= PDO_MAX || config->mode > PDO_ON_RTR ||
+     config->entry_count > PDO_MAX_ENTRIES || config->std_id > 0x7FFU)
+  {
+    return -1;
+  }
+
+  /* Un periodo de 0 mandaria el marco en cada vuelta del ciclo principal */
+  if(config->mode == PDO_CYCLIC && config->period_ms < PDO_MIN_PERIOD_MS)
+  {
+    return -1;
+  }
+
+  /* Solo identificadores con el numero de este nodo, fuera de los rangos de
+   * alarmas, respuestas, heartbeat y las demas clases */
+  if((config->std_id & CAN_NODE_ID_MASK) != mapped_node ||
+     config_base_reserved(config->std_id & ~CAN_NODE_ID_MASK))
+  {
+    return -1;
+  }
+
+  for(int i = 0; i < config->entry_count; i++)
+  {
+    const pdo_entry* entry = &config->entries[i];
+    if(entry->var >= PDO_VAR_COUNT || entry->size == 0 ||
+       entry->size > vars[entry->var].size || entry->offset + entry->size > CAN_MAX_BYTES)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief	Replaces the configuration of a frame, called from the main loop
+ * @param	int: Frame number, up to PDO_MAX
+ * @param	pdo_config*: New configuration
+ *
+ * @retval	0 if applied, -1 if the configuration is not valid
+ */
+int pdo_configure(int pdo, const pdo_config* config)
+{
+  if(validate(pdo, config) != 0)
+  {
+    return -1;
+  }
+
+  /* El ISR no contesta mientras cambia la configuración */
+  rtr_valid[pdo] = 0;
+  configs[pdo] = *config;
+  sent_once[pdo] = 0;
+  last_tick[pdo] = HAL_GetTick();
+
+  return 0;
+}
+
+/**
+ * @brief	Gets the configuration of a frame
+ * @param	int: Frame number, up to PDO_MAX
+ *
+ * @retval	Pointer to the configuration, NULL if the number is not valid
+ */
+const pdo_config* pdo_get_config(int pdo)
+{
+  if(pdo < 0 || pdo >= PDO_MAX)
+  {
+    return NULL;
+  }
+  return &configs[pdo];
+}
+
+/* Contesta un CAN_CMD_PDO_CONFIG */
+static void send_reply(can_handle* handle, uint8_t pdo, pdo_reply result)
+{
+  const uint8_t reply[3] = { CAN_CMD_PDO_CONFIG, pdo, (uint8_t)result };
+  can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), reply, sizeof(reply), CAN_TX_RESPONSE_DEADLINE_MS);
+}
+
+/* Registra el filtro de RTR de un identificador, una sola vez. Desde el ciclo
+ * principal o antes de arrancar el periférico */
+static int register_rtr(can_handle* handle, uint16_t std_id)
+{
+  for(int i = 0; i < rtr_id_count; i++)
+  {
+    if(rtr_ids[i] == std_id)
+    {
+      return 0;
+    }
+  }
+
+  if(rtr_id_count >= PDO_MAX || can_register_handler(handle, std_id, CAN_RTR_REMOTE, pdo_answer_rtr) < 0)
+  {
+    return -1;
+  }
+
+  rtr_ids[rtr_id_count++] = std_id;
+  return 0;
+}
+
+/**
+ * @brief	Applies a configuration kept across a warm restart, see warm.c. A
+ * 		frame in PDO_ON_RTR mode gets its filter for remote requests again,
+ * 		call it before the peripheral starts.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	int: Frame number, up to PDO_MAX
+ * @param	pdo_config*: Configuration
+ *
+ * @retval	0 if applied, -1 if the configuration is not valid
+ */
+int pdo_restore(can_handle* handle, int pdo, const pdo_config* config)
+{
+  if(validate(pdo, config) != 0 ||
+     (config->mode == PDO_ON_RTR && register_rtr(handle, config->std_id) != 0))
+  {
+    return -1;
+  }
+
+  return pdo_configure(pdo, config);
+}
+
+/**
+ * @brief	Handler of CAN_CMD_PDO_CONFIG, called from the RX interrupt. The change
+ * 		is only validated here and applied by pdo_poll(), which also registers
+ * 		the filter for remote requests of a frame in PDO_ON_RTR mode. Payload:
+ * 		[1] node number, CAN_NODE_BROADCAST for every node [2] frame number
+ * 		[3] pdo_subcommand, followed by
+ * 		PDO_CMD_COMM: [4..5] identifier [6] pdo_mode [7] number of entries
+ * 		PDO_CMD_TIMING: [4..5] period in ms [6..7] inhibit time in ms
+ * 		PDO_CMD_MAP: [4] entry [5] pdo_var [6] offset [7] size
+ * 		All fields are little endian. The result is answered on the response
+ * 		identifier as [0] CAN_CMD_PDO_CONFIG [1] frame number [2] pdo_reply. If
+ * 		no filter is left pdo_poll() answers again with PDO_REPLY_NO_FILTER.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void pdo_command(can_handle* handle, const can_rx_view* frame)
+{
+  if(can_view_dlc(frame) < 8)
+  {
+    return;
+  }
+
+  const uint8_t node = can_view_byte(frame, 1);
+  if(node != CAN_NODE_BROADCAST && node != node_id_get())
+  {
+    return;
+  }
+
+  const uint8_t pdo = can_view_byte(frame, 2);
+  int result = -1;
+
+  if(pdo < PDO_MAX)
+  {
+    /* Varios comandos seguidos se acumulan sobre el cambio pendiente */
+    pdo_config config = (pending_mask & (1U << pdo)) ? pending[pdo] : configs[pdo];
+
+    switch(can_view_byte(frame, 3))
+    {
+      case PDO_CMD_COMM:
+        config.std_id = can_view_byte(frame, 4) | (can_view_byte(frame, 5) << 8);
+        config.mode = can_view_byte(frame, 6);
+        config.entry_count = can_view_byte(frame, 7);
+        result = 0;
+        break;
+      case PDO_CMD_TIMING:
+        config.period_ms = can_view_byte(frame, 4) | (can_view_byte(frame, 5) << 8);
+        config.inhibit_ms = can_view_byte(frame, 6) | (can_view_byte(frame, 7) << 8);
+        result = 0;
+        break;
+      case PDO_CMD_MAP:
+        if(can_view_byte(frame, 4) < PDO_MAX_ENTRIES)
+        {
+          pdo_entry* entry = &config.entries[can_view_byte(frame, 4)];
+          entry->var = can_view_byte(frame, 5);
+          entry->offset = can_view_byte(frame, 6);
+          entry->size = can_view_byte(frame, 7);
+          result = 0;
+        }
+        break;
+      default:
+        break;
+    }
+
+    if(result == 0)
+    {
+      result = validate(pdo, &config);
+    }
+    if(result == 0)
+    {
+      pending[pdo] = config;
+      pending_mask |= (1U << pdo);
+    }
+  }
+
+  send_reply(handle, pdo, (result == 0) ? PDO_REPLY_ACCEPTED : PDO_REPLY_INVALID);
+}
+
+/**
+ * @brief	Answers a remote request for a frame in PDO_ON_RTR mode, called from the
+ * 		RX interrupt
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the request
+ *
+ * @retval	None
+ */
+void pdo_answer_rtr(can_handle* handle, const can_rx_view* frame)
+{
+  const uint32_t std_id = can_view_std_id(frame);
+
+  if(aggregator_is_claimed())
+  {
+    return;
+  }
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    if(configs[pdo].mode == PDO_ON_RTR && configs[pdo].std_id == std_id && rtr_valid[pdo])
+    {
+      if(can_tx_send_image(handle, CAN_TX_RESPONSE, &rtr_cache[pdo][rtr_index[pdo]],
+                           CAN_TX_RESPONSE_DEADLINE_MS, CAN_TX_NO_TAG) != 0)
+      {
+        can_health_count_drop();
+      }
+    }
+  }
+}
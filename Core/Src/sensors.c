@@ -16,7 +16,38 @@
  */
 
 #include "sensors.h"
+#include "main.h"
 #include "stm32f0xx_it.h"
+#include "timebase.h"
+#include "config.h"
+#include "trace.h"
+#include "commissioning.h"
+#include "isr_profile.h"
+
+/* La LUT y las constantes del ADC se leen de la configuración en flash, ver
+ * config.c. Como se menciono en la documentación, la LUT se da en intervalos
+ * de 5 en 5 de %RH, desde el 0 al 100. Se calibra desde el panel.
+ */
+
+static sensors_stats stats;
+
+/* Paso de la captura de %RH, lo sigue sensors_tim_irq() sin los callbacks de
+ * la HAL */
+static volatile enum {
+  CAPTURE_IDLE,
+  CAPTURE_ARMED, /* Esperando el primer flanco, que arranca el timer */
+  CAPTURE_RUNNING
+} capture_state = CAPTURE_IDLE;
+
+/* Hay una captura completa en timer_samples */
+static volatile uint8_t captured = 0;
+
+/* El ultimo flanco en ciclos de CPU, lo lee TIM2_IRQHandler() para la latencia */
+static uint32_t edge_cycles;
+static uint8_t edge_seen = 0;
+
+/* timebase_now_us() al armar la captura */
+static uint32_t armed_us;
 
 /* ESTOY CONSIDERANDO CAMBIAR QUE RETORNEN POR COPIA, NO POR REFERENCIA, PARA ASI
  * EVITAR HACIENDO DEREFERENCIAS CONSTANTES, O DE OTRA FORMA, ALMACENARLO EN
@@ -39,7 +70,7 @@ sensor_error read_sensors(sensors_handle* handle, float* temp, float* rh)
 {
   
   temp_error temp_read_error = read_temp(&handle->adc, temp);
-  hum_error rh_read_error = read_rh(&handle->htim2, rh);
+  hum_error rh_read_error = read_rh(handle->htim2, rh);
 
   sensor_error sensor_error_flags = ALL_OK;
   if(temp_read_error != TEMP_OK) {
@@ -91,7 +122,7 @@ temp_error read_temp_adc(adc_handle* handle, float* temp)
 {
   if (HAL_ADC_Start(handle) == HAL_BUSY)
   {
-    printf("ADC busy, can't read.\n");
+    TRACE(TRACE_ADC_BUSY, 0);
     return TEMP_ADC_FAIL;
   }
   else
@@ -104,25 +135,25 @@ temp_error read_temp_adc(adc_handle* handle, float* temp)
 
     //READ V_REF ADC
     int v_ref_read;
-    if(HAL_ADC_PollForConversion(handle, ADC_TIMEOUT) == HAL_OK)
+    if(HAL_ADC_PollForConversion(handle, config_get()->adc_timeout_ms) == HAL_OK)
     {
       v_ref_read = HAL_ADC_GetValue(handle);
     }
     else
     {
-      printf("ADC Timed out reading Vref\n");
+      TRACE(TRACE_ADC_VREF_TIMEOUT, config_get()->adc_timeout_ms);
       return TEMP_ADC_FAIL;
     }
 
     //READ LM35 ADC
     int temp_reading;
-    if(HAL_ADC_PollForConversion(handle, ADC_TIMEOUT) == HAL_OK)
+    if(HAL_ADC_PollForConversion(handle, config_get()->adc_timeout_ms) == HAL_OK)
     {
       temp_reading = HAL_ADC_GetValue(handle);
     }
     else
     {
-      printf("ADC Timed out reading external temp sensor\n");
+      TRACE(TRACE_ADC_TEMP_TIMEOUT, config_get()->adc_timeout_ms);
       return TEMP_ADC_FAIL;
     }
 
@@ -131,15 +162,19 @@ temp_error read_temp_adc(adc_handle* handle, float* temp)
     //del 7 de abril de 2021
     //constexpr se especifica en el estandar C++11
     const float v_supply_sqr = 3.3*3.3;
-    const float v_ref = 1.25;
-    const float v_temp_grad = 0.01;
+    const float v_ref = config_get()->adc_v_ref;
+    const float v_temp_grad = config_get()->temp_gradient;
     const float resolution = 4096; //2^12
 
     //temp = V / V/°C = (v_uncal * read_value / 4096) / 10 mV/°C 
     //V_read_ref = 1.25 = V_uncalibrated * read_value / 4096
     // por lo tanto, V_uncalibrated = 1.25 * 4096 / read_value
+#ifdef COMMISSIONING_STREAM
+    commissioning_adc((uint32_t)v_ref_read, (uint32_t)temp_reading);
+#endif
+
     float v_uncal = (v_ref * resolution) / v_ref_read;
-    float temp_deg_c = (v_uncal * temp_reading / resolution) / 0.01;
+    float temp_deg_c = (v_uncal * temp_reading / resolution) / v_temp_grad;
     *temp = temp_deg_c;
     
     return TEMP_OK;
@@ -160,9 +195,120 @@ temp_error read_temp_internal(float* temp)
 #endif
 
 
+/**
+ * @brief	Averages the frequency of the captured periods
+ * @param	int: Periods captured after the first edge
+ *
+ * @retval	float: Frequency in Hz
+ */
+static RAMFUNC float estimate_freq(int timer_sample_count)
+{
+  float avg_freq = 0.f;
+
+  // t_real = timer_val * 1/clock_rate, ergo:
+  // f_real = clock_rate / timer_val
+  for(int i = 1; i <= timer_sample_count; i++)
+  {
+    uint32_t time_diff;
+    uint32_t time_n = timer_samples[i];
+    uint32_t time_n_m1 = timer_samples[i-1];
+
+    time_diff = (time_n > time_n_m1) ?     /* Como manejar overflows en los timers? */
+      time_n - time_n_m1 :                 /* t[n] - t[n-1] */
+      time_n + (0xFFFFFFFF - time_n_m1);   /* t[n] + ((2^32-1) - t[n-1]) */
+
+    avg_freq += TIMER_CLOCK_RATE/time_diff;
+  }
+
+  return avg_freq / timer_sample_count;
+}
+
+/* Convierte la captura a %RH, contando los ciclos para comparar con
+ * RAMFUNC_DISABLE */
+static float convert(int timer_sample_count)
+{
+  const uint32_t start_cycles = timebase_cycles();
+  const float avg_freq = estimate_freq(timer_sample_count);
+  const float rh = lerp_rh_from_lut(avg_freq);
+  const uint32_t cycles = timebase_cycles() - start_cycles;
+
+  stats.rh_cycles_last = cycles;
+  if(cycles > stats.rh_cycles_max)
+  {
+    stats.rh_cycles_max = cycles;
+  }
+  return rh;
+}
+
+/**
+ * @brief	Times the RH conversion on a synthetic capture at the middle of the
+ * 		LUT, so the cycle counters have a figure from the target before the
+ * 		first real capture. Called once at boot, before the first reading.
+ * @param	None
+ *
+ * @retval	None
+ */
+void sensors_time_conversion(void)
+{
+  const float freq = config_get()->freq_lut[FREQ_LUT_SIZE / 2];
+  const uint32_t period = (uint32_t)(TIMER_CLOCK_RATE / ((freq > 0.f) ? freq : 1000.f));
+  const int timer_sample_count = (int)config_get()->timer_samples;
+
+  for(int i = 0; i <= timer_sample_count; i++)
+  {
+    timer_samples[i] = (uint32_t)i * period;
+  }
+  (void)convert(timer_sample_count);
+}
+
+/* Arma la captura de %RH si no hay una en curso o completa. Regresa -1 si el
+ * canal lo tiene otro */
+static int arm_capture(tim_handle* handle)
+{
+  if(capture_state != CAPTURE_IDLE || captured)
+  {
+    return 0;
+  }
+  if(HAL_TIM_GetChannelState(handle, TIM_CHANNEL_1) != HAL_TIM_CHANNEL_STATE_READY)
+  {
+    return -1;
+  }
+
+  // Es posible hacer uso de DMA para inyectar directamente el valor del timer
+
+  // Establece callback
+  // Hay que definir USE_HAL_TIM_REGISTER_CALLBACKS a 1 en el compilador
+  // para que funcione los callbacks de usuario. La HAL solo deja registrar
+  // con el timer en READY, un solo callback sigue toda la captura.
+  HAL_TIM_RegisterCallback(handle, HAL_TIM_IC_CAPTURE_CB_ID, sensors_tim_capture);
+
+  /* El canal 1 captura TI1 en cada flanco de subida (ver MX_TIM2_Init()).
+   * El periodo sale de CCR1 y no de cuando corre el callback, siempre que
+   * lo lea antes del siguiente flanco; si no, CC1OF marca el flanco perdido */
+  armed_us = timebase_now_us();
+  capture_state = CAPTURE_ARMED;
+  __HAL_TIM_CLEAR_FLAG(handle, TIM_FLAG_CC1 | TIM_FLAG_CC1OF);
+  HAL_TIM_IC_Start_IT(handle, TIM_CHANNEL_1);
+  return 0;
+}
+
+/**
+ * @brief	Arms the RH capture ahead of the next reading, so read_rh() finds
+ * 		it complete or nearly. Called from the main loop RH_CAPTURE_LEAD_US
+ * 		before the sample, repeated calls do nothing.
+ * @param	tim_handle*: Pointer to the TIM2 handle
+ *
+ * @retval	None
+ */
+void sensors_arm_rh(tim_handle* handle)
+{
+  (void)arm_capture(handle);
+}
+
 /**
  * @brief     Reads RH by translating it from the external oscillating
- *            frequency of the external RC oscillator.
+ *            frequency of the external RC oscillator. Waits for the capture
+ *            armed by sensors_arm_rh(), or arms it, up to RH_CAPTURE_TIMEOUT_US.
  * @param     timer handle*: Pointer to timer handle which will
  * @param     float*: Pointer to float to store RH
  *
@@ -170,86 +316,167 @@ temp_error read_temp_internal(float* temp)
  */
 hum_error read_rh(tim_handle* handle, float* rh)
 {
-  if(handle->State != HAL_OK)
+  /* Una captura que no se armo para esta lectura (el tiempo del bus se movio)
+   * se descarta */
+  if(captured && timebase_now_us() - armed_us > RH_CAPTURE_LEAD_US + RH_CAPTURE_TIMEOUT_US)
+  {
+    captured = 0;
+  }
+  if(arm_capture(handle) != 0)
   {
-    printf("Timer still getting freq values\n");
+    TRACE(TRACE_TIMER_BUSY, HAL_TIM_GetChannelState(handle, TIM_CHANNEL_1));
     return HUM_TIM2_FAIL;
   }
-  else
+
+  /* Igual que el ADC, se espera la captura con un limite */
+  while(!captured && timebase_now_us() - armed_us < RH_CAPTURE_TIMEOUT_US)
   {
-    float avg_freq = 0.f;
+  }
 
-    // t_real = timer_val * 1/clock_rate, ergo:
-    // f_real = clock_rate / timer_val
-    for(int i = 1; i <= MAX_TIMER_SAMPLES; i++)
-    {
-      uint32_t time_diff;
-      uint32_t time_n = timer_samples[i];
-      uint32_t time_n_m1 = timer_samples[i-1];
-      
-      time_diff = (time_n > time_n_m1) ?     /* Como manejar overflows en los timers? */
-	time_n - time_n_m1 :                 /* t[n] - t[n-1] */
-	time_n + (0xFFFFFFFF - time_n_m1);   /* t[n] + ((2^32-1) - t[n-1]) */
-
-      avg_freq += TIMER_CLOCK_RATE/time_diff;
-    }
-    avg_freq /= MAX_TIMER_SAMPLES;
-    
-    *rh = lerp_rh_from_lut(avg_freq);
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const int has_capture = captured;
+  const uint32_t state = capture_state;
+  if(!has_capture)
+  {
+    HAL_TIM_IC_Stop_IT(handle, TIM_CHANNEL_1);
+    capture_state = CAPTURE_IDLE;
+  }
+  __set_PRIMASK(primask);
 
-    // Es posible hacer uso de DMA para inyectar directamente el valor del timer
-    // Revisar si handle->Channel si da los valores TIM_CHANNEL_N correctos para
-    // la función
-    
-    // Establece callback
-    // Hay que definir USE_HAL_TIM_REGISTER_CALLBACKS a 1 en el compilador
-    // para que funcione los callbacks de usuario.
-    TIM_ITRx_SetConfig(handle->Instance, TIM_TS_ETRF); /* Use external trigger input */
+  if(!has_capture)
+  {
+    TRACE(TRACE_RH_TIMEOUT, state);
+    return HUM_TIM2_FAIL;
+  }
 
-    //FILTRO ES UN PLACEHOLDER, VER INTERRUPTS
-    TIM_ETR_SetConfig(handle->Instance, TIM_ETRPRESCALER_DIV1, TIM_ETRPOLARITY_NONINVERTED, 0x00); /* Conf ext trig*/
-    HAL_TIM_RegisterCallback(handle, HAL_TIM_TRIGGER_CB_ID, init_tim_callback);
+  const int timer_sample_count = (int)config_get()->timer_samples;
 
-  }
+#ifdef COMMISSIONING_STREAM
+  /* Las capturas de esta medición, desde la de arranque */
+  const uint32_t captures = (timer_sample_count < MAX_TIMER_SAMPLES) ? (uint32_t)timer_sample_count + 1U : MAX_TIMER_SAMPLES;
+  commissioning_send(COMMISSIONING_CAPTURE, timer_samples, captures);
+#endif
 
-  return HUM_OK;
+  *rh = convert(timer_sample_count);
+  captured = 0;
 
+  return HUM_OK;
 }
 
 /*  Ver documentación 20 de abril, 2021
  *  Lectura_Humedad.pdf
  */
 static int callback_iteration;
-void init_tim_callback(tim_handle* handle)
+RAMFUNC void init_tim_callback(tim_handle* handle, uint32_t capture)
 {
-  //Starts timer
-  HAL_TIM_RegisterCallback(
-    handle, HAL_TIM_TRIGGER_CB_ID,
-    recursive_tim_callback);
+  (void)handle;
+  //Primer flanco
   callback_iteration = 0;
-  HAL_TIM_Base_Start_IT(handle);
-  
+  timer_samples[0] = capture;
+  capture_state = CAPTURE_RUNNING;
 }
 
-void recursive_tim_callback(tim_handle* handle)
+RAMFUNC void recursive_tim_callback(tim_handle* handle, uint32_t capture)
 {
   callback_iteration++;
-  timer_samples[callback_iteration] = TIM_GetCounter(handle->Instance);
+  timer_samples[callback_iteration] = capture;
 
-  callback_iteration++;
-  if(callback_iteration >= MAX_TIMER_SAMPLES)
+  if(callback_iteration >= (int)config_get()->timer_samples)
+  {
+    /* HAL_TIM_IC_Stop_IT() deshabilita el canal y el contador y regresa el
+     * canal a HAL_TIM_CHANNEL_STATE_READY, read_rh() puede armar la siguiente */
+    HAL_TIM_IC_Stop_IT(handle, TIM_CHANNEL_1);
+    captured = 1;
+    capture_state = CAPTURE_IDLE;
+  }
+}
+
+/* Un flanco del oscilador, con el valor de CCR1 ya leido (leerlo borra CC1IF) */
+static RAMFUNC void capture_edge(tim_handle* handle, uint32_t capture)
+{
+  TIM_TypeDef* tim = handle->Instance;
+  const uint32_t now = timebase_cycles();
+
+  /* El contador avanza (PSC + 1) ciclos de CPU por cuenta */
+  edge_cycles = now - (tim->CNT - capture) * (tim->PSC + 1U);
+  edge_seen = 1;
+
+  if((tim->SR & TIM_SR_CC1OF) != 0U)
+  {
+    /* Se perdio un flanco entre dos lecturas de CCR1, el periodo ya no sirve
+     * y la captura vuelve a empezar desde este */
+    __HAL_TIM_CLEAR_FLAG(handle, TIM_FLAG_CC1OF);
+    capture_state = CAPTURE_ARMED;
+  }
+
+  if(capture_state == CAPTURE_RUNNING)
+  {
+    recursive_tim_callback(handle, capture);
+  }
+  else if(capture_state == CAPTURE_ARMED)
+  {
+    init_tim_callback(handle, capture);
+  }
+}
+
+/**
+ * @brief	Input capture callback, one per rising edge of the RH oscillator on
+ * 		TIM2_CH1. Registered with the HAL, which clears CC1IF before calling it.
+ * @param	tim_handle*: Pointer to the TIM2 handle
+ *
+ * @retval	None
+ */
+RAMFUNC void sensors_tim_capture(tim_handle* handle)
+{
+  capture_edge(handle, handle->Instance->CCR1);
+}
+
+/**
+ * @brief	Direct TIM2 interrupt, replaces HAL_TIM_IRQHandler() with
+ * 		DIRECT_ISR_TIM2. Only the channel 1 capture interrupt is enabled,
+ * 		the edge goes to the capture callbacks without the HAL pointers.
+ * @param	tim_handle*: Pointer to the TIM2 handle
+ *
+ * @retval	None
+ */
+RAMFUNC void sensors_tim_irq(tim_handle* handle)
+{
+  TIM_TypeDef* tim = handle->Instance;
+
+  // Leer CCR1 borra CC1IF; escribirlo en SR podria borrar el de un flanco
+  // que llegue entre las dos lecturas
+  if((tim->SR & tim->DIER & TIM_SR_CC1IF) != 0U)
   {
-    HAL_TIM_UnRegisterCallback(handle, HAL_TIM_TRIGGER_CB_ID);
+    capture_edge(handle, tim->CCR1);
   }
 }
 
+/**
+ * @brief	Latency of the last TIM2 interrupt, from the edge captured in CCR1
+ * 		to the entry of the handler. Read once per interrupt.
+ * @param	uint32_t: isr_profile_enter() of the handler
+ *
+ * @retval	uint32_t: Cycles since the edge, or ISR_PROFILE_NO_LATENCY
+ */
+RAMFUNC uint32_t sensors_edge_latency(uint32_t entry_cycles)
+{
+  if(!edge_seen || (int32_t)(entry_cycles - edge_cycles) < 0)
+  {
+    edge_seen = 0;
+    return ISR_PROFILE_NO_LATENCY;
+  }
+  edge_seen = 0;
+  return entry_cycles - edge_cycles;
+}
+
 /**
  * @brief	Obtains and returns the RH% by means of interpolation by using data
  * 		from the LUT.
  * @param	float: Freq data
  * @retval	float: RH value
  */
-float lerp_rh_from_lut(float freq)
+RAMFUNC float lerp_rh_from_lut(float freq)
 {
 
   // Encuentra los valores por los que esta rodeado el valor de frec en la LUT
@@ -257,6 +484,7 @@ float lerp_rh_from_lut(float freq)
   // La complejidad O(N) no es problema, pienso yo
   // Seria interesante almacenar la LUT en otras estructuras de datos
   // como un arbol binario, pero no pienso esto sea gran problema
+  const float* freq_lut = config_get()->freq_lut;
   int il = 0;
   int ig = 0;
   if(freq < freq_lut[0]) {
@@ -277,3 +505,14 @@ float lerp_rh_from_lut(float freq)
   new_rh = ( (freq - freq_lut[il]) * (ig*5.f - il*5.f) ) / (freq_lut[ig] - freq_lut[il]) + il*5.f;
   return new_rh;
 }
+
+/**
+ * @brief	Gets the cycles of the RH conversion
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const sensors_stats* sensors_get_stats(void)
+{
+  return &stats;
+}
@@ -23,6 +23,11 @@
 #include "stm32f0xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "commissioning.h"
+#include "isr_profile.h"
+#include "can_schedule.h"
+#include "sensors.h"
+#include "watchdog.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -56,7 +61,9 @@
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
+extern CAN_HandleTypeDef hcan;
 extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim6;
 /* USER CODE BEGIN EV */
 
 /* USER CODE END EV */
@@ -85,6 +92,7 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
+  watchdog_fault();
 
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
@@ -126,11 +134,11 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
-
+  const uint32_t entry_val = SysTick->VAL;
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
-
+  isr_profile_systick(entry_val);
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -147,15 +155,69 @@ void SysTick_Handler(void)
 void TIM2_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM2_IRQn 0 */
-
+  const uint32_t entry = isr_profile_enter();
+#ifdef DIRECT_ISR_TIM2
+  sensors_tim_irq(&htim2);
+  isr_profile_exit(ISR_TIM2, entry, sensors_edge_latency(entry));
+  return;
+#endif
   /* USER CODE END TIM2_IRQn 0 */
   HAL_TIM_IRQHandler(&htim2);
   /* USER CODE BEGIN TIM2_IRQn 1 */
-
+  isr_profile_exit(ISR_TIM2, entry, sensors_edge_latency(entry));
   /* USER CODE END TIM2_IRQn 1 */
 }
 
+/**
+  * @brief This function handles TIM6 global and DAC channel underrun error interrupts.
+  */
+void TIM6_DAC_IRQHandler(void)
+{
+  /* USER CODE BEGIN TIM6_DAC_IRQn 0 */
+  const uint32_t entry = isr_profile_enter();
+  const uint32_t latency = can_schedule_slot_latency(entry);
+#ifdef DIRECT_ISR_TIM6
+  can_schedule_irq(&htim6);
+  isr_profile_exit(ISR_TIM6, entry, latency);
+  return;
+#endif
+  /* USER CODE END TIM6_DAC_IRQn 0 */
+  HAL_TIM_IRQHandler(&htim6);
+  /* USER CODE BEGIN TIM6_DAC_IRQn 1 */
+  isr_profile_exit(ISR_TIM6, entry, latency);
+  /* USER CODE END TIM6_DAC_IRQn 1 */
+}
+
+/**
+  * @brief This function handles HDMI-CEC and CAN global interrupts / HDMI-CEC wake-up interrupt through EXTI line 27.
+  */
+void CEC_CAN_IRQHandler(void)
+{
+  /* USER CODE BEGIN CEC_CAN_IRQn 0 */
+  const uint32_t entry = isr_profile_enter();
+  const uint32_t latency = isr_profile_can_latency(CAN, timebase_now_us());
+#ifdef DIRECT_ISR_CAN
+  can_irq(&hcan);
+  isr_profile_exit(ISR_CAN, entry, latency);
+  return;
+#endif
+  /* USER CODE END CEC_CAN_IRQn 0 */
+  HAL_CAN_IRQHandler(&hcan);
+  /* USER CODE BEGIN CEC_CAN_IRQn 1 */
+  isr_profile_exit(ISR_CAN, entry, latency);
+  /* USER CODE END CEC_CAN_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
+#ifdef COMMISSIONING_STREAM
+/**
+  * @brief This function handles DMA1 channel 2 and 3 and DMA2 channel 1 and 2 interrupts.
+  */
+void DMA1_Ch2_3_DMA2_Ch1_2_IRQHandler(void)
+{
+  commissioning_dma_irq();
+}
+#endif
 
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
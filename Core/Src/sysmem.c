@@ -24,12 +24,26 @@
 /* Includes */
 #include <errno.h>
 #include <stdint.h>
+#include "sysmem.h"
 
 /**
  * Pointer to the current high watermark of the heap usage
  */
 static uint8_t *__sbrk_heap_end = NULL;
 
+/*
+ * Marcas de agua: la pila se pinta al arrancar desde el final de .bss hasta
+ * casi el puntero de pila, y sysmem_poll() busca la palabra pintada mas baja
+ * que ya fue escrita, entre el tope del heap y la marca anterior. El heap se
+ * mide en _sbrk().
+ */
+extern uint8_t _end; /* Symbol defined in the linker script */
+extern uint8_t _estack; /* Symbol defined in the linker script */
+extern uint32_t _Min_Stack_Size; /* Symbol defined in the linker script */
+
+static const uint32_t *stack_low = NULL; /* Palabra mas baja escrita por la pila */
+static sysmem_stats stats;
+
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
  *        and others from the C library
@@ -53,9 +67,6 @@ static uint8_t *__sbrk_heap_end = NULL;
  */
 void *_sbrk(ptrdiff_t incr)
 {
-  extern uint8_t _end; /* Symbol defined in the linker script */
-  extern uint8_t _estack; /* Symbol defined in the linker script */
-  extern uint32_t _Min_Stack_Size; /* Symbol defined in the linker script */
   const uint32_t stack_limit = (uint32_t)&_estack - (uint32_t)&_Min_Stack_Size;
   const uint8_t *max_heap = (uint8_t *)stack_limit;
   uint8_t *prev_heap_end;
@@ -69,6 +80,7 @@ void *_sbrk(ptrdiff_t incr)
   /* Protect heap from growing into the reserved MSP stack */
   if (__sbrk_heap_end + incr > max_heap)
   {
+    stats.heap_failures++;
     errno = ENOMEM;
     return (void *)-1;
   }
@@ -76,5 +88,80 @@ void *_sbrk(ptrdiff_t incr)
   prev_heap_end = __sbrk_heap_end;
   __sbrk_heap_end += incr;
 
+  if ((uint32_t)(__sbrk_heap_end - &_end) > stats.heap_peak)
+  {
+    stats.heap_peak = (uint32_t)(__sbrk_heap_end - &_end);
+  }
+
   return (void *)prev_heap_end;
 }
+
+/**
+ * @brief	Paints the free RAM between the end of .bss and the stack pointer, to
+ * 		find the deepest stack later. Called first thing in main(), before
+ * 		anything uses the heap.
+ * @param	None
+ *
+ * @retval	None
+ */
+void sysmem_paint_stack(void)
+{
+  uint32_t *word = (uint32_t *)(((uint32_t)&_end + 3U) & ~3U);
+  uint32_t *const top = (uint32_t *)((__get_MSP() - SYSMEM_PAINT_MARGIN) & ~3U);
+
+  while (word < top)
+  {
+    *word++ = SYSMEM_PAINT;
+  }
+
+  stack_low = top;
+  stats.stack_reserved = (uint32_t)&_Min_Stack_Size;
+  stats.stack_peak = (uint32_t)&_estack - (uint32_t)top;
+  stats.free_min = (uint32_t)top - (uint32_t)&_end;
+}
+
+/**
+ * @brief	Updates the stack watermark. The scan is bounded by the previous mark,
+ * 		call it from the main loop.
+ * @param	None
+ *
+ * @retval	None
+ */
+void sysmem_poll(void)
+{
+  if (stack_low == NULL)
+  {
+    return;
+  }
+
+  const uint8_t *heap_end = (__sbrk_heap_end != NULL) ? __sbrk_heap_end : &_end;
+  const uint32_t *word = (const uint32_t *)(((uint32_t)heap_end + 3U) & ~3U);
+
+  /* La primera palabra escrita arriba del heap es la mas profunda de la pila */
+  while (word < stack_low && *word == SYSMEM_PAINT)
+  {
+    word++;
+  }
+  if (word < stack_low)
+  {
+    stack_low = word;
+    stats.stack_peak = (uint32_t)&_estack - (uint32_t)word;
+  }
+
+  const uint32_t gap = ((uint32_t)stack_low > (uint32_t)heap_end) ? (uint32_t)stack_low - (uint32_t)heap_end : 0U;
+  if (gap < stats.free_min)
+  {
+    stats.free_min = gap;
+  }
+}
+
+/**
+ * @brief	Gets the memory watermarks
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const sysmem_stats *sysmem_get_stats(void)
+{
+  return &stats;
+}
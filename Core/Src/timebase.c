@@ -0,0 +1,223 @@
+/**
+ * @file 	timebase.c
+ * @brief	Microsecond timestamps derived from the HAL tick and the SysTick counter,
+ * 		and bus time disciplined by the SYNC frames of the control panel
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#include "timebase.h"
+
+/*
+ * El tiempo del bus se obtiene del tiempo local extrapolando desde el ultimo
+ * SYNC recibido, corregido por la diferencia de frecuencia entre el oscilador
+ * del panel y el local. Cada SYNC corrige la fase de golpe, la frecuencia se
+ * estima con un filtro IIR sobre las diferencias entre SYNCs consecutivos.
+ *
+ * El instante local del SYNC se toma del SOF que marca el hardware (TTCM), no
+ * de la entrada al interrupt: la latencia del interrupt varia de un marco a
+ * otro y de un nodo a otro. El contador de bxCAN y SysTick salen del mismo
+ * reloj, asi que (tiempo local - SOF) mod 2^16 es una constante mas el retardo
+ * desde el SOF hasta que se lee el reloj; su minimo entre marcos del mismo
+ * largo quita el jitter y deja un retardo fijo, igual en todos los nodos. La
+ * diferencia entre nodos queda en el error de ese minimo y de la estimación de
+ * frecuencia.
+ *
+ * Tools/time_sync_sim.c simula varios nodos con este archivo y mide la
+ * diferencia entre sus instantes de muestreo.
+ */
+static uint32_t sync_local_us;
+static uint32_t sync_master_us;
+static int32_t rate_ppb = 0;
+static uint8_t synced = 0;
+
+/* Minimo de (tiempo local - SOF) mod 2^16, ver timebase_sof_local_us() */
+static uint16_t sof_offset;
+static uint8_t sof_offset_valid = 0;
+static uint8_t sof_frames = 0;
+
+/**
+ * @brief	Returns the time since boot in microseconds. Safe to call from an
+ * 		interrupt that blocks SysTick, a pending tick is accounted for.
+ *
+ * @retval	uint32_t: Microseconds, wraps around every ~71 minutes
+ */
+uint32_t timebase_now_us(void)
+{
+  uint32_t tick;
+  uint32_t val;
+
+  /* Si SysTick interrumpe entre ambas lecturas se vuelve a intentar */
+  do {
+    tick = HAL_GetTick();
+    val = SysTick->VAL;
+  } while(tick != HAL_GetTick());
+
+  /* Dentro de un ISR de igual prioridad el tick no avanza, el contador puede
+   * haber recargado con la interrupción pendiente */
+  if((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+  {
+    val = SysTick->VAL;
+    tick += uwTickFreq;
+  }
+
+  const uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  return tick * 1000U + (SysTick->LOAD - val) / cycles_per_us;
+}
+
+/**
+ * @brief	Returns the time since boot in CPU cycles, counted by SysTick. Cheaper
+ * 		than timebase_now_us(), it doesn't divide. Safe to call from an
+ * 		interrupt that blocks SysTick.
+ *
+ * @retval	uint32_t: Cycles, wraps around every ~89 s at 48 MHz
+ */
+uint32_t timebase_cycles(void)
+{
+  uint32_t tick;
+  uint32_t val;
+
+  do {
+    tick = HAL_GetTick();
+    val = SysTick->VAL;
+  } while(tick != HAL_GetTick());
+
+  if((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+  {
+    val = SysTick->VAL;
+    tick += uwTickFreq;
+  }
+
+  const uint32_t reload = SysTick->LOAD + 1U;
+  return tick * reload + (reload - 1U - val);
+}
+
+/**
+ * @brief	Converts a local timestamp to bus time. Before the first SYNC the
+ * 		bus time is the local time.
+ * @param	uint32_t: Local time, as returned by timebase_now_us()
+ *
+ * @retval	uint32_t: Bus time in microseconds
+ */
+uint32_t timebase_bus_us_at(uint32_t local_us)
+{
+  /* Copia consistente, timebase_sync() corre en el interrupt de CAN */
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const uint8_t is_synced = synced;
+  const uint32_t base_local = sync_local_us;
+  const uint32_t base_master = sync_master_us;
+  const int32_t rate = rate_ppb;
+  __set_PRIMASK(primask);
+
+  if(!is_synced)
+  {
+    return local_us;
+  }
+
+  const uint32_t elapsed = local_us - base_local;
+  const int32_t correction = (int32_t)(((int64_t)elapsed * rate) / 1000000000);
+  return base_master + elapsed + correction;
+}
+
+/**
+ * @brief	Returns the current bus time in microseconds
+ *
+ * @retval	uint32_t: Bus time, wraps around every ~71 minutes
+ */
+uint32_t timebase_bus_us(void)
+{
+  return timebase_bus_us_at(timebase_now_us());
+}
+
+/**
+ * @brief	Converts the hardware SOF timestamp of a received frame to local
+ * 		time, removing the jitter of the interrupt latency. The result is
+ * 		the SOF plus the shortest delay seen between the SOF and the call, a
+ * 		constant as long as it is only used for frames of the same length.
+ * 		Called from the RX interrupt of the SYNC frames.
+ * @param	uint16_t: TIME field of the FIFO mailbox, in bit times
+ * @param	uint32_t: timebase_now_us() in the interrupt
+ *
+ * @retval	uint32_t: Local time of the SOF, in microseconds
+ */
+uint32_t timebase_sof_local_us(uint16_t sof_stamp, uint32_t now_us)
+{
+  const uint16_t elapsed = (uint16_t)((uint16_t)now_us - (uint16_t)(sof_stamp * TIMEBASE_CAN_BIT_US));
+
+  /* El envejecimiento deja que el minimo suba si la relación entre ambos
+   * contadores se mueve, un retardo menor lo baja en seguida */
+  if(++sof_frames >= TIMEBASE_SOF_AGING)
+  {
+    sof_frames = 0;
+    sof_offset++;
+  }
+  if(!sof_offset_valid || (int16_t)(elapsed - sof_offset) < 0)
+  {
+    sof_offset = elapsed;
+    sof_offset_valid = 1;
+  }
+
+  return now_us - (uint16_t)(elapsed - sof_offset);
+}
+
+/**
+ * @brief	Disciplines the bus time with a SYNC from the time master
+ * @param	uint32_t: Master time carried by the SYNC frame
+ * @param	uint32_t: Local time when the SYNC was received
+ *
+ * @retval	None
+ */
+void timebase_sync(uint32_t master_us, uint32_t local_us)
+{
+  if(synced)
+  {
+    const uint32_t d_local = local_us - sync_local_us;
+    const int32_t d_error = (int32_t)((master_us - sync_master_us) - d_local);
+
+    if(d_local > 0 && d_local < TIMEBASE_SYNC_MAX_INTERVAL_US)
+    {
+      const int32_t measured_ppb = (int32_t)(((int64_t)d_error * 1000000000) / d_local);
+      if(measured_ppb > -TIMEBASE_RATE_LIMIT_PPB && measured_ppb < TIMEBASE_RATE_LIMIT_PPB)
+      {
+        rate_ppb += (measured_ppb - rate_ppb) / TIMEBASE_RATE_GAIN;
+      }
+    }
+  }
+
+  sync_local_us = local_us;
+  sync_master_us = master_us;
+  synced = 1;
+}
+
+int timebase_is_synced(void)
+{
+  return synced;
+}
+
+/**
+ * @brief	Returns the estimated rate of the bus time relative to the local
+ * 		clock, in parts per billion
+ *
+ * @retval	int32_t: Rate difference
+ */
+int32_t timebase_rate_ppb(void)
+{
+  return rate_ppb;
+}
+
+/**
+ * @brief	Starts the rate estimate from a previous one, kept across a warm
+ * 		restart. The phase still waits for the next SYNC.
+ * @param	int32_t: Rate difference in parts per billion
+ *
+ * @retval	None
+ */
+void timebase_set_rate_ppb(int32_t rate)
+{
+  if(rate > -TIMEBASE_RATE_LIMIT_PPB && rate < TIMEBASE_RATE_LIMIT_PPB)
+  {
+    rate_ppb = rate;
+  }
+}
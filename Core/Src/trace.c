@@ -0,0 +1,162 @@
+/**
+ * @file 	trace.c
+ * @brief	Deferred binary trace: events are written to a RAM ring as compact
+ * 		records and formatted on the host
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+#include "trace.h"
+#include "main.h"
+#include "can_tx.h"
+#include "timebase.h"
+#include "boot.h"
+#include "warm.h"
+#include "flash_log.h"
+
+/*
+ * Un registro son 8 bytes: tiempo, evento y un argumento. Escribirlo cuesta lo
+ * que timebase_cycles() mas unas pocas instrucciones con las interrupciones
+ * deshabilitadas, contra los miles de ciclos de printf() a un puerto que ni
+ * siquiera esta conectado en campo. El tiempo queda en ciclos, sin la división
+ * de timebase_now_us(); el host lo convierte. Las cadenas de formato no estan en la
+ * imagen, Tools/trace_decode.c las toma de trace_events.h al compilarse.
+ *
+ * El anillo se lee con el depurador (simbolo trace_buffer) o se pide por CAN
+ * con CAN_CMD_TRACE: los registros se mandan tal cual, un marco por registro,
+ * como fuente bulk. Un reenvio del registro en flash en curso no se reemplaza,
+ * el comando se contesta ocupado.
+ *
+ * El anillo esta en .noinit: despues de un reset en caliente conserva los
+ * eventos previos, que es lo que interesa despues de un reset del watchdog, y
+ * el indice sigue contando. El tiempo de los registros si empieza de nuevo.
+ */
+trace_ring trace_buffer WARM_NOINIT;
+
+static volatile uint32_t stream_cursor;
+static volatile uint32_t stream_end;
+
+/**
+ * @brief	Keeps the ring of the previous run if it survived the reset, and
+ * 		registers the trace command. Called right after boot_init(), before
+ * 		any event.
+ *
+ * @retval	None
+ */
+void trace_init(void)
+{
+  if(trace_buffer.magic != TRACE_MAGIC || (boot_get_stats()->reset_flags & (RCC_CSR_PORRSTF >> 24)))
+  {
+    trace_buffer.head = 0;
+    trace_buffer.magic = TRACE_MAGIC;
+  }
+
+  can_register_command(CAN_CMD_TRACE, trace_command);
+}
+
+/**
+ * @brief	Writes a record to the ring, overwriting the oldest one. Safe to call
+ * 		from any interrupt.
+ * @param	trace_event: Event
+ * @param	uint16_t: Argument, formatted by the host with the event format
+ *
+ * @retval	None
+ */
+void trace_write(trace_event event, uint16_t arg)
+{
+  const uint32_t time_cycles = timebase_cycles();
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const uint32_t index = trace_buffer.head;
+  trace_record* record = &trace_buffer.records[index % TRACE_RING_SIZE];
+  record->time_cycles = time_cycles;
+  record->event = (uint16_t)event;
+  record->arg = arg;
+  trace_buffer.head = index + 1U;
+  __set_PRIMASK(primask);
+}
+
+/* Fuente bulk, desde el interrupt de TX. Se salta los registros que ya fueron
+ * sobrescritos. */
+static int stream_next(can_tx_image* image, uint32_t* cookie)
+{
+  trace_record record;
+
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t index = stream_cursor;
+  const uint32_t head = trace_buffer.head;
+  if(head - index > TRACE_RING_SIZE)
+  {
+    index = head - TRACE_RING_SIZE;
+  }
+  const int available = index < stream_end;
+  record = trace_buffer.records[index % TRACE_RING_SIZE];
+  __set_PRIMASK(primask);
+
+  if(!available)
+  {
+    return 0;
+  }
+
+  can_tx_build_image(CAN_TX_ID(CAN_TX_TRACE_BASE), (const uint8_t*)&record, sizeof(record), image);
+  *cookie = index;
+  stream_cursor = index + 1U;
+  return 1;
+}
+
+static void stream_failed(uint32_t cookie)
+{
+  if(cookie < stream_cursor)
+  {
+    stream_cursor = cookie;
+  }
+}
+
+/**
+ * @brief	Command handler for CAN_CMD_TRACE, called from the RX interrupt. The
+ * 		payload is [1] node (0 for all). The answer, on the response
+ * 		identifier, is [0] command [2..3] number of records [4..7] index of
+ * 		the first one. The records written until then follow as bulk frames
+ * 		on the trace identifier. While a log transfer is in progress the
+ * 		answer is [0] command [1] TRACE_BUSY and nothing is sent.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ * @param	can_rx_view*: View of the command frame
+ *
+ * @retval	None
+ */
+void trace_command(can_handle* handle, const can_rx_view* frame)
+{
+  if(can_view_dlc(frame) < 2)
+  {
+    return;
+  }
+
+  const uint8_t node = can_view_byte(frame, 1);
+  if(node != CAN_NODE_BROADCAST && node != node_id_get())
+  {
+    return;
+  }
+
+  if(flash_log_streaming())
+  {
+    const uint8_t busy[CAN_MAX_BYTES] = { CAN_CMD_TRACE, TRACE_BUSY, 0, 0, 0, 0, 0, 0 };
+    can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), busy, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+    return;
+  }
+
+  const uint32_t head = trace_buffer.head;
+  const uint32_t first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0U;
+  const uint32_t records = head - first;
+  stream_cursor = first;
+  stream_end = head;
+  can_tx_set_bulk_source(stream_next, stream_failed);
+
+  const uint8_t reply[CAN_MAX_BYTES] = {
+    CAN_CMD_TRACE, 0, (uint8_t)records, (uint8_t)(records >> 8),
+    (uint8_t)first, (uint8_t)(first >> 8), (uint8_t)(first >> 16), (uint8_t)(first >> 24)
+  };
+  can_tx_send(handle, CAN_TX_RESPONSE, CAN_TX_ID(CAN_TX_RESPONSE_BASE), reply, CAN_MAX_BYTES, CAN_TX_RESPONSE_DEADLINE_MS);
+}
@@ -0,0 +1,193 @@
+/**
+ * @file 	warm.c
+ * @brief	State kept in RAM across a warm restart, so the node resumes instead
+ * 		of converging again
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Un reset por software, por el watchdog o por el pin no borra la RAM. Lo que
+ * tarda en reconstruirse se copia despues de cada lectura a la sección
+ * .noinit, que el codigo de arranque no toca, con un CRC-32. Al arrancar, si
+ * hay una copia valida, cada modulo sigue desde ella:
+ * - la estimación de frecuencia del tiempo del bus (timebase.c), sin esperar a
+ *   que el filtro converja otra vez con los SYNC; la fase si espera al
+ *   siguiente SYNC.
+ * - la ranura de respuesta (can_schedule.c), el mapeo de los PDO (pdo.c) y el
+ *   rol del agregador (aggregator.c), que el panel configura en ejecución y no
+ *   se guardan en flash.
+ * - las medias en curso de 1 minuto y 1 hora del registro (flash_log.c), con
+ *   warm_restore_log() despues de flash_log_init().
+ *
+ * Hay dos copias que se escriben por turnos, un reset a mitad de una escritura
+ * deja la otra valida. Despues de un reset por encendido la RAM no tiene
+ * sentido y las copias se descartan aunque el CRC coincida.
+ *
+ * La sección se define en el linker script, ver el README. Sin ella el linker
+ * puede dejar las copias despues de _end, donde sysmem_paint_stack() las pinta
+ * y la pila las pisa; warm_restore() lo revisa antes de la primera escritura.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "warm.h"
+#include "main.h"
+#include "boot.h"
+#include "can_schedule.h"
+#include "crc.h"
+#include "od.h"
+#include "timebase.h"
+#include "trace.h"
+
+_Static_assert(offsetof(warm_state, crc) % 4U == 0U, "the CRC of warm_state must follow whole words");
+
+#define CRC_WORDS (offsetof(warm_state, crc) / 4U)
+
+extern uint8_t _end; /* Symbol defined in the linker script */
+
+static warm_state copies[2] WARM_NOINIT;
+
+static uint8_t current = 1; /* Copia escrita mas reciente, la siguiente va en la otra */
+static uint32_t sequence = 0;
+static warm_stats stats;
+
+/* Copia de la que se siguio, NULL en un arranque en frio. warm_save() no corre
+ * antes del ciclo principal, sigue intacta hasta warm_restore_log(). */
+static const warm_state* restored = NULL;
+
+static int copy_valid(const warm_state* copy)
+{
+  return copy->version == WARM_VERSION && copy->crc == crc_words((const uint32_t*)copy, CRC_WORDS);
+}
+
+/**
+ * @brief	Resumes the modules from the newest valid copy, if the reset kept
+ * 		the RAM. Called once every module is initialized and before CAN
+ * 		starts, so a command of the panel isn't overwritten.
+ * @param	can_handle*: Pointer to a handle to a CAN object, typedefs CAN_HandleTypeDef
+ *
+ * @retval	1 if the state was restored, 0 on a cold start
+ */
+int warm_restore(can_handle* handle)
+{
+  /* Las copias deben quedar debajo de la RAM que se pinta y usa la pila */
+  if((uintptr_t)(&copies[1] + 1) > (uintptr_t)&_end)
+  {
+    Error_Handler();
+  }
+
+  if(boot_get_stats()->reset_flags & (RCC_CSR_PORRSTF >> 24))
+  {
+    return 0;
+  }
+
+  const warm_state* found = NULL;
+  for(uint8_t i = 0; i < 2; i++)
+  {
+    if(copies[i].magic != WARM_MAGIC)
+    {
+      continue;
+    }
+    if(!copy_valid(&copies[i]))
+    {
+      stats.discarded++;
+      continue;
+    }
+    if(found == NULL || copies[i].sequence - found->sequence < 0x80000000UL)
+    {
+      found = &copies[i];
+    }
+  }
+
+  if(found == NULL)
+  {
+    return 0;
+  }
+
+  timebase_set_rate_ppb(found->rate_ppb);
+  can_schedule_set_offset(found->slot_offset_us);
+
+  /* Por el diccionario, con los mismos limites que una escritura del panel */
+  od_write(OD_AGGREGATOR_ENABLE, 0, found->aggregator_enable);
+  for(uint8_t word = 0; word < AGGREGATOR_MEMBER_WORDS; word++)
+  {
+    od_write(OD_AGGREGATOR_MEMBERS, word, found->aggregator_members[word]);
+  }
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    pdo_restore(handle, pdo, &found->pdos[pdo]);
+  }
+
+  restored = found;
+  stats.restarts = (found->restarts < 0xFFFFU) ? found->restarts + 1U : 0xFFFFU;
+  sequence = found->sequence;
+  current = (uint8_t)(found - copies);
+  TRACE(TRACE_WARM_RESTORE, stats.restarts);
+  return 1;
+}
+
+/**
+ * @brief	Resumes the running means of the log from the copy found by
+ * 		warm_restore(). Called after flash_log_init(), as
+ * 		flash_log_set_windows() requires, and before the first reading.
+ * @param	None
+ *
+ * @retval	None
+ */
+void warm_restore_log(void)
+{
+  if(restored != NULL)
+  {
+    flash_log_set_windows(restored->log_windows);
+  }
+}
+
+/**
+ * @brief	Copies the state of the modules to the older copy. Called from the
+ * 		main loop after every reading.
+ * @param	None
+ *
+ * @retval	None
+ */
+void warm_save(void)
+{
+  const uint8_t next = current ^ 1U;
+  warm_state* copy = &copies[next];
+
+  copy->magic = WARM_MAGIC;
+  copy->version = WARM_VERSION;
+  copy->restarts = (uint16_t)stats.restarts;
+  copy->sequence = ++sequence;
+  copy->rate_ppb = timebase_rate_ppb();
+  copy->slot_offset_us = can_schedule_offset();
+
+  od_read(OD_AGGREGATOR_ENABLE, 0, &copy->aggregator_enable);
+  for(uint8_t word = 0; word < AGGREGATOR_MEMBER_WORDS; word++)
+  {
+    od_read(OD_AGGREGATOR_MEMBERS, word, &copy->aggregator_members[word]);
+  }
+
+  for(int pdo = 0; pdo < PDO_MAX; pdo++)
+  {
+    copy->pdos[pdo] = *pdo_get_config(pdo);
+  }
+
+  flash_log_get_windows(copy->log_windows);
+
+  copy->crc = crc_words((const uint32_t*)copy, CRC_WORDS);
+  current = next;
+}
+
+/**
+ * @brief	Gets the warm restart counters
+ * @param	None
+ *
+ * @retval	Pointer to the counters
+ */
+const warm_stats* warm_get_stats(void)
+{
+  return &stats;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file 	watchdog.c
+ * @brief	Independent watchdog fed only while every supervised task checks in
+ * 		within its deadline, and record of the task that missed it
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Cada tarea registrada se reporta con watchdog_checkin() y watchdog_poll(),
+ * en el ciclo principal, alimenta al IWDG solo si ninguna paso su plazo. Una
+ * tarea vencida, un ciclo principal detenido o Error_Handler() terminan en un
+ * reset a mas tardar WATCHDOG_TIMEOUT_MS despues, el peor caso es el plazo
+ * mayor mas ese tiempo.
+ *
+ * El registro de la corrida esta en .noinit (ver warm.h): los tiempos de los
+ * ultimos reportes, las tareas vencidas cuando se dejo de alimentar y si se
+ * llego a un fallo. Despues de un reset del IWDG, watchdog_init() deduce de él
+ * que tareas vencieron; si el ciclo principal se detuvo sin llegar a
+ * watchdog_poll() son las que, al momento del reset, ya pasaban su plazo. La
+ * traza tambien sobrevive y muestra lo que paso antes.
+ *
+ * El IWDG corre con el LSI y no se detiene una vez arrancado, el arranque
+ * completo debe caber en WATCHDOG_TIMEOUT_MS. Se congela mientras el depurador
+ * detiene al CPU.
+ */
+
+#include "watchdog.h"
+#include "boot.h"
+#include "trace.h"
+#include "warm.h"
+
+_Static_assert(WATCHDOG_RELOAD <= IWDG_RLR_RL, "WATCHDOG_TIMEOUT_MS doesn't fit in IWDG_RLR");
+_Static_assert(WATCHDOG_TASKS <= 7, "the missed mask has a bit per task below WATCHDOG_FAULT");
+
+#define KEY_RELOAD 0xAAAAU
+#define KEY_ACCESS 0x5555U
+#define KEY_START 0xCCCCU
+
+/**
+ * @struct Record of the run, kept across the reset
+ */
+typedef struct watchdog_record {
+  uint32_t magic;
+  uint32_t feed_tick; /* HAL_GetTick() de la ultima alimentación */
+  uint32_t checkin_tick[WATCHDOG_TASKS];
+  uint32_t deadline_ms[WATCHDOG_TASKS]; /* 0 si la tarea no esta registrada */
+  uint16_t resets;
+  uint8_t withheld; /* Tareas vencidas desde que se dejo de alimentar */
+  uint8_t fault;
+} watchdog_record;
+
+static watchdog_record record WARM_NOINIT;
+static watchdog_stats stats;
+
+/* Tareas que pasaron su plazo a un tiempo dado */
+static uint8_t late_tasks(uint32_t now)
+{
+  uint8_t late = 0;
+  for(uint8_t task = 0; task < WATCHDOG_TASKS; task++)
+  {
+    if(record.deadline_ms[task] != 0U && now - record.checkin_tick[task] > record.deadline_ms[task])
+    {
+      late |= (uint8_t)(1U << task);
+    }
+  }
+  return late;
+}
+
+/**
+ * @brief	Reads the record of the previous run and starts the IWDG. Called
+ * 		right after boot_init().
+ * @param	None
+ *
+ * @retval	None
+ */
+void watchdog_init(void)
+{
+  const uint8_t flags = boot_get_stats()->reset_flags;
+
+  if(record.magic == WATCHDOG_MAGIC && !(flags & (RCC_CSR_PORRSTF >> 24)))
+  {
+    stats.resets = record.resets;
+    if(flags & (RCC_CSR_IWDGRSTF >> 24))
+    {
+      if(stats.resets < 0xFFFFU)
+      {
+        stats.resets++;
+      }
+
+      stats.missed = record.withheld;
+      if(record.fault)
+      {
+        stats.missed |= WATCHDOG_FAULT;
+      }
+      else if(stats.missed == 0U)
+      {
+        /* El ciclo principal se detuvo, el reset fue un timeout despues */
+        stats.missed = late_tasks(record.feed_tick + WATCHDOG_TIMEOUT_MS);
+      }
+      TRACE(TRACE_WATCHDOG_RESET, stats.missed);
+    }
+  }
+
+  record.magic = WATCHDOG_MAGIC;
+  record.resets = (uint16_t)stats.resets;
+  record.withheld = 0;
+  record.fault = 0;
+  record.feed_tick = HAL_GetTick();
+  for(uint8_t task = 0; task < WATCHDOG_TASKS; task++)
+  {
+    record.deadline_ms[task] = 0;
+  }
+
+  __HAL_RCC_DBGMCU_CLK_ENABLE();
+  DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+
+  /* Arrancar el IWDG enciende el LSI; PR y RLR se actualizan unos ciclos del
+   * LSI despues */
+  IWDG->KR = KEY_START;
+  IWDG->KR = KEY_ACCESS;
+  IWDG->PR = IWDG_PR_PR_2;
+  IWDG->RLR = WATCHDOG_RELOAD;
+  while(IWDG->SR != 0U)
+  {
+  }
+  IWDG->KR = KEY_RELOAD;
+}
+
+/**
+ * @brief	Adds a task to the supervision, its deadline counts from now
+ * @param	watchdog_task: Task
+ * @param	uint32_t: Longest time between two check-ins, in ms
+ *
+ * @retval	None
+ */
+void watchdog_register(watchdog_task task, uint32_t deadline_ms)
+{
+  record.checkin_tick[task] = HAL_GetTick();
+  record.deadline_ms[task] = deadline_ms;
+}
+
+/**
+ * @brief	Reports that a task made progress
+ * @param	watchdog_task: Task
+ *
+ * @retval	None
+ */
+void watchdog_checkin(watchdog_task task)
+{
+  record.checkin_tick[task] = HAL_GetTick();
+}
+
+/**
+ * @brief	Feeds the IWDG if no task is past its deadline. Called from the main
+ * 		loop.
+ * @param	None
+ *
+ * @retval	None
+ */
+void watchdog_poll(void)
+{
+  const uint32_t now = HAL_GetTick();
+  const uint8_t late = late_tasks(now);
+
+  if(late != 0U)
+  {
+    if(record.withheld == 0U)
+    {
+      TRACE(TRACE_WATCHDOG_LATE, late);
+    }
+    record.withheld |= late;
+    return;
+  }
+
+  record.withheld = 0;
+  record.feed_tick = now;
+  IWDG->KR = KEY_RELOAD;
+}
+
+/**
+ * @brief	Notes that the firmware reached a fault handler, which waits for the
+ * 		IWDG with the interrupts disabled
+ * @param	None
+ *
+ * @retval	None
+ */
+void watchdog_fault(void)
+{
+  record.fault = 1;
+}
+
+/**
+ * @brief	Gets the watchdog resets and the tasks that caused the last one
+ * @param	None
+ *
+ * @retval	Pointer to the statistics
+ */
+const watchdog_stats* watchdog_get_stats(void)
+{
+  return &stats;
+}
@@ -44,6 +44,12 @@ defined in linker script */
 .word _sbss
 /* end address for the .bss section. defined in linker script */
 .word _ebss
+/* start, end and load address of the functions that run from SRAM (.RamFunc).
+defined in linker script; weak, so a script without the section copies nothing
+here and leaves the functions in .data */
+.weak _sramfunc
+.weak _eramfunc
+.weak _siramfunc
 
   .section .text.Reset_Handler
   .weak Reset_Handler
@@ -68,6 +74,23 @@ LoopCopyDataInit:
   adds r4, r0, r3
   cmp r4, r1
   bcc CopyDataInit
+
+/* Copy the functions that run from SRAM, see RAMFUNC in main.h */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  movs r3, #0
+  b LoopCopyRamFunc
+
+CopyRamFunc:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamFunc:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamFunc
   
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
@@ -0,0 +1,307 @@
+/**
+ * @file 	can_rx_test.c
+ * @brief	Host test of the zero-copy receive path of can.c: drives
+ * 		can_dispatch_fifo() over a simulated bxCAN with frames in its FIFOs
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación y ejecución, desde la raiz del repositorio:
+ *   gcc -O2 -DSTM32F091xC -DUSE_HAL_DRIVER -DRAMFUNC_DISABLE -ITools/host -ICore/Inc \
+ *     -IDrivers/STM32F0xx_HAL_Driver/Inc -IDrivers/CMSIS/Device/ST/STM32F0xx/Include \
+ *     -IDrivers/CMSIS/Include Tools/can_rx_test.c Core/Src/can.c -o can_rx_test
+ *   ./can_rx_test
+ *
+ * El periférico es una estructura CAN_TypeDef en memoria. Cada caso carga un
+ * marco en el mailbox de salida de una FIFO, con FULL y FOVR activos, y llama a
+ * can_dispatch_fifo() como lo haria el ISR. Se revisa que el marco llegue en su
+ * lugar al handler de su FMI, sin copia, y que al liberarlo se escriba solo
+ * RFOM: FULL y FOVR se borran escribiendo 1. Una escritura a RFxR deja FMP en
+ * 0, asi que cada llamada atiende un marco; el ciclo sobre varios lo cubre el
+ * hardware. Termina con 0 si todos los casos pasan.
+ *
+ * En el README, la lista de herramientas tiene la linea de compilación.
+ */
+
+#include <stdio.h>
+#include "can.h"
+#include "can_health.h"
+#include "can_schedule.h"
+#include "can_tx.h"
+#include "config.h"
+#include "node_id.h"
+#include "timebase.h"
+
+static CAN_TypeDef can_ip;
+static can_handle hcan = { .Instance = &can_ip };
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static void check(int condition, const char* text, int line)
+{
+  checks++;
+  if(!condition)
+  {
+    failures++;
+    printf("FAIL line %d: %s\n", line, text);
+  }
+}
+
+/* Ultimo marco visto por un handler */
+typedef struct seen {
+  int calls;
+  const volatile can_rx_mailbox* mailbox;
+  uint32_t fifo;
+  uint32_t std_id;
+  uint32_t rtr;
+  uint32_t dlc;
+  uint8_t first_byte;
+} seen;
+
+static seen seen_remote;
+static seen seen_data;
+static seen seen_range;
+static uint32_t rx_counted = 0;
+
+static void note(seen* handler, const can_rx_view* frame)
+{
+  handler->calls++;
+  handler->mailbox = frame->mailbox;
+  handler->fifo = frame->fifo;
+  handler->std_id = can_view_std_id(frame);
+  handler->rtr = can_view_is_rtr(frame);
+  handler->dlc = can_view_dlc(frame);
+  handler->first_byte = can_view_byte(frame, 0);
+}
+
+static void on_remote(can_handle* handle, const can_rx_view* frame)
+{
+  note(&seen_remote, frame);
+}
+
+static void on_data(can_handle* handle, const can_rx_view* frame)
+{
+  note(&seen_data, frame);
+}
+
+static void on_range(can_handle* handle, const can_rx_view* frame)
+{
+  note(&seen_range, frame);
+}
+
+/* Deja un marco en el mailbox de salida de la FIFO, como el hardware */
+static void load_frame(uint32_t fifo, uint32_t std_id, int rtr, uint32_t fmi, uint32_t dlc, uint8_t first_byte)
+{
+  CAN_FIFOMailBox_TypeDef* mailbox = &can_ip.sFIFOMailBox[fifo];
+  mailbox->RIR = (std_id << CAN_RI0R_STID_Pos) | (rtr ? CAN_RI0R_RTR : 0U);
+  mailbox->RDTR = (0x1234U << CAN_RDT0R_TIME_Pos) | (fmi << CAN_RDT0R_FMI_Pos) | dlc;
+  mailbox->RDLR = first_byte;
+  mailbox->RDHR = 0;
+
+  if(fifo == CAN_RX_FIFO0)
+  {
+    can_ip.RF0R = 1U | CAN_RF0R_FULL0 | CAN_RF0R_FOVR0;
+  }
+  else
+  {
+    can_ip.RF1R = 1U | CAN_RF1R_FULL1 | CAN_RF1R_FOVR1;
+  }
+}
+
+static void reset_seen(void)
+{
+  seen_remote = (seen){0};
+  seen_data = (seen){0};
+  seen_range = (seen){0};
+  rx_counted = 0;
+}
+
+int main(void)
+{
+  /* FMI 0 y 1 en FIFO0, un rango en FIFO1 (FMI 0 y 1 del mismo banco) */
+  CHECK(can_register_handler(&hcan, 0x001, CAN_RTR_REMOTE, on_remote) == 0);
+  CHECK(can_register_handler(&hcan, 0x001, CAN_RTR_DATA, on_data) == 1);
+  CHECK(can_register_mask_handler(&hcan, 0x180, 0x780, on_range) == 0);
+
+  /* RTR del panel por FIFO0 */
+  reset_seen();
+  load_frame(CAN_RX_FIFO0, 0x001, 1, 0, 0, 0);
+  can_dispatch_fifo(&hcan, CAN_RX_FIFO0);
+  CHECK(seen_remote.calls == 1 && seen_data.calls == 0 && seen_range.calls == 0);
+  CHECK(seen_remote.mailbox == &can_ip.sFIFOMailBox[0]);
+  CHECK(seen_remote.std_id == 0x001 && seen_remote.rtr == 1);
+  CHECK(can_ip.RF0R == CAN_RF0R_RFOM0);
+  CHECK(rx_counted == 1);
+
+  /* Comando del panel por FIFO0 */
+  reset_seen();
+  load_frame(CAN_RX_FIFO0, 0x001, 0, 1, 3, 0x42);
+  can_dispatch_fifo(&hcan, CAN_RX_FIFO0);
+  CHECK(seen_data.calls == 1 && seen_remote.calls == 0);
+  CHECK(seen_data.fifo == CAN_RX_FIFO0 && seen_data.dlc == 3 && seen_data.first_byte == 0x42);
+  CHECK(can_ip.RF0R == CAN_RF0R_RFOM0);
+
+  /* FMI sin handler: se libera sin llamar a nadie */
+  reset_seen();
+  load_frame(CAN_RX_FIFO0, 0x005, 0, 7, 1, 0);
+  can_dispatch_fifo(&hcan, CAN_RX_FIFO0);
+  CHECK(seen_remote.calls == 0 && seen_data.calls == 0 && seen_range.calls == 0);
+  CHECK(can_ip.RF0R == CAN_RF0R_RFOM0);
+  CHECK(rx_counted == 1);
+
+  /* Rango por FIFO1, los dos filtros del banco van al mismo handler */
+  for(uint32_t fmi = 0; fmi < 2; fmi++)
+  {
+    reset_seen();
+    load_frame(CAN_RX_FIFO1, 0x185, 0, fmi, 8, 0x99);
+    can_dispatch_fifo(&hcan, CAN_RX_FIFO1);
+    CHECK(seen_range.calls == 1 && seen_data.calls == 0);
+    CHECK(seen_range.mailbox == &can_ip.sFIFOMailBox[1] && seen_range.fifo == CAN_RX_FIFO1);
+    CHECK(seen_range.std_id == 0x185 && seen_range.first_byte == 0x99);
+    CHECK(can_ip.RF1R == CAN_RF1R_RFOM1);
+  }
+
+  /* FMI de un banco de FIFO1 sin rango registrado */
+  reset_seen();
+  load_frame(CAN_RX_FIFO1, 0x185, 0, 2, 8, 0);
+  can_dispatch_fifo(&hcan, CAN_RX_FIFO1);
+  CHECK(seen_range.calls == 0);
+  CHECK(can_ip.RF1R == CAN_RF1R_RFOM1);
+
+  /* FIFO vacia: no hay handler ni escritura, FULL y FOVR siguen pendientes */
+  reset_seen();
+  can_ip.RF0R = CAN_RF0R_FULL0 | CAN_RF0R_FOVR0;
+  can_dispatch_fifo(&hcan, CAN_RX_FIFO0);
+  CHECK(seen_remote.calls == 0 && seen_data.calls == 0);
+  CHECK(can_ip.RF0R == (CAN_RF0R_FULL0 | CAN_RF0R_FOVR0));
+  CHECK(rx_counted == 0);
+
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures != 0;
+}
+
+/* Lo que can.c usa del resto del firmware y de la HAL */
+
+void Error_Handler(void)
+{
+  printf("FAIL Error_Handler()\n");
+  failures++;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef* handle, CAN_FilterTypeDef* filter)
+{
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* handle, uint32_t interrupts)
+{
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef* handle)
+{
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef* handle)
+{
+  return HAL_OK;
+}
+
+void HAL_CAN_IRQHandler(CAN_HandleTypeDef* handle)
+{
+}
+
+uint32_t HAL_GetTick(void)
+{
+  return 1;
+}
+
+/* Se llama una vez por marco. Cada caso carga uno, si la FIFO no se vacia al
+ * liberarlo se corta el ciclo para que la prueba falle en vez de colgarse */
+void can_health_count_rx(const can_rx_view* frame)
+{
+  rx_counted++;
+  if(rx_counted > 1U)
+  {
+    can_ip.RF0R = 0;
+    can_ip.RF1R = 0;
+  }
+}
+
+void can_health_count_tx(can_handle* handle, uint32_t mailbox)
+{
+}
+
+void can_health_count_abort(void)
+{
+}
+
+void can_health_count_drop(void)
+{
+}
+
+void can_health_on_error(can_handle* handle, uint32_t error_code)
+{
+}
+
+int can_schedule_defer(can_handle* handle, uint32_t start_us, uint16_t poll_time)
+{
+  return 0;
+}
+
+void can_tx_build_image(uint32_t std_id, const uint8_t* data, int bytes, can_tx_image* image)
+{
+}
+
+int can_tx_send(can_handle* handle, can_tx_class tx_class, uint32_t std_id,
+                const uint8_t* data, int bytes, uint32_t deadline_ms)
+{
+  return 0;
+}
+
+int can_tx_send_image(can_handle* handle, can_tx_class tx_class, const can_tx_image* image,
+                      uint32_t deadline_ms, uint32_t tag)
+{
+  return 0;
+}
+
+int can_tx_write_mailbox(can_handle* handle, const can_tx_image* image, can_tx_class tx_class)
+{
+  return 0;
+}
+
+void can_tx_mailbox_done(can_handle* handle, uint32_t mailbox, int sent)
+{
+}
+
+uint32_t can_tx_mailbox_tag(uint32_t mailbox)
+{
+  return CAN_TX_NO_TAG;
+}
+
+int aggregator_is_claimed(void)
+{
+  return 0;
+}
+
+const config_values* config_get(void)
+{
+  static config_values values;
+  return &values;
+}
+
+uint8_t node_id_get(void)
+{
+  return 0x10;
+}
+
+uint32_t timebase_now_us(void)
+{
+  return 0;
+}
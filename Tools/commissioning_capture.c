@@ -0,0 +1,196 @@
+/**
+ * @file 	commissioning_capture.c
+ * @brief	Host side of the commissioning stream: captures the USART stream to
+ * 		a file and replays a capture as CSV
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación, desde la raiz del repositorio:
+ *   gcc -O2 -ICore/Inc Tools/commissioning_capture.c Core/Src/crc.c -o commissioning_capture
+ *
+ * Captura, hasta Ctrl-C, los bytes tal cual llegan del puerto:
+ *   ./commissioning_capture /dev/ttyUSB0 probe.bin
+ *
+ * Reproducción, una linea por marco valido: secuencia, tiempo del nodo en µs,
+ * tipo (adc o capture) y los valores crudos. Los marcos con CRC invalido y los
+ * saltos de secuencia se reportan en stderr.
+ *   ./commissioning_capture -r probe.bin > probe.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "crc.h"
+
+/* Deben coincidir con commissioning.h */
+#define SYNC 0xA5U
+#define MAX_PAYLOAD 16U
+#define TYPE_ADC 1U
+#define TYPE_CAPTURE 2U
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal)
+{
+  (void)signal;
+  running = 0;
+}
+
+static int capture(const char* device, const char* path)
+{
+  const int port = open(device, O_RDONLY | O_NOCTTY);
+  if(port < 0)
+  {
+    perror(device);
+    return 1;
+  }
+
+  struct termios tty;
+  if(tcgetattr(port, &tty) != 0)
+  {
+    perror(device);
+    return 1;
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B921600);
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  if(tcsetattr(port, TCSANOW, &tty) != 0)
+  {
+    perror(device);
+    return 1;
+  }
+
+  FILE* file = fopen(path, "wb");
+  if(file == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  signal(SIGINT, stop);
+  unsigned long total = 0;
+  uint8_t buffer[4096];
+  while(running)
+  {
+    const ssize_t got = read(port, buffer, sizeof(buffer));
+    if(got <= 0)
+    {
+      continue;
+    }
+    fwrite(buffer, 1, (size_t)got, file);
+    total += (unsigned long)got;
+  }
+
+  fclose(file);
+  close(port);
+  fprintf(stderr, "%lu bytes\n", total);
+  return 0;
+}
+
+static uint32_t word_at(const uint8_t* bytes)
+{
+  return bytes[0] | (bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static int replay(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t* data = malloc((size_t)size);
+  if(data == NULL || fread(data, 1, (size_t)size, file) != (size_t)size)
+  {
+    fprintf(stderr, "%s: can't read\n", path);
+    return 1;
+  }
+  fclose(file);
+
+  printf("sequence,time_us,type,values\n");
+
+  unsigned long frames = 0;
+  unsigned long skipped = 0;
+  int previous = -1;
+  long position = 0;
+  while(position + 12 <= size)
+  {
+    const uint8_t type = data[position + 1];
+    const uint32_t words = data[position + 2];
+    const long length = (long)(words + 3U) * 4;
+    if(data[position] != SYNC || (type != TYPE_ADC && type != TYPE_CAPTURE) ||
+       words > MAX_PAYLOAD || position + length > size)
+    {
+      position++;
+      skipped++;
+      continue;
+    }
+
+    uint32_t frame[MAX_PAYLOAD + 3U];
+    for(uint32_t i = 0; i < words + 3U; i++)
+    {
+      frame[i] = word_at(&data[position + 4 * (long)i]);
+    }
+    if(crc_words(frame, words + 2U) != frame[words + 2U])
+    {
+      position++;
+      skipped++;
+      continue;
+    }
+
+    const uint8_t sequence = data[position + 3];
+    if(previous >= 0 && sequence != (uint8_t)(previous + 1))
+    {
+      fprintf(stderr, "frames lost before sequence %u\n", sequence);
+    }
+    previous = sequence;
+
+    if(type == TYPE_ADC)
+    {
+      printf("%u,%u,adc,%u,%u\n", sequence, frame[1], frame[2] & 0xFFFFU, frame[2] >> 16);
+    }
+    else
+    {
+      printf("%u,%u,capture", sequence, frame[1]);
+      for(uint32_t i = 0; i < words; i++)
+      {
+        printf(",%u", frame[2U + i]);
+      }
+      printf("\n");
+    }
+    frames++;
+    position += length;
+  }
+
+  fprintf(stderr, "%lu frames, %lu bytes skipped\n", frames, skipped);
+  free(data);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc == 3 && strcmp(argv[1], "-r") == 0)
+  {
+    return replay(argv[2]);
+  }
+  if(argc == 3)
+  {
+    return capture(argv[1], argv[2]);
+  }
+
+  fprintf(stderr, "usage: %s <serial device> <capture file> | -r <capture file>\n", argv[0]);
+  return 2;
+}
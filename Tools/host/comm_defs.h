@@ -0,0 +1,19 @@
+/**
+ * @file	comm_defs.h
+ * @brief	Stand-in of the definitions shared with the control panel, for the
+ * 		host tests under Tools/
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * El firmware toma comm_defs.h del proyecto del panel de control. Las pruebas
+ * del host compilan can.c y node_id.c, que lo incluyen pero no usan nada de
+ * él; este archivo solo existe para que se encuentre.
+ */
+
+#ifndef COMM_DEFS_H_
+#define COMM_DEFS_H_
+
+#endif /* COMM_DEFS_H_ */
@@ -0,0 +1,315 @@
+/**
+ * @file 	log_bench.c
+ * @brief	Host benchmark of log_codec.c on synthetic compost curves: compression
+ * 		ratio, history that fits in the flash log and Cortex-M0 cycles of the
+ * 		encoder
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación, desde la raiz del repositorio:
+ *   gcc -O2 -ICore/Inc Tools/log_bench.c Core/Src/log_codec.c -lm -o log_bench
+ *   ./log_bench [dias]
+ *
+ * Cada escenario se muestrea cada segundo, como main.c, y se codifica en
+ * bloques del tamaño de una pagina del registro igual que flash_log.c. Todo
+ * bloque se decodifica y se compara con la entrada.
+ *
+ * Los ciclos por muestra son DERIVADOS, no medidos: se suma, por cada muestra,
+ * el costo del camino que toma log_encode() en el código para Cortex-M0, ver
+ * m0_encode_cycles(). En el nodo, flash_log.c mide los ciclos de log_encode()
+ * con SysTick y los publica en el diccionario de objetos (indices 0x52 y 0x53).
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "log_codec.h"
+
+/* Deben coincidir con flash_log.h */
+#define DATA_HALFWORDS 1014U
+#define DATA_BITS (DATA_HALFWORDS * 16U)
+#define LOG_PAGES 40U /* Nivel de lecturas */
+
+#define SAMPLE_PERIOD_US 1000000U
+#define RECORD_BITS 64U
+#define CORE_MHZ 48.0
+
+/*
+ * Ciclos de log_encode() en el Cortex-M0. Los costos de cada camino salen del
+ * listado de log_codec.c para thumbv6m con -Os (LLVM 14, opt -Os y llc; no
+ * habia arm-none-eabi-gcc a mano, el de GCC puede variar unos ciclos), con los
+ * tiempos de la TRM del Cortex-M0: 1 ciclo por instrucción, 2 por carga o
+ * escritura, 1+N por push, 3+N por pop con retorno, 3 por salto tomado y 4 por
+ * BL. put_bits() queda como función aparte; put_delta() la lleva en linea solo
+ * para la diferencia en cero, y log_encode() para las banderas.
+ *
+ * No incluye los estados de espera de la flash: a 48 MHz hay uno, y el buffer de
+ * prebusqueda lo oculta salvo en los saltos tomados, cerca de un 5% mas.
+ * Comparado instrucción por instrucción contra un simulador del listado en las
+ * curvas de este programa, el modelo da los mismos ciclos en cada muestra.
+ */
+#define M0_PUT_BITS 37U /* Llamada a put_bits(), sin contar el BL */
+#define M0_PUT_BITS_EMIT 50U /* Idem, completando una media palabra */
+#define M0_DELTA_ZERO 45U /* put_delta() con diferencia en cero */
+#define M0_DELTA_ZERO_EMIT 59U
+#define M0_DELTA_FITS 70U /* Mas M0_DELTA_STEP por cada ancho probado antes y dos put_bits() */
+#define M0_DELTA_STEP 15U
+#define M0_DELTA_FULL16 104U /* Ancho completo de 16 bits, mas dos put_bits() */
+#define M0_DELTA_FULL24 113U /* Ancho completo de 24 bits, mas tres put_bits() */
+#define M0_ENCODE_BASE (42U + 19U + 23U) /* log_encode() sin las diferencias, las banderas ni el final */
+#define M0_FLAGS_SAME 26U
+#define M0_FLAGS_SAME_EMIT 42U
+#define M0_FLAGS_CHANGED 44U /* Mas 21 si el bit de cambio completa media palabra, 13 si la completan las banderas */
+#define M0_TAIL 44U
+#define M0_TAIL_FIRST 42U /* Primera muestra del bloque */
+
+/* Deben coincidir con log_codec.c */
+static const uint8_t time_widths[3] = { 4, 9, 14 };
+static const uint8_t value_widths[3] = { 4, 7, 10 };
+
+typedef struct scenario {
+  const char* name;
+  double (*temp)(double hours);
+  double (*rh)(double hours);
+  double temp_noise; /* Centesimas, desviación estandar */
+  double rh_noise;
+  double fail_rate; /* Fracción de horas con la sonda de temperatura en falla */
+} scenario;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static double uniform(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (double)(rng_state >> 11) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+  const double u = uniform() + 1e-12;
+  return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * uniform());
+}
+
+/* Fase mesofila: de ambiente a termofila en unos dos dias */
+static double temp_startup(double hours)
+{
+  return 22.0 + 43.0 / (1.0 + exp(-(hours - 30.0) / 6.0)) + 0.8 * sin(hours * 0.2618);
+}
+
+/* Fase termofila con volteos cada 72 h: caida de 15 °C y recuperación en horas */
+static double temp_thermophilic(double hours)
+{
+  const double since_turn = fmod(hours, 72.0);
+  const double dip = (since_turn < 0.1) ? 150.0 * since_turn : 15.0 * exp(-(since_turn - 0.1) / 2.0);
+  return 64.0 - dip + 1.2 * sin(hours * 0.2618);
+}
+
+/* Enfriamiento y maduración */
+static double temp_cooling(double hours)
+{
+  return 26.0 + 30.0 * exp(-hours / 96.0) + 1.5 * sin(hours * 0.2618);
+}
+
+static double rh_steady(double hours)
+{
+  return 58.0 + 4.0 * sin(hours * 0.2618 + 1.0) - 0.02 * hours;
+}
+
+/* Riego cada 24 h */
+static double rh_watered(double hours)
+{
+  return 50.0 + 20.0 * exp(-fmod(hours, 24.0) / 5.0);
+}
+
+static const scenario scenarios[] = {
+  { "arranque", temp_startup, rh_steady, 2.0, 8.0, 0.0 },
+  { "termofila", temp_thermophilic, rh_watered, 3.0, 10.0, 0.0 },
+  { "enfriamiento", temp_cooling, rh_steady, 2.0, 8.0, 0.0 },
+  { "sonda ruidosa", temp_thermophilic, rh_watered, 15.0, 40.0, 0.0 },
+  { "fallas", temp_thermophilic, rh_watered, 3.0, 10.0, 0.05 },
+};
+
+static int32_t sign_extend(uint32_t value, uint8_t width)
+{
+  return (int32_t)(value << (32U - width)) >> (32U - width);
+}
+
+/* Bits pendientes de put_bits(), 1 si se completa una media palabra */
+static int m0_bits(uint32_t* pending, uint32_t width)
+{
+  *pending += width;
+  if(*pending >= 16U)
+  {
+    *pending -= 16U;
+    return 1;
+  }
+  return 0;
+}
+
+static uint32_t m0_put_bits(uint32_t* pending, uint32_t width)
+{
+  return m0_bits(pending, width) ? M0_PUT_BITS_EMIT : M0_PUT_BITS;
+}
+
+static uint32_t m0_put_delta(uint32_t* pending, int32_t delta, const uint8_t* widths, uint32_t full)
+{
+  if(delta == 0)
+  {
+    return m0_bits(pending, 1) ? M0_DELTA_ZERO_EMIT : M0_DELTA_ZERO;
+  }
+
+  for(uint32_t i = 0; i < 3; i++)
+  {
+    const int32_t range = 1L << (widths[i] - 1U);
+    if(delta >= -range && delta < range)
+    {
+      const uint32_t prefix = m0_put_bits(pending, i + 2U);
+      return M0_DELTA_FITS + M0_DELTA_STEP * i + prefix + m0_put_bits(pending, widths[i]);
+    }
+  }
+
+  const uint32_t prefix = m0_put_bits(pending, 4);
+  if(full > 16U)
+  {
+    const uint32_t high = m0_put_bits(pending, full - 16U);
+    return M0_DELTA_FULL24 + prefix + high + m0_put_bits(pending, 16);
+  }
+  return M0_DELTA_FULL16 + prefix + m0_put_bits(pending, 16);
+}
+
+/* Ciclos que tomara log_encode() con este estado y esta muestra */
+static uint32_t m0_encode_cycles(const log_encoder* encoder, const log_sample* sample)
+{
+  const log_codec_state* last = &encoder->last;
+  uint32_t pending = encoder->pending_bits;
+  uint32_t cycles = M0_ENCODE_BASE;
+
+  const int32_t delta = sign_extend(sample->time - last->time, LOG_CODEC_TIME_BITS);
+  const int32_t dod = sign_extend((uint32_t)(delta - last->delta), LOG_CODEC_TIME_BITS);
+  cycles += m0_put_delta(&pending, dod, time_widths, LOG_CODEC_TIME_BITS);
+  cycles += m0_put_delta(&pending, (int16_t)(sample->temp - last->temp), value_widths, 16);
+  cycles += m0_put_delta(&pending, (int16_t)(sample->rh - last->rh), value_widths, 16);
+
+  if(sample->flags == last->flags)
+  {
+    cycles += m0_bits(&pending, 1) ? M0_FLAGS_SAME_EMIT : M0_FLAGS_SAME;
+  }
+  else
+  {
+    cycles += M0_FLAGS_CHANGED;
+    cycles += m0_bits(&pending, 1) ? 21U : 0U;
+    cycles += m0_bits(&pending, 8) ? 13U : 0U;
+  }
+
+  return cycles + ((last->count == 0U) ? M0_TAIL_FIRST : M0_TAIL);
+}
+
+static int same(const log_sample* a, const log_sample* b)
+{
+  return a->time == b->time && a->temp == b->temp && a->rh == b->rh && a->flags == b->flags;
+}
+
+/* Decodifica un bloque y lo compara con las muestras que se codificaron */
+static int verify(const uint16_t* block, uint32_t halfwords, const log_sample* samples, uint32_t count)
+{
+  log_decoder decoder;
+  log_sample sample;
+  log_decoder_reset(&decoder, block, halfwords * 16U);
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if(!log_decode(&decoder, &sample) || !same(&sample, &samples[i]))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void run(const scenario* s, double days)
+{
+  const uint32_t total = (uint32_t)(days * 86400.0);
+  log_sample* samples = malloc(total * sizeof(log_sample));
+  uint16_t block[DATA_HALFWORDS + LOG_CODEC_MAX_HALFWORDS];
+
+  /* Lecturas */
+  uint8_t failing = 0;
+  for(uint32_t i = 0; i < total; i++)
+  {
+    const double hours = i / 3600.0;
+    if(i % 3600U == 0U)
+    {
+      failing = uniform() < s->fail_rate;
+    }
+
+    /* El SYNC corrige el tiempo del bus por unos µs */
+    const uint64_t bus_us = (uint64_t)i * SAMPLE_PERIOD_US + (uniform() < 0.01 ? (uint64_t)(uniform() * 40.0) : 0U);
+    samples[i].time = (uint32_t)(bus_us >> 8) & 0xFFFFFFU;
+    samples[i].temp = failing ? -4000 : (int16_t)lround(s->temp(hours) * 100.0 + s->temp_noise * gaussian());
+    samples[i].rh = (uint16_t)lround(s->rh(hours) * 100.0 + s->rh_noise * gaussian());
+    samples[i].flags = failing ? 1U : 0U;
+  }
+
+  /* Codificación por paginas */
+  log_encoder encoder;
+  uint64_t bits = 0;
+  uint32_t pages = 0;
+  uint32_t first = 0;
+  uint32_t written = 0;
+  uint64_t cycles = 0;
+  uint32_t cycles_max = 0;
+  int ok = 1;
+
+  log_encoder_reset(&encoder);
+  for(uint32_t i = 0; i < total; i++)
+  {
+    const uint32_t sample_cycles = m0_encode_cycles(&encoder, &samples[i]);
+    cycles += sample_cycles;
+    if(sample_cycles > cycles_max)
+    {
+      cycles_max = sample_cycles;
+    }
+
+    written += log_encode(&encoder, &samples[i], &block[written]);
+
+    if(DATA_BITS - encoder.total_bits < LOG_CODEC_MAX_SAMPLE_BITS || i + 1U == total)
+    {
+      written += log_encoder_flush(&encoder, &block[written]);
+      ok &= verify(block, written, &samples[first], i + 1U - first);
+      bits += encoder.total_bits;
+      pages++;
+      first = i + 1U;
+      written = 0;
+      log_encoder_reset(&encoder);
+    }
+  }
+
+  const double bits_per_sample = (double)bits / total;
+  const double per_page = (double)total / pages;
+  const double cycles_mean = (double)cycles / total;
+  printf("%-14s %9u %7.2f %6.2fx %8.0f %8.1f h %8.1f h %7.0f %6u %6.1f us  %s\n", s->name, total, bits_per_sample,
+         RECORD_BITS / bits_per_sample, per_page, per_page * LOG_PAGES / 3600.0,
+         (DATA_BITS / RECORD_BITS) * LOG_PAGES / 3600.0, cycles_mean, cycles_max, cycles_mean / CORE_MHZ,
+         ok ? "ok" : "MISMATCH");
+
+  free(samples);
+}
+
+int main(int argc, char** argv)
+{
+  const double days = (argc > 1) ? atof(argv[1]) : 3.0;
+
+  printf("%-14s %9s %7s %7s %8s %10s %10s %7s %6s %9s\n", "escenario", "muestras", "bits", "razon", "por pag",
+         "historia", "sin comp", "ciclos", "max", "a 48 MHz");
+  printf("%-14s ciclos de Cortex-M0 por muestra derivados del listado, sin estados de espera\n", "");
+  for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+  {
+    run(&scenarios[i], days);
+  }
+  return 0;
+}
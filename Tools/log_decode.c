@@ -0,0 +1,154 @@
+/**
+ * @file 	log_decode.c
+ * @brief	Host decoder of the flash log: reads a dump of the log pages and
+ * 		prints the readings as CSV
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación, desde la raiz del repositorio:
+ *   gcc -O2 -ICore/Inc Tools/log_decode.c Core/Src/log_codec.c Core/Src/crc.c -o log_decode
+ *
+ * El volcado es la región del registro, por ejemplo con st-flash:
+ *   st-flash read log.bin 0x0801F800 0x20000
+ *   ./log_decode log.bin > log.csv
+ *
+ * La salida tiene una linea por registro: nivel (0 lecturas, 1 medias de 1
+ * minuto, 2 medias de 1 hora), indice absoluto dentro del nivel, reloj del
+ * registro en segundos, tiempo en unidades de 256 us (24 bits, da la vuelta
+ * cada ~71 minutos), temperatura en °C, %RH y banderas de error. Las paginas
+ * con CRC invalido se reportan en stderr y se decodifican de todas formas.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log_codec.h"
+#include "crc.h"
+
+/* Deben coincidir con flash_log.h */
+#define PAGE_SIZE 2048U
+#define DATA_HALFWORDS ((PAGE_SIZE - 20U) / 2U)
+#define INDEX_STRIDE 4096U
+#define MAGIC 0x4C48U
+#define CRC_WORDS ((PAGE_SIZE - 8U) / 4U)
+
+typedef struct page {
+  uint16_t magic;
+  uint8_t tier;
+  uint8_t reserved;
+  uint32_t sequence;
+  uint32_t start_seconds;
+  uint16_t data[DATA_HALFWORDS];
+  uint32_t crc;
+  uint16_t count;
+  uint16_t end_magic;
+} page;
+
+static int by_tier_and_sequence(const void* a, const void* b)
+{
+  const page* pa = *(const page* const*)a;
+  const page* pb = *(const page* const*)b;
+  if(pa->tier != pb->tier)
+  {
+    return pa->tier - pb->tier;
+  }
+  return (pa->sequence > pb->sequence) - (pa->sequence < pb->sequence);
+}
+
+int main(int argc, char** argv)
+{
+  if(argc != 2)
+  {
+    fprintf(stderr, "usage: %s <log dump>\n", argv[0]);
+    return 2;
+  }
+
+  FILE* file = fopen(argv[1], "rb");
+  if(file == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  const uint32_t pages = (uint32_t)(size / PAGE_SIZE);
+  page* dump = malloc(pages * sizeof(page));
+  page** used = malloc(pages * sizeof(page*));
+  if(dump == NULL || used == NULL || fread(dump, sizeof(page), pages, file) != pages)
+  {
+    fprintf(stderr, "%s: can't read %u pages\n", argv[1], pages);
+    return 1;
+  }
+  fclose(file);
+
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < pages; i++)
+  {
+    if(dump[i].magic == MAGIC)
+    {
+      used[count++] = &dump[i];
+    }
+  }
+  qsort(used, count, sizeof(page*), by_tier_and_sequence);
+
+  printf("tier,index,seconds,time_256us,temp_c,rh,flags\n");
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    const page* p = used[i];
+    uint32_t limit = DATA_HALFWORDS;
+    uint32_t records = INDEX_STRIDE;
+
+    if(p->end_magic == MAGIC)
+    {
+      records = p->count;
+      if(crc_words((const uint32_t*)p, CRC_WORDS) != p->crc)
+      {
+        fprintf(stderr, "page %u: bad CRC\n", p->sequence);
+      }
+    }
+    else
+    {
+      /* Pagina abierta, hasta la ultima media palabra programada */
+      while(limit > 0 && p->data[limit - 1U] == 0xFFFFU)
+      {
+        limit--;
+      }
+    }
+
+    log_decoder decoder;
+    log_sample sample;
+    uint64_t units = 0;
+    uint32_t previous = 0;
+    log_decoder_reset(&decoder, p->data, limit * 16U);
+
+    for(uint32_t n = 0; n < records && log_decode(&decoder, &sample); n++)
+    {
+      /* Mismo reloj que record_advance() de flash_log.c */
+      const int32_t delta = (int32_t)((sample.time - previous) << 8) >> 8;
+      if(n > 0 && p->tier != 0)
+      {
+        units += (sample.time - previous) & 0xFFFFFFU;
+      }
+      else if(n > 0 && delta > 0)
+      {
+        units += (uint32_t)delta;
+      }
+      previous = sample.time;
+
+      printf("%u,%lu,%lu,%u,%.2f,%.2f,%u\n", p->tier, (unsigned long)p->sequence * INDEX_STRIDE + n,
+             (unsigned long)(p->start_seconds + (units * 256U) / 1000000U), sample.time,
+             sample.temp / 100.0, sample.rh / 100.0, sample.flags);
+    }
+  }
+
+  free(used);
+  free(dump);
+  return 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file 	time_sync_sim.c
+ * @brief	Host simulation of several nodes disciplined by the SYNC frames of
+ * 		the panel, measures the skew between their sample instants
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación, desde la raiz del repositorio:
+ *   gcc -O2 -DSTM32F091xC -DUSE_HAL_DRIVER -ICore/Inc -ICore/Src \
+ *     -IDrivers/STM32F0xx_HAL_Driver/Inc -IDrivers/CMSIS/Device/ST/STM32F0xx/Include \
+ *     -IDrivers/CMSIS/Include Tools/time_sync_sim.c -lm -o time_sync_sim
+ *   ./time_sync_sim [nodos] [segundos] [semilla]
+ *
+ * Cada nodo corre el timebase.c del firmware, en su propio proceso, con
+ * SysTick y el tick de la HAL derivados de un cristal con error aleatorio de
+ * hasta +-NODE_PPM. El panel manda un SYNC por segundo con su tiempo en el SOF
+ * (su cristal tambien tiene error). Cada nodo:
+ * - recibe el SYNC al terminar el marco, con el relleno de bits variable, y
+ *   entra al interrupt con una latencia aleatoria de 0 a ISR_JITTER_US.
+ * - tiene el contador de marcas de bxCAN corrido una cantidad aleatoria.
+ * - muestrea como main.c: en cada vuelta del ciclo compara timebase_bus_us()
+ *   con el siguiente multiplo de SAMPLE_PERIOD_US, y la vuelta tarda de 0 a
+ *   LOOP_US.
+ *
+ * Se comparan dos formas de tomar el instante local del SYNC: la entrada al
+ * interrupt (timebase_now_us()) y el SOF de hardware (timebase_sof_local_us()).
+ * Para cada segundo, pasado SETTLE_S, la diferencia entre el primer y el ultimo
+ * nodo en muestrear; se reporta la maxima y la media. Los tiempos son del
+ * reloj ideal de la simulación.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "timebase.h"
+
+/* timebase.c lee SysTick y SCB, se redirigen a registros simulados. Cada
+ * nodo es un solo hilo, las secciones criticas no hacen nada */
+static SysTick_Type fake_systick;
+static SCB_Type fake_scb;
+#undef SysTick
+#define SysTick (&fake_systick)
+#undef SCB
+#define SCB (&fake_scb)
+#define __get_PRIMASK() 0U
+#define __disable_irq() do {} while(0)
+#define __set_PRIMASK(primask) (void)(primask)
+#include "timebase.c"
+
+#define NODE_PPM 50.0
+#define MASTER_PPM 20.0
+#define ISR_JITTER_US 10.0
+#define FRAME_US 70.0 /* SYNC de 5 bytes a 1 Mbit/s */
+#define STUFF_BITS 4 /* Relleno de 0 a STUFF_BITS - 1 bits, depende del tiempo enviado */
+#define SYNC_PHASE_US 500000.0 /* Los SYNC caen a mitad del periodo de muestreo */
+#define SAMPLE_PERIOD_US 1000000U
+#define SETTLE_S 30
+#define CORE_HZ 48000000.0
+
+uint32_t SystemCoreClock = (uint32_t)CORE_HZ;
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_1KHZ;
+
+/* Reloj del nodo simulado */
+static double node_scale; /* 1 + error del cristal */
+static double node_boot_us; /* Tiempo ideal del arranque del nodo */
+static uint16_t node_can_offset;
+static double sim_us; /* Tiempo ideal actual */
+
+static double local_us_at(double t)
+{
+  return (t - node_boot_us) * node_scale;
+}
+
+/* Pone el reloj simulado en un instante ideal */
+static void set_time(double t)
+{
+  sim_us = t;
+  const uint64_t cycles = (uint64_t)(local_us_at(t) * (CORE_HZ / 1e6));
+  fake_systick.LOAD = (uint32_t)(CORE_HZ / 1000.0) - 1U;
+  fake_systick.VAL = fake_systick.LOAD - (uint32_t)(cycles % (fake_systick.LOAD + 1U));
+}
+
+uint32_t HAL_GetTick(void)
+{
+  const uint64_t cycles = (uint64_t)(local_us_at(sim_us) * (CORE_HZ / 1e6));
+  return (uint32_t)(cycles / (fake_systick.LOAD + 1U));
+}
+
+static double uniform(double max)
+{
+  return max * (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+/* Primer instante ideal, desde from, en que timebase_bus_us() llega a target */
+static double crossing(double from, double to, uint32_t target)
+{
+  while(to - from > 0.5)
+  {
+    const double middle = (from + to) / 2.0;
+    set_time(middle);
+    if((int32_t)(timebase_bus_us() - target) >= 0)
+    {
+      to = middle;
+    }
+    else
+    {
+      from = middle;
+    }
+  }
+  return to;
+}
+
+/* Corre un nodo y deja el instante ideal de cada muestra en samples[] */
+static void run_node(int seconds, int use_sof, double loop_us, double* samples)
+{
+  node_scale = 1.0 + (uniform(2.0) - 1.0) * NODE_PPM * 1e-6;
+  node_boot_us = -uniform(60e6);
+  node_can_offset = (uint16_t)rand();
+  const double master_scale = 1.0 + MASTER_PPM * 1e-6;
+
+  uint32_t next_sample_us = 0;
+  int aligned = 0;
+
+  for(int second = 0; second < seconds; second++)
+  {
+    /* SYNC de este segundo */
+    const double sof = second * 1e6 + SYNC_PHASE_US;
+    const double isr = sof + FRAME_US + (double)(rand() % STUFF_BITS) + uniform(ISR_JITTER_US);
+    const uint32_t master_us = (uint32_t)(uint64_t)(sof * master_scale);
+    const uint16_t stamp = (uint16_t)((uint32_t)local_us_at(sof) + node_can_offset);
+
+    set_time(isr);
+    const uint32_t now_us = timebase_now_us();
+    timebase_sync(master_us, use_sof ? timebase_sof_local_us(stamp, now_us) : now_us);
+
+    /* La muestra del segundo siguiente, entre este SYNC y el proximo */
+    set_time(isr + 1000.0);
+    const uint32_t bus_now = timebase_bus_us();
+    if(!aligned || (int32_t)(bus_now - next_sample_us) >= (int32_t)SAMPLE_PERIOD_US)
+    {
+      next_sample_us = bus_now - (bus_now % SAMPLE_PERIOD_US) + SAMPLE_PERIOD_US;
+      aligned = 1;
+    }
+
+    const double at = crossing(isr + 1000.0, isr + 1e6 - 1000.0, next_sample_us);
+    samples[second] = at + uniform(loop_us);
+    next_sample_us += SAMPLE_PERIOD_US;
+  }
+}
+
+static void simulate(int nodes, int seconds, unsigned seed, int use_sof, double loop_us)
+{
+  double* samples = mmap(NULL, sizeof(double) * (size_t)nodes * (size_t)seconds,
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(samples == MAP_FAILED)
+  {
+    perror("mmap");
+    exit(1);
+  }
+
+  /* Un proceso por nodo, timebase.c guarda su estado en variables estaticas */
+  for(int node = 0; node < nodes; node++)
+  {
+    const pid_t pid = fork();
+    if(pid == 0)
+    {
+      srand(seed * 1000U + (unsigned)node);
+      run_node(seconds, use_sof, loop_us, &samples[node * seconds]);
+      _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+  }
+
+  double worst = 0.0;
+  double total = 0.0;
+  int count = 0;
+  for(int second = SETTLE_S; second < seconds; second++)
+  {
+    double first = samples[second];
+    double last = samples[second];
+    for(int node = 1; node < nodes; node++)
+    {
+      first = fmin(first, samples[node * seconds + second]);
+      last = fmax(last, samples[node * seconds + second]);
+    }
+    worst = fmax(worst, last - first);
+    total += last - first;
+    count++;
+  }
+
+  printf("%-9s loop 0-%2.0f us: max %5.1f us, mean %5.1f us\n",
+         use_sof ? "SOF" : "interrupt", loop_us, worst, total / count);
+  munmap(samples, sizeof(double) * (size_t)nodes * (size_t)seconds);
+}
+
+int main(int argc, char** argv)
+{
+  const int nodes = (argc > 1) ? atoi(argv[1]) : 8;
+  const int seconds = (argc > 2) ? atoi(argv[2]) : 3600;
+  const unsigned seed = (argc > 3) ? (unsigned)atoi(argv[3]) : 1U;
+
+  if(nodes < 2 || seconds <= SETTLE_S)
+  {
+    fprintf(stderr, "usage: %s [nodes >= 2] [seconds > %d] [seed]\n", argv[0], SETTLE_S);
+    return 2;
+  }
+
+  printf("%d nodes, %d s, +-%.0f ppm, interrupt jitter 0-%.0f us\n", nodes, seconds, NODE_PPM, ISR_JITTER_US);
+  simulate(nodes, seconds, seed, 0, 0.0);
+  simulate(nodes, seconds, seed, 1, 0.0);
+  simulate(nodes, seconds, seed, 0, 20.0);
+  simulate(nodes, seconds, seed, 1, 20.0);
+  return 0;
+}
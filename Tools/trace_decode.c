@@ -0,0 +1,189 @@
+/**
+ * @file 	trace_decode.c
+ * @brief	Host decoder of the trace: reads the ring from a RAM dump or the
+ * 		trace frames from a CAN capture and prints the formatted events
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Iván Guillermo Peña Flores
+ */
+
+/*
+ * Compilación, desde la raiz del repositorio:
+ *   gcc -O2 -ICore/Inc Tools/trace_decode.c -o trace_decode
+ *
+ * Los formatos se toman de trace_events.h al compilar, hay que recompilar el
+ * decodificador junto con el firmware cuando se agregan eventos.
+ *
+ * El volcado es la variable trace_buffer, por ejemplo desde gdb:
+ *   dump binary value trace.bin trace_buffer
+ *   ./trace_decode trace.bin
+ *
+ * La captura es la salida de candump -L (lineas "(tiempo) can0 78A#..."):
+ *   candump -L can0 > trace.log
+ *   ./trace_decode -c trace.log
+ *
+ * La salida tiene una linea por registro: nodo, tiempo local del nodo en
+ * segundos, nombre del evento y el mensaje formateado. El tiempo del registro
+ * son ciclos de CPU (timebase_cycles()); el contador de 32 bits se extiende al
+ * dar la vuelta entre registros consecutivos, cada ~89 s a 48 MHz, asi que un
+ * hueco mayor entre dos registros se ve mas corto.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Deben coincidir con trace.h y can_tx.h */
+#define RING_SIZE 128U
+#define MAGIC 0x54524345UL
+#define TRACE_BASE 0x780U
+#define NODES 128U
+#define CPU_HZ 48000000.0 /* SystemCoreClock */
+
+typedef struct record {
+  uint32_t time_cycles;
+  uint16_t event;
+  uint16_t arg;
+} record;
+
+typedef struct ring {
+  uint32_t magic;
+  uint32_t head;
+  record records[RING_SIZE];
+} ring;
+
+static const char* const names[] = {
+#define TRACE_EVENT(id, format) #id,
+#include "trace_events.h"
+#undef TRACE_EVENT
+};
+
+static const char* const formats[] = {
+#define TRACE_EVENT(id, format) format,
+#include "trace_events.h"
+#undef TRACE_EVENT
+};
+
+#define EVENTS (sizeof(formats) / sizeof(formats[0]))
+
+/* Tiempo extendido a 64 bits por nodo */
+static uint64_t elapsed_cycles[NODES];
+static uint32_t previous_cycles[NODES];
+static uint8_t seen[NODES];
+
+static void print_record(uint32_t node, const record* r)
+{
+  if(seen[node])
+  {
+    elapsed_cycles[node] += r->time_cycles - previous_cycles[node];
+  }
+  else
+  {
+    elapsed_cycles[node] = r->time_cycles;
+    seen[node] = 1;
+  }
+  previous_cycles[node] = r->time_cycles;
+
+  printf("%u,%.6f,", node, elapsed_cycles[node] / CPU_HZ);
+  if(r->event < EVENTS)
+  {
+    printf("%s,\"", names[r->event]);
+    printf(formats[r->event], (unsigned int)r->arg);
+    printf("\"\n");
+  }
+  else
+  {
+    printf("unknown %u,arg %u\n", r->event, r->arg);
+  }
+}
+
+static int decode_dump(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  ring dump;
+  const size_t size = fread(&dump, 1, sizeof(dump), file);
+  fclose(file);
+  if(size != sizeof(dump) || dump.magic != MAGIC)
+  {
+    fprintf(stderr, "%s: not a dump of trace_buffer\n", path);
+    return 1;
+  }
+
+  const uint32_t first = (dump.head > RING_SIZE) ? dump.head - RING_SIZE : 0U;
+  if(first > 0U)
+  {
+    fprintf(stderr, "%u records overwritten\n", first);
+  }
+  for(uint32_t index = first; index != dump.head; index++)
+  {
+    print_record(0U, &dump.records[index % RING_SIZE]);
+  }
+  return 0;
+}
+
+static int decode_capture(const char* path)
+{
+  FILE* file = fopen(path, "r");
+  if(file == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  char line[256];
+  while(fgets(line, sizeof(line), file) != NULL)
+  {
+    unsigned int id;
+    char data[17];
+    const char* frame = strchr(line, ')');
+    if(frame == NULL || sscanf(frame + 1, " %*s %x#%16s", &id, data) != 2 || strlen(data) != 16U)
+    {
+      continue;
+    }
+    if((id & ~(NODES - 1U)) != TRACE_BASE)
+    {
+      continue;
+    }
+
+    uint8_t bytes[8];
+    for(int i = 0; i < 8; i++)
+    {
+      unsigned int byte;
+      sscanf(&data[2 * i], "%2x", &byte);
+      bytes[i] = (uint8_t)byte;
+    }
+
+    const record r = {
+      .time_cycles = bytes[0] | (bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24),
+      .event = (uint16_t)(bytes[4] | (bytes[5] << 8)),
+      .arg = (uint16_t)(bytes[6] | (bytes[7] << 8))
+    };
+    print_record(id & (NODES - 1U), &r);
+  }
+  fclose(file);
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc == 3 && strcmp(argv[1], "-c") == 0)
+  {
+    printf("node,seconds,event,message\n");
+    return decode_capture(argv[2]);
+  }
+  if(argc == 2)
+  {
+    printf("node,seconds,event,message\n");
+    return decode_dump(argv[1]);
+  }
+
+  fprintf(stderr, "usage: %s <trace_buffer dump> | -c <candump -L log>\n", argv[0]);
+  return 2;
+}